@@ -0,0 +1,438 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file adaptive_map.hpp
+ *   @brief The adaptive library contains ordered sets/maps which watch how they are accessed, and move their elements
+ *   between a splay tree, which is fast when lookups keep returning to a few keys or walk the keys in order, and a
+ *   balanced tree of bs_tree.hpp, which is fast when lookups are spread over all keys.
+ *	1. adaptive_set
+ *	2. adaptive_map
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _ADAPTIVE_MAP_HPP_
+#define _ADAPTIVE_MAP_HPP_
+
+#include "bs_tree.hpp"
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+
+namespace xstl {
+    /**
+     *	@brief the tree an adaptive set/map currently stores its elements in.
+     */
+    enum class adaptive_mode { balanced, splay };
+
+    /**
+     *	@class _Adaptive_tree
+     *   @brief an ordered set/map of unique keys, whose elements live in either _Splay_tree or _Balanced_tree. Every
+     *	sample_window operations, the ratio of lookups and the locality of found elements are sampled. An element is local
+     *	if it was found recently, which is remembered by a small table of node addresses, or it is next to the element found
+     *	just before. A window where at least half of operations are lookups and at least half of lookups are local prefers
+     *	splay tree, and splay tree is kept until locality drops below a quarter.
+     *	Elements only move at safe points, namely at the beginning of insertions, erase(key) and adapt(), after at least
+     *	size() operations since the last migration, so that migrations are amortized to O(1) per operation. Migration
+     *	rebuilds the target tree from the nodes of the other one in O(n) by merge(), so it allocates no node, and pointers
+     *	and references to elements stay valid, but iterators are invalidated.
+     *	Only lookups through a non-const container are sampled. Const lookups change nothing, so they may run on several
+     *	threads at once, like those of the underlying trees.
+     */
+    template <class _Splay_tree, class _Balanced_tree>
+    class _Adaptive_tree {
+    public:
+        using key_type               = typename _Balanced_tree::key_type;
+        using value_type             = typename _Balanced_tree::value_type;
+        using key_compare            = typename _Balanced_tree::key_compare;
+        using allocator_type         = typename _Balanced_tree::allocator_type;
+        using size_type              = typename _Balanced_tree::size_type;
+        using difference_type        = typename _Balanced_tree::difference_type;
+        using reference              = typename _Balanced_tree::reference;
+        using const_reference        = typename _Balanced_tree::const_reference;
+        using iterator               = typename _Balanced_tree::iterator;
+        using const_iterator         = typename _Balanced_tree::const_iterator;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    private:
+        static constexpr bool _Is_map = !std::is_same_v<key_type, value_type>;
+
+        static_assert(std::is_same_v<iterator, typename _Splay_tree::iterator>
+                          && std::is_same_v<const_iterator, typename _Splay_tree::const_iterator>,
+                      "adaptive_map/set requires trees sharing the same node type");
+        static_assert(std::is_same_v<decltype(std::declval<_Balanced_tree&>().insert(std::declval<const value_type&>())),
+                                     std::pair<iterator, bool>>,
+                      "adaptive_map/set only supports trees of unique keys");
+
+        static constexpr size_type _Hot_slots     = 64;  // must be a power of 2
+        static constexpr size_type _Sample_period = 8;   // must be a power of 2
+
+    public:
+        static constexpr size_type sample_window = 1024;
+
+        _Adaptive_tree() = default;
+
+        explicit _Adaptive_tree(const key_compare& cmpr) : _splay(cmpr), _balanced(cmpr) {}
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Adaptive_tree(_Iter first, _Iter last, const key_compare& cmpr = key_compare()) : _Adaptive_tree(cmpr) {
+            _balanced.insert(first, last);
+        }
+
+        _Adaptive_tree(std::initializer_list<value_type> ilist, const key_compare& cmpr = key_compare())
+            : _Adaptive_tree(ilist.begin(), ilist.end(), cmpr) {}
+
+        // the sampling window is not copied, since it remembers an iterator of the source
+        _Adaptive_tree(const _Adaptive_tree& other)
+            : _splay(other._splay), _balanced(other._balanced), _mode(other._mode), _migrations(other._migrations),
+              _preferred(other._preferred), _since_migration(other._since_migration) {}
+
+        _Adaptive_tree(_Adaptive_tree&& other) noexcept
+            : _splay(std::move(other._splay)), _balanced(std::move(other._balanced)), _mode(other._mode),
+              _migrations(other._migrations), _preferred(other._preferred), _since_migration(other._since_migration) {
+            other._Reset_window();
+        }
+
+        _Adaptive_tree& operator=(const _Adaptive_tree& other) {
+            if (this != std::addressof(other))
+                _Adaptive_tree(other).swap(*this);
+            return *this;
+        }
+
+        _Adaptive_tree& operator=(_Adaptive_tree&& other) noexcept {
+            if (this != std::addressof(other))
+                _Adaptive_tree(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        XSTL_NODISCARD iterator       begin() noexcept { return _Apply([](auto& tree) { return tree.begin(); }); }
+        XSTL_NODISCARD const_iterator begin() const noexcept { return _Apply([](auto& tree) { return tree.begin(); }); }
+        XSTL_NODISCARD iterator       end() noexcept { return _Apply([](auto& tree) { return tree.end(); }); }
+        XSTL_NODISCARD const_iterator end() const noexcept { return _Apply([](auto& tree) { return tree.end(); }); }
+        XSTL_NODISCARD const_iterator cbegin() const noexcept { return begin(); }
+        XSTL_NODISCARD const_iterator cend() const noexcept { return end(); }
+        XSTL_NODISCARD reverse_iterator       rbegin() noexcept { return reverse_iterator(end()); }
+        XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+        XSTL_NODISCARD reverse_iterator       rend() noexcept { return reverse_iterator(begin()); }
+        XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+        XSTL_NODISCARD size_type size() const noexcept { return _Apply([](auto& tree) { return tree.size(); }); }
+        XSTL_NODISCARD bool      empty() const noexcept { return size() == 0; }
+        XSTL_NODISCARD size_type max_size() const noexcept { return _balanced.max_size(); }
+
+        XSTL_NODISCARD key_compare key_comp() const { return _balanced.key_comp(); }
+
+        /**
+         *	@return the tree which holds elements now
+         */
+        XSTL_NODISCARD adaptive_mode mode() const noexcept { return _mode; }
+
+        /**
+         *	@return the number of times elements have moved between trees
+         */
+        XSTL_NODISCARD size_type migrations() const noexcept { return _migrations; }
+
+        /**
+         *	@brief a safe point for workloads which only look up. Moves elements to the tree preferred by the last sampled
+         *	window if enough operations have passed since the last migration.
+         *	@return true if elements moved
+         */
+        bool adapt() { return _Safe_point(); }
+
+        /**
+         *	@brief moves elements to the tree of mode immediately, regardless of sampling.
+         */
+        void adapt(adaptive_mode mode) {
+            _preferred = mode;
+            if (mode != _mode)
+                _Migrate(mode);
+        }
+
+        template <class... _Args>
+        std::pair<iterator, bool> emplace(_Args&&... args) {
+            _Safe_point();
+            _Record_modify();
+            return _Apply([&](auto& tree) { return tree.emplace(std::forward<_Args>(args)...); });
+        }
+
+        std::pair<iterator, bool> insert(const value_type& value) { return emplace(value); }
+        std::pair<iterator, bool> insert(value_type&& value) { return emplace(std::move(value)); }
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert(_Iter first, _Iter last) {
+            for (; first != last; ++first)
+                emplace(*first);
+        }
+
+        void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        template <class _Key, class... _Mapped, bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        std::pair<iterator, bool> try_emplace(_Key&& key, _Mapped&&... mapped_value) {
+            _Safe_point();
+            _Record_modify();
+            return _Apply([&](auto& tree) {
+                return tree.try_emplace(std::forward<_Key>(key), std::forward<_Mapped>(mapped_value)...);
+            });
+        }
+
+        template <bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        auto& operator[](const key_type& key) {
+            return try_emplace(key).first->second;
+        }
+        template <bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        auto& operator[](key_type&& key) {
+            return try_emplace(std::move(key)).first->second;
+        }
+
+        template <bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        auto& at(const key_type& key) {
+            const iterator _iter = find(key);
+            if (_iter == end())
+                throw std::out_of_range("invalid adaptive_map key");
+            return _iter->second;
+        }
+        template <bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        const auto& at(const key_type& key) const {
+            const const_iterator _iter = find(key);
+            if (_iter == end())
+                throw std::out_of_range("invalid adaptive_map key");
+            return _iter->second;
+        }
+
+        /**
+         *	@brief removes the element at pos. It is not a safe point, so iterators to other elements stay valid.
+         */
+        iterator erase(const_iterator pos) {
+            _Record_modify();
+            return _Apply([&](auto& tree) { return tree.erase(pos); });
+        }
+
+        iterator erase(const_iterator first, const_iterator last) {
+            _Record_modify();
+            return _Apply([&](auto& tree) { return tree.erase(first, last); });
+        }
+
+        size_type erase(const key_type& key) {
+            _Safe_point();
+            _Record_modify();
+            return _Apply([&](auto& tree) { return tree.erase(key); });
+        }
+
+        void clear() noexcept {
+            _splay.clear();
+            _balanced.clear();
+            _last_found = false;
+        }
+
+        void swap(_Adaptive_tree& other) noexcept(std::is_nothrow_swappable_v<key_compare>) {
+            using std::swap;
+            _splay.swap(other._splay);
+            _balanced.swap(other._balanced);
+            swap(_mode, other._mode);
+            swap(_preferred, other._preferred);
+            swap(_migrations, other._migrations);
+            swap(_since_migration, other._since_migration);
+            _Reset_window();
+            other._Reset_window();
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator find(const _Key& key) {
+            const iterator _iter = _Apply([&](auto& tree) { return tree.find(key); });
+            _Record_lookup(_iter);
+            return _iter;
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator find(const _Key& key) const {
+            return _Apply([&](auto& tree) { return tree.find(key); });
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD bool contains(const _Key& key) {
+            return find(key) != end();
+        }
+        template <class _Key>
+        XSTL_NODISCARD bool contains(const _Key& key) const {
+            return find(key) != end();
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD size_type count(const _Key& key) {
+            return contains(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD size_type count(const _Key& key) const {
+            return contains(key);
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator lower_bound(const _Key& key) {
+            const iterator _iter = _Apply([&](auto& tree) { return tree.lower_bound(key); });
+            _Record_lookup(_iter);
+            return _iter;
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator lower_bound(const _Key& key) const {
+            return _Apply([&](auto& tree) { return tree.lower_bound(key); });
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator upper_bound(const _Key& key) {
+            const iterator _iter = _Apply([&](auto& tree) { return tree.upper_bound(key); });
+            _Record_lookup(_iter);
+            return _iter;
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator upper_bound(const _Key& key) const {
+            return _Apply([&](auto& tree) { return tree.upper_bound(key); });
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD std::pair<iterator, iterator> equal_range(const _Key& key) {
+            const iterator _first = lower_bound(key);
+            if (_first != end() && !key_comp()(key, _Key_of(*_first)))
+                return { _first, std::next(_first) };
+            return { _first, _first };
+        }
+        template <class _Key>
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const _Key& key) const {
+            const const_iterator _first = lower_bound(key);
+            if (_first != end() && !key_comp()(key, _Key_of(*_first)))
+                return { _first, std::next(_first) };
+            return { _first, _first };
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Adaptive_tree& lhs, const _Adaptive_tree& rhs) {
+            return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+        }
+
+    private:
+        static const key_type& _Key_of(const value_type& value) noexcept {
+            if constexpr (_Is_map)
+                return value.first;
+            else
+                return value;
+        }
+
+        template <class _Fn>
+        decltype(auto) _Apply(_Fn&& fn) {
+            if (_mode == adaptive_mode::splay)
+                return fn(_splay);
+            return fn(_balanced);
+        }
+        template <class _Fn>
+        decltype(auto) _Apply(_Fn&& fn) const {
+            if (_mode == adaptive_mode::splay)
+                return fn(_splay);
+            return fn(_balanced);
+        }
+
+        static size_type _Hot_slot(const void* node) noexcept {
+            return static_cast<size_type>((reinterpret_cast<std::uintptr_t>(node) * 0x9E3779B97F4A7C15ull) >> 32)
+                   & (_Hot_slots - 1);
+        }
+
+        /**
+         *	@brief samples a lookup which returned iter. Only one pair of consecutive lookups in _Sample_period is checked,
+         *	since walking to the neighbours of a node may miss cache. The second lookup of a pair is local if its element is
+         *	in the table of recently found elements or next to the element of the first one, which catches ascending and
+         *	descending scans.
+         */
+        void _Record_lookup(const_iterator iter) noexcept {
+            const size_type _phase = ++_lookups & (_Sample_period - 1);
+            if (_phase == _Sample_period - 1) {
+                _last       = iter;
+                _last_found = iter != end();
+            }
+            else if (_phase == 0 && iter != end()) {
+                ++_samples;
+                const void* _node = std::addressof(*iter);
+                if (_last_found && (iter == _last || std::next(_last) == iter || std::next(iter) == _last))
+                    ++_hits;
+                else if (const void*& _slot = _hot[_Hot_slot(_node)]; _slot == _node)
+                    ++_hits;
+                else
+                    _slot = _node;
+            }
+            _Tick();
+        }
+
+        void _Record_modify() noexcept {
+            _last_found = false;  // _last may be erased
+            _Tick();
+        }
+
+        /**
+         *	@brief closes the sampling window every sample_window operations and decides the preferred tree, with a gap
+         *	between the locality entering splay tree and the one leaving it, so that workloads near the threshold do not
+         *	migrate back and forth.
+         */
+        void _Tick() noexcept {
+            ++_since_migration;
+            if (++_ops < sample_window)
+                return;
+            const bool _lookup_heavy = _lookups * 2 >= _ops;
+            const bool _local = _samples != 0 && (_mode == adaptive_mode::splay ? _hits * 4 >= _samples : _hits * 2 >= _samples);
+            _preferred        = _lookup_heavy && _local ? adaptive_mode::splay : adaptive_mode::balanced;
+            _ops = _lookups = _samples = _hits = 0;
+        }
+
+        void _Reset_window() noexcept {
+            _ops = _lookups = _samples = _hits = 0;
+            _last_found                        = false;
+        }
+
+        bool _Safe_point() {
+            if (_preferred == _mode || _since_migration < size())
+                return false;
+            _Migrate(_preferred);
+            return true;
+        }
+
+        void _Migrate(adaptive_mode mode) {
+            if (mode == adaptive_mode::splay)
+                _splay.merge(_balanced);
+            else
+                _balanced.merge(_splay);
+            _mode            = mode;
+            _since_migration = 0;
+            ++_migrations;
+            _Reset_window();
+        }
+
+        _Splay_tree                         _splay;
+        _Balanced_tree                      _balanced;
+        adaptive_mode                       _mode            = adaptive_mode::balanced;
+        size_type                           _migrations      = 0;
+        adaptive_mode                       _preferred       = adaptive_mode::balanced;
+        size_type                           _since_migration = 0;  // operations since the last migration
+        size_type                           _ops             = 0;  // operations in the current window
+        size_type                           _lookups         = 0;
+        size_type                           _samples         = 0;  // checked lookups
+        size_type                           _hits            = 0;  // local ones of checked lookups
+        std::array<const void*, _Hot_slots> _hot{};                // addresses of recently found elements
+        const_iterator                      _last{};               // the first lookup of a sampled pair
+        bool                                _last_found = false;
+    };
+
+    template <class _Splay_tree, class _Balanced_tree>
+    void swap(_Adaptive_tree<_Splay_tree, _Balanced_tree>& lhs, _Adaptive_tree<_Splay_tree, _Balanced_tree>& rhs) noexcept(
+        noexcept(lhs.swap(rhs))) {
+        lhs.swap(rhs);
+    }
+
+    /**
+     * The splay tree only splays nodes deeper than 6, so a working set near the root is read without rotations, while a
+     * scan still brings each next node up.
+     */
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp),
+              template <class, class, class, class...> class _Balanced = rb_set>
+    using adaptive_set = _Adaptive_tree<splay_set<_Tp, _Compare, _Alloc, SplayDepth<6>>, _Balanced<_Tp, _Compare, _Alloc>>;
+#define MAP_VALUE_TYPE std::pair<const _Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),
+              template <class, class, class, class, class...> class _Balanced = rb_map>
+    using adaptive_map = _Adaptive_tree<splay_map<_Key, _Value, _Compare, _Alloc, SplayDepth<6>>,
+                                        _Balanced<_Key, _Value, _Compare, _Alloc>>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _ADAPTIVE_MAP_HPP_
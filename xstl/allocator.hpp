@@ -5,6 +5,7 @@
  *	1. malloc_alloc
  *	2. defualt_alloc
  *	3. unique_alloc
+ *	and segment_allocator, which allocates from a memory region shared by processes.
  *   @author Shen Xian e-mail: 865710157@qq.com
  *   @version 2.0
  */
@@ -13,11 +14,14 @@
 #define _ALLOCATORS_HPP_
 
 #include "xstl_core.hpp"
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <mutex>
 #include <new>
+#include <thread>
 #include <type_traits>
 
 #define ALIGN_SZ 8 /* the size of a memory chunk */
@@ -206,8 +210,9 @@ namespace xstl {
         if (n > MAX_SZ)
             return par_alloc::allocate(n);
 #if defined(USE_THREADS)
-        if (_Threads)
-            std::lock_guard garud(_mutex);
+        std::unique_lock<std::mutex> _guard(_mutex, std::defer_lock);
+        if constexpr (_Threads)
+            _guard.lock();
 #endif
         typename _Base::block_ptr *_free_block_ptr = _free_list + _Fit_idx(n), _res = *_free_block_ptr;
         if (_res == nullptr)                           // if there is no node in free list
@@ -226,8 +231,9 @@ namespace xstl {
         if (ptr == nullptr)
             return;
 #if defined(USE_THREADS)
-        if (_Threads)
-            std::lock_guard garud(_mutex);
+        std::unique_lock<std::mutex> _guard(_mutex, std::defer_lock);
+        if constexpr (_Threads)
+            _guard.lock();
 #endif
         typename _Base::block_ptr* _free_block_ptr = _free_list + _Fit_idx(n);
         ((typename _Base::block_ptr)ptr)->_next    = *_free_block_ptr;
@@ -342,8 +348,9 @@ namespace xstl {
     template <int _Inst, bool _Threads>
     void* unique_alloc<_Inst, _Threads>::allocate(size_t n) {
 #if defined(USE_THREADS)
-        if (_Threads)
-            std::lock_guard garud(_mutex);
+        std::unique_lock<std::mutex> _guard(_mutex, std::defer_lock);
+        if constexpr (_Threads)
+            _guard.lock();
 #endif
         block_ptr _res = _free_list_header;
         if (_res == nullptr)
@@ -358,8 +365,9 @@ namespace xstl {
         if (ptr == nullptr)
             return;
 #if defined(USE_THREADS)
-        if (_Threads)
-            std::lock_guard garud(_mutex);
+        std::unique_lock<std::mutex> _guard(_mutex, std::defer_lock);
+        if constexpr (_Threads)
+            _guard.lock();
 #endif
         ((block_ptr)ptr)->_next = _free_list_header;
         _free_list_header       = (block_ptr)ptr;
@@ -461,6 +469,228 @@ namespace xstl {
         return false;
     }
 
+    /**
+     *	@class offset_ptr
+     *	@brief a pointer which stores the distance from itself to its pointee, so that structures linked by it stay valid
+     *	wherever the memory holding them is mapped. Copying recomputes the distance from the new address. Null is stored as 1,
+     *	which cannot be the distance to an object aligned like a pointer.
+     */
+    template <class _Tp>
+    class offset_ptr {
+    public:
+        using element_type = _Tp;
+
+        offset_ptr() noexcept = default;
+        offset_ptr(std::nullptr_t) noexcept {}
+        explicit offset_ptr(_Tp* ptr) noexcept { *this = ptr; }
+        offset_ptr(const offset_ptr& x) noexcept { *this = x.get(); }
+
+        offset_ptr& operator=(const offset_ptr& x) noexcept { return *this = x.get(); }
+
+        offset_ptr& operator=(_Tp* ptr) noexcept {
+            const std::uintptr_t _self = reinterpret_cast<std::uintptr_t>(this);
+            _offset                    = ptr ? static_cast<std::intptr_t>(reinterpret_cast<std::uintptr_t>(ptr) - _self) : _Null;
+            return *this;
+        }
+
+        XSTL_NODISCARD _Tp* get() const noexcept {
+            return _offset == _Null
+                       ? nullptr
+                       : reinterpret_cast<_Tp*>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(_offset));
+        }
+
+        operator _Tp*() const noexcept { return get(); }
+
+        _Tp* operator->() const noexcept { return get(); }
+
+        template <class _Ty = _Tp, std::enable_if_t<!std::is_void_v<_Ty>, int> = 0>
+        _Ty& operator*() const noexcept {
+            return *get();
+        }
+
+    private:
+        static constexpr std::intptr_t _Null = 1;
+
+        std::intptr_t _offset = _Null;
+    };
+
+    /**
+     *	@class memory_segment
+     *	@brief the header of a memory region shared by processes, e.g. a shared memory object or a mapped file. It is placed at
+     *	the beginning of the region and refers to everything by offsets, so the region can be mapped at different addresses and
+     *	reopened as it is. Blocks are carved from the region by bumping, small ones are recycled by free lists like defualt_alloc
+     *	and larger ones by a first-fit list. Allocation does not lock by itself: writers of all processes must hold lock(), which
+     *	guards the containers living in the segment as well.
+     */
+    class memory_segment : private allocator_base {
+        using _Base = allocator_base;
+        using _Base::ALIGN;
+        using _Base::round_up;
+        enum : size_t { MAX_SZ = LIST_SZ * ALIGN };
+        enum : std::uint32_t { MAGIC = 0x47455358 };  // "XSEG"
+
+        struct _Link {  // a free small block, which may be as small as ALIGN
+            offset_ptr<_Link> _next;
+        };
+        static_assert(sizeof(_Link) <= ALIGN, "the smallest block cannot hold the link of free list");
+
+        struct _Block {  // a free large block, which is larger than MAX_SZ
+            offset_ptr<_Block> _next;
+            size_t             _size;
+        };
+
+    public:
+        /**
+         *	@brief formats the region [base, base + size) and returns its header, or nullptr if the region is too small.
+         */
+        static memory_segment* create(void* base, size_t size) noexcept {
+            if (base == nullptr || reinterpret_cast<std::uintptr_t>(base) % alignof(memory_segment) != 0
+                || size < round_up(sizeof(memory_segment)))
+                return nullptr;
+            return ::new (base) memory_segment(size);
+        }
+
+        /**
+         *	@brief returns the header of a region which has been formatted by create, or nullptr if it has not.
+         */
+        static memory_segment* open(void* base, size_t size) noexcept {
+            memory_segment* _segment = static_cast<memory_segment*>(base);
+            if (base == nullptr || size < sizeof(memory_segment) || _segment->_magic != MAGIC || _segment->_size > size)
+                return nullptr;
+            return _segment;
+        }
+
+        /**
+         *	@brief returns nullptr if the segment is exhausted.
+         */
+        void* allocate(size_t n) noexcept {
+            n = round_up(n != 0 ? n : 1);
+            if (n <= MAX_SZ) {
+                offset_ptr<_Link>& _head = _free_list[_Fit_idx(n)];
+                if (_Link* _res = _head) {
+                    _head = _res->_next;
+                    return _res;
+                }
+            }
+            else
+                for (offset_ptr<_Block>* _link = &_large_list; *_link; _link = &(*_link)->_next) {
+                    _Block* _block = *_link;
+                    if (_block->_size >= n) {
+                        const size_t _rest = _block->_size - n;
+                        *_link             = _block->_next;
+                        if (_rest >= sizeof(_Link))  // split the tail off, a smaller one goes out with the block
+                            deallocate(reinterpret_cast<char*>(_block) + n, _rest);
+                        return _block;
+                    }
+                }
+            if (_size - _top < n)
+                return nullptr;
+            void* _res = reinterpret_cast<char*>(this) + _top;
+            _top += n;
+            return _res;
+        }
+
+        void deallocate(void* ptr, size_t n) noexcept {
+            if (ptr == nullptr || n == 0)
+                return;
+            n = round_up(n);
+            if (n <= MAX_SZ) {
+                _Link*             _link = ::new (ptr) _Link;
+                offset_ptr<_Link>& _head = _free_list[_Fit_idx(n)];
+                _link->_next             = _head;
+                _head                    = _link;
+            }
+            else {
+                _Block* _block = ::new (ptr) _Block;
+                _block->_size  = n;
+                _block->_next  = _large_list;
+                _large_list    = _block;
+            }
+        }
+
+        /**
+         *	@brief the object which processes find the segment by, usually a container constructed in the segment.
+         */
+        XSTL_NODISCARD void* root() const noexcept { return _root; }
+        void                 set_root(void* ptr) noexcept { _root = ptr; }
+
+        XSTL_NODISCARD size_t size() const noexcept { return _size; }
+        XSTL_NODISCARD size_t used() const noexcept { return _top; }
+
+        /**
+         *	@brief a spin lock which works across processes. A process dying with it held leaves it held.
+         */
+        void lock() noexcept {
+            while (_lock.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+        bool try_lock() noexcept { return !_lock.test_and_set(std::memory_order_acquire); }
+        void unlock() noexcept { _lock.clear(std::memory_order_release); }
+
+    private:
+        explicit memory_segment(size_t size) noexcept : _size(size), _top(round_up(sizeof(memory_segment))) {}
+
+        inline static size_t _Fit_idx(size_t n) noexcept { return n / ALIGN - 1; }
+
+        std::uint32_t      _magic = MAGIC;
+        std::atomic_flag   _lock  = ATOMIC_FLAG_INIT;
+        size_t             _size;
+        size_t             _top;
+        offset_ptr<_Link>  _free_list[LIST_SZ];
+        offset_ptr<_Block> _large_list;
+        offset_ptr<void>   _root;
+    };
+
+    /**
+     *	@class segment_allocator
+     *	@brief allocates from a memory_segment. It refers to the segment by offset_ptr, so a container holding it can live in the
+     *	segment too. Elements must not own memory outside the segment.
+     */
+    template <class _Tp>
+    class segment_allocator {
+    public:
+        static_assert(!std::is_const_v<_Tp>, "The C++ Standard forbids containers of const elements "
+                                             "because allocator<const T> is ill-formed.");
+        static_assert(alignof(_Tp) <= allocator_base::ALIGN, "memory_segment only aligns blocks to ALIGN_SZ");
+
+        using size_type                              = size_t;
+        using difference_type                        = ptrdiff_t;
+        using value_type                             = _Tp;
+        using propagate_on_container_copy_assignment = std::false_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap            = std::true_type;
+        using is_always_equal                        = std::false_type;
+
+        explicit segment_allocator(memory_segment& segment) noexcept : _segment(std::addressof(segment)) {}
+        template <class _OtherTp>
+        segment_allocator(const segment_allocator<_OtherTp>& x) noexcept : _segment(x.segment()) {}
+
+        _Tp* allocate(size_type n, const void* = nullptr) {
+            if (n > static_cast<size_type>(-1) / sizeof(_Tp))
+                throw std::bad_array_new_length();
+            void* _res = _segment->allocate(n * sizeof(_Tp));
+            if (_res == nullptr)
+                throw std::bad_alloc();
+            return static_cast<_Tp*>(_res);
+        }
+        void deallocate(_Tp* ptr, size_type n) noexcept { _segment->deallocate(ptr, n * sizeof(_Tp)); }
+
+        XSTL_NODISCARD memory_segment* segment() const noexcept { return _segment; }
+
+    private:
+        offset_ptr<memory_segment> _segment;
+    };
+
+    template <class _Tp, class _OtherTp>
+    inline bool operator==(const segment_allocator<_Tp>& lhs, const segment_allocator<_OtherTp>& rhs) noexcept {
+        return lhs.segment() == rhs.segment();
+    }
+
+    template <class _Tp, class _OtherTp>
+    inline bool operator!=(const segment_allocator<_Tp>& lhs, const segment_allocator<_OtherTp>& rhs) noexcept {
+        return !(lhs == rhs);
+    }
+
     // propagate on container swap
     template <class _Alloc>
     void alloc_pocs(_Alloc& left, _Alloc& right) noexcept(std::allocator_traits<_Alloc>::propagate_on_container_swap::value) {
@@ -468,7 +698,7 @@ namespace xstl {
         if constexpr (std::allocator_traits<_Alloc>::propagate_on_container_swap::value)
             swap(left, right);
         else
-            XSTL_EXPECT(left != right, "containers incompatible for swap");
+            XSTL_EXPECT(left == right, "containers incompatible for swap");
     }
 
     // propagate on container copy assignment
@@ -1,12 +1,14 @@
 ﻿/*
  *   Copyright (c) 2022 Kamichanw. All rights reserved.
  *   @file allocator.hpp
- *   @brief The tree library contains 5 types of binary search trees :
+ *   @brief The tree library contains 7 types of binary search trees :
  *	1. bs_tree (Binary Search Tree)
  *	2. avl_tree (AVL Tree)
  *	3. treap_tree (Treap Tree)
  *	4. splay_tree (Splay Tree)
  *	5. rb_tree (Red Black Tree)
+ *	6. scapegoat_tree (Scapegoat Tree)
+ *	7. wb_tree (Weight Balanced Tree)
  *   @author Kami-chan e-mail: 865710157@qq.com
  */
 #pragma once
@@ -17,15 +19,24 @@
 #include "compressed_tuple.hpp"
 #include "iter_adapter.hpp"
 #include <algorithm>
-#ifndef __cpp_explicit_this_parameter
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <functional>
-#endif
 #include <iosfwd>
-#include <queue>
-#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#if USE_THREADS
+#include <future>
+#include <thread>
+#endif
 
 #undef KFN
-#define KFN(NODE) _Traits::kfn((NODE)->_value)
+#define KFN(NODE) _Traits::kfn(_Traits::_Node::value_of(NODE))
 
 namespace xstl {
     // namespace {
@@ -35,128 +46,1018 @@ namespace xstl {
      */
     enum { BLACK, RED };
 
+    /**
+     *	@class _Tree_node_ops
+     *   @brief common algorithms of tree nodes. _Node should provide _left, _right, _parent, _prop, _is_nil and _value, or
+     *   override is_nil, prop and set_prop when it stores the last two elsewhere.
+     */
+    template <class _Node>
+    struct _Tree_node_ops {
+        using _Nodeptr = _Node*;
+        using _Linkptr = _Nodeptr;  // how the header is held by tree, nodes may hide it
+
+        template <class _Alnode>
+        inline static _Nodeptr create_root(_Alnode& alloc) {
+            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
+            _Nodeptr _node = alloc.allocate(1);
+            _Node::init_node(_node, _node, _node, _node, BLACK, true);
+            return _node;
+        }
+
+        /**
+         *   @brief frees the header created by create_root, whose value has never been constructed.
+         */
+        template <class _Alnode>
+        inline static void destroy_root(_Alnode& alloc, _Nodeptr root) noexcept {
+            std::allocator_traits<_Alnode>::deallocate(alloc, root, 1);
+        }
+
+        template <class _Alnode, class... _Args>
+        inline static _Nodeptr create_node(_Alnode& alloc, _Nodeptr root, _Args&&... args) {
+            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
+            _Nodeptr _node = alloc.allocate(1);
+            try {
+                construct_node(alloc, _node, root, std::forward<_Args>(args)...);
+            } catch (...) {
+                alloc.deallocate(_node, 1);
+                throw;
+            }
+            return _node;
+        }
+
+        /**
+         *   @brief constructs a node in storage which has been allocated from alloc already.
+         */
+        template <class _Alnode, class... _Args>
+        inline static void construct_node(_Alnode& alloc, _Nodeptr node, _Nodeptr root, _Args&&... args) {
+            std::allocator_traits<_Alnode>::construct(alloc, std::addressof(node->_value), std::forward<_Args>(args)...);
+            _Node::init_node(node, root, root, root, BLACK, false);
+            _Node::cache_key(node);
+        }
+
+        /**
+         *   @brief the element held by node. Hooks of intrusive trees have no _value and return the object embedding them.
+         */
+        inline static auto& value_of(_Nodeptr node) noexcept { return node->_value; }
+
+        inline bool is_real_root() const noexcept { return _Self() == _Self()->_parent->_parent; }
+        inline bool is_left() const noexcept { return _Self() == _Self()->_parent->_left; }
+        inline bool is_right() const noexcept { return _Self() == _Self()->_parent->_right; }
+
+        /**
+         *   @brief the nil flag and the balance data of node. _Compact_tree_node packs both into its parent word, so code
+         *   shared by the nodes of bs, splay and rb trees reads and writes them through these.
+         */
+        inline bool is_nil() const noexcept { return _Self()->_is_nil; }
+        inline int  prop() const noexcept { return _Self()->_prop; }
+        inline void set_prop(const int attr) noexcept { static_cast<_Node*>(this)->_prop = attr; }
+
+        template <class _Alnode>
+        void static destroy_node(_Alnode& alloc, _Nodeptr node) noexcept {
+            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
+            std::allocator_traits<_Alnode>::destroy(alloc, std::addressof(node->_value));
+            std::allocator_traits<_Alnode>::deallocate(alloc, node, 1);
+        }
+
+        /**
+         *   @brief destroys the values of count nodes in one pass and then returns all of their storage in another, so the
+         *   allocator is not entered between destructors.
+         */
+        template <class _Alnode>
+        static void destroy_nodes(_Alnode& alloc, const _Nodeptr* nodes, size_t count) noexcept {
+            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
+            for (size_t _i = 0; _i != count; ++_i)
+                std::allocator_traits<_Alnode>::destroy(alloc, std::addressof(nodes[_i]->_value));
+            for (size_t _i = 0; _i != count; ++_i)
+                std::allocator_traits<_Alnode>::deallocate(alloc, nodes[_i], 1);
+        }
+
+        inline static _Nodeptr leftmost(_Nodeptr node) noexcept {
+            while (!node->_left->is_nil())
+                node = node->_left;
+            return node;
+        }
+
+        inline static _Nodeptr rightmost(_Nodeptr node) noexcept {
+            while (!node->_right->is_nil())
+                node = node->_right;
+            return node;
+        }
+
+        inline static _Nodeptr find_inorder_predecessor(_Nodeptr node) noexcept {
+            if (!node->_left->is_nil())
+                return rightmost(node->_left);
+            _Nodeptr _parent{};
+            while (!(_parent = node->_parent)->is_nil() && node->is_left())
+                node = _parent;
+            if (!node->is_nil())
+                node = _parent;
+            return node;
+        }
+
+        inline static _Nodeptr find_inorder_successor(_Nodeptr node) noexcept {
+            if (!node->_right->is_nil())
+                return leftmost(node->_right);
+            while (!node->_parent->is_nil() && node->is_right())
+                node = node->_parent;
+            return node->_parent;
+        }
+
+        /**
+         *   @brief keep in-order threads of nodes which have them, see _Threaded_tree_node. Other nodes find their neighbours
+         *   by parent pointers, so these do nothing.
+         */
+        inline static void thread_child(_Nodeptr) noexcept {}
+        inline static void unthread(_Nodeptr) noexcept {}
+        inline static void rethread(_Nodeptr) noexcept {}
+
+        /**
+         *   @brief refreshes what a node caches from its key, see _Prefix_tree_node. It is called whenever a node is
+         *   constructed or linked, and after its key is modified in place.
+         */
+        inline static void cache_key(_Nodeptr) noexcept {}
+
+    private:
+        inline const _Node* _Self() const noexcept { return static_cast<const _Node*>(this); }
+    };
+
     /**
      *	@class _Tree_node
      *   @brief the node of bs_tree.
      */
     template <class _Tp>
-    struct _Tree_node {
+    struct _Tree_node : _Tree_node_ops<_Tree_node<_Tp>> {
         using _Node    = _Tree_node<_Tp>;
         using _Nodeptr = _Node*;
 
-        int _prop = 0;
+        int _prop = 0;
+
+        bool     _is_nil = true;
+        _Nodeptr _left{ nullptr };
+        _Nodeptr _right{ nullptr };
+        _Nodeptr _parent{ nullptr };
+        _Tp      _value{};
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left   = left;
+            node->_right  = right;
+            node->_parent = parent;
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent, parent);
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+    };
+
+    /**
+     *	@class _Prefix_tree_node
+     *   @brief the node of bs_tree whose key is a string of char, i.e. _Tp is the string or a pair whose first is. The first
+     *	8 bytes of key are packed in big-endian order and cached next to the links, so searches compare integers first and
+     *	only read the buffer of key when the prefixes are equal. It is 8 bytes larger than _Tree_node on 64-bit platform.
+     *	Only trees comparing by operator< use it, and the layout does not depend on which std::less they use, so that
+     *	trees of std::less<> and std::less<key_type> merge.
+     */
+    template <class _Tp>
+    struct _Prefix_tree_node : _Tree_node_ops<_Prefix_tree_node<_Tp>> {
+        using _Node    = _Prefix_tree_node<_Tp>;
+        using _Nodeptr = _Node*;
+
+        int _prop = 0;
+
+        bool          _is_nil = true;
+        _Nodeptr      _left{ nullptr };
+        _Nodeptr      _right{ nullptr };
+        _Nodeptr      _parent{ nullptr };
+        std::uint64_t _prefix = 0;
+        _Tp           _value{};
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left   = left;
+            node->_right  = right;
+            node->_parent = parent;
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent, parent);
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void cache_key(_Nodeptr node) noexcept {
+            if constexpr (std::is_convertible_v<const _Tp&, std::string_view>)
+                node->_prefix = make_prefix(node->_value);
+            else
+                node->_prefix = make_prefix(node->_value.first);
+        }
+
+        /**
+         *   @brief packs the first 8 bytes of key into an integer, padding with zeros. Bytes are compared as unsigned char
+         *	like std::char_traits<char>, so if prefixes of two keys differ, they are ordered as the keys.
+         */
+        inline static std::uint64_t make_prefix(std::string_view key) noexcept {
+            const std::size_t _count  = (std::min)(key.size(), sizeof(std::uint64_t));
+            std::uint64_t     _prefix = 0;
+            for (std::size_t _i = 0; _i < _count; ++_i)
+                _prefix |= static_cast<std::uint64_t>(static_cast<unsigned char>(key[_i])) << (56 - 8 * _i);
+            return _prefix;
+        }
+    };
+
+    /**
+     *	@class _Threaded_tree_node
+     *   @brief the node of bs_tree which links its in-order predecessor and successor, so that iterators step in O(1) by
+     *	following one pointer. The header is the head of the circular thread. Rotations keep in-order, so only insertion,
+     *	removal and bulk relinking touch the thread. It is 16 bytes larger than _Tree_node on 64-bit platform.
+     */
+    template <class _Tp>
+    struct _Threaded_tree_node : _Tree_node_ops<_Threaded_tree_node<_Tp>> {
+        using _Node    = _Threaded_tree_node<_Tp>;
+        using _Nodeptr = _Node*;
+        using _Ops     = _Tree_node_ops<_Node>;
+
+        int _prop = 0;
+
+        bool     _is_nil = true;
+        _Nodeptr _left{ nullptr };
+        _Nodeptr _right{ nullptr };
+        _Nodeptr _parent{ nullptr };
+        _Nodeptr _prev{ nullptr };
+        _Nodeptr _next{ nullptr };
+        _Tp      _value{};
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left   = left;
+            node->_right  = right;
+            node->_parent = parent;
+            node->_prev   = parent;  // a detached node threads to header, and header to itself
+            node->_next   = parent;
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent, parent);
+            construct_in_place(node->_prev, parent);
+            construct_in_place(node->_next, parent);
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static _Nodeptr find_inorder_predecessor(_Nodeptr node) noexcept { return node->_prev; }
+
+        inline static _Nodeptr find_inorder_successor(_Nodeptr node) noexcept { return node->_next; }
+
+        /**
+         *   @brief threads node, which has just been linked as a leaf, between its in-order neighbours.
+         */
+        inline static void thread_child(_Nodeptr node) noexcept {
+            const _Nodeptr _parent = node->_parent;
+            _Thread_before(node, _parent->is_nil() || node == _parent->_left ? _parent : _parent->_next);
+        }
+
+        inline static void unthread(_Nodeptr node) noexcept {
+            node->_prev->_next = node->_next;
+            node->_next->_prev = node->_prev;
+        }
+
+        /**
+         *   @brief threads all nodes of the tree of header again, after the tree is linked in bulk.
+         */
+        inline static void rethread(_Nodeptr header) noexcept {
+            header->_prev = header->_next = header;
+            for (_Nodeptr _node = _Ops::leftmost(header->_parent); !_node->is_nil(); _node = _Ops::find_inorder_successor(_node))
+                _Thread_before(_node, header);
+        }
+
+    private:
+        inline static void _Thread_before(_Nodeptr node, _Nodeptr next) noexcept {
+            node->_next        = next;
+            node->_prev        = next->_prev;
+            next->_prev->_next = node;
+            next->_prev        = node;
+        }
+    };
+
+    /**
+     *	@class _Compact_link
+     *   @brief the parent word of _Compact_tree_node. The lowest bit of the word is the nil flag and the next one is the
+     *	colour, the rest is the parent pointer. It reads and assigns like a parent pointer, the flags are reached by accessors.
+     */
+    template <class _Node>
+    struct _Compact_link {
+        static constexpr std::uintptr_t nil_bit  = 0x1;
+        static constexpr std::uintptr_t prop_bit = 0x2;
+        static constexpr std::uintptr_t ptr_mask = ~(nil_bit | prop_bit);
+
+        static std::uintptr_t pack(_Node* parent, const int attr, bool is_nil) noexcept {
+            XSTL_EXPECT((attr & ~1) == 0, "compact tree node can only hold a colour");
+            return reinterpret_cast<std::uintptr_t>(parent) | (attr ? prop_bit : 0) | (is_nil ? nil_bit : 0);
+        }
+
+        // assigning a link to another only copies the parent pointer, the flags belong to the node holding the word
+        _Compact_link& operator=(const _Compact_link& x) noexcept { return *this = x.get(); }
+
+        _Compact_link& operator=(_Node* parent) noexcept {
+            _bits = reinterpret_cast<std::uintptr_t>(parent) | (_bits & ~ptr_mask);
+            return *this;
+        }
+
+        _Node* get() const noexcept { return reinterpret_cast<_Node*>(_bits & ptr_mask); }
+        operator _Node*() const noexcept { return get(); }
+        _Node* operator->() const noexcept { return get(); }
+
+        bool is_nil() const noexcept { return (_bits & nil_bit) != 0; }
+        int  prop() const noexcept { return (_bits & prop_bit) ? RED : BLACK; }
+        void set_prop(const int attr) noexcept {
+            XSTL_EXPECT((attr & ~1) == 0, "compact tree node can only hold a colour");
+            _bits = attr ? _bits | prop_bit : _bits & ~prop_bit;
+        }
+
+        std::uintptr_t _bits;
+    };
+
+    /**
+     *	@class _Compact_tree_node
+     *   @brief the node of bs_tree whose colour and nil flag are packed into the low bits of the parent pointer.
+     *	It is 8 bytes smaller than _Tree_node on 64-bit platform, but _prop can only hold BLACK or RED.
+     */
+    template <class _Tp>
+    struct _Compact_tree_node : _Tree_node_ops<_Compact_tree_node<_Tp>> {
+        using _Node    = _Compact_tree_node<_Tp>;
+        using _Nodeptr = _Node*;
+
+        _Compact_link<_Node> _parent;
+        _Nodeptr             _left{ nullptr };
+        _Nodeptr             _right{ nullptr };
+        _Tp                  _value{};
+
+        inline bool is_nil() const noexcept { return _parent.is_nil(); }
+        inline int  prop() const noexcept { return _parent.prop(); }
+        inline void set_prop(const int attr) noexcept { _parent.set_prop(attr); }
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left         = left;
+            node->_right        = right;
+            node->_parent._bits = _Compact_link<_Node>::pack(parent, attr, is_nil);
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            static_assert(alignof(_Node) >= 4, "the low bits of node pointer are not enough to hold colour and nil flag");
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent._bits, _Compact_link<_Node>::pack(parent, attr, is_nil));
+        }
+    };
+
+    /**
+     *	@class _Offset_tree_node
+     *   @brief the node of bs_tree whose links are offset_ptr, so that a tree allocated from a memory_segment, header and
+     *	nodes together, stays valid wherever the segment is mapped. Following a link costs one addition.
+     */
+    template <class _Tp>
+    struct _Offset_tree_node : _Tree_node_ops<_Offset_tree_node<_Tp>> {
+        using _Node    = _Offset_tree_node<_Tp>;
+        using _Nodeptr = _Node*;
+        using _Linkptr = offset_ptr<_Node>;
+
+        int _prop = 0;
+
+        bool     _is_nil = true;
+        _Linkptr _left;
+        _Linkptr _right;
+        _Linkptr _parent;
+        _Tp      _value{};
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left   = left;
+            node->_right  = right;
+            node->_parent = parent;
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent, parent);
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+    };
+
+    template <class _Alnode>
+    struct _Tree_temp_node {  // for exception safety
+        using _Alnode_traits = std::allocator_traits<_Alnode>;
+        using _Nodeptr       = typename _Alnode_traits::pointer;
+        using _Node          = typename std::remove_pointer_t<_Nodeptr>;
+
+        explicit _Tree_temp_node(_Alnode& alloc) : _alnode(alloc), _node(alloc.allocate(1)) {
+            _Node::init_node(_node, _node, _node, _node, BLACK, true);
+        }
+
+        template <class... _Args>
+        _Tree_temp_node(_Alnode& alloc, _Nodeptr root, _Args&&... values) : _Tree_temp_node(alloc) {
+            _Alnode_traits::construct(_alnode, std::addressof(_node->_value), std::forward<_Args>(values)...);
+            _Node::init_node(_node, root, root, root, RED, false);
+        }
+
+        _Tree_temp_node(const _Tree_temp_node&)            = delete;
+        _Tree_temp_node& operator=(const _Tree_temp_node&) = delete;
+
+        XSTL_NODISCARD _Nodeptr release() noexcept { return std::exchange(_node, nullptr); }
+
+        ~_Tree_temp_node() {
+            if (_node)
+                _Node::destroy_node(_alnode, _node);
+        }
+
+        _Nodeptr _node = nullptr;
+        _Alnode& _alnode;
+    };
+
+    /**
+     *	@class element_codec
+     *   @brief writes and reads one element for save()/load() of trees. It copies bytes of trivially copyable types and
+     *	handles key and mapped value of maps one by one. Other types need a specialization, or a codec passed to save/load,
+     *	with the same static members. Streams can be std::ostream/istream or obitstream/ibitstream.
+     */
+    template <class _Tp>
+    struct element_codec {
+        static_assert(std::is_trivially_copyable_v<_Tp>, "element_codec only copies bytes of trivially copyable types");
+
+        template <class _Ostream>
+        static void encode(_Ostream& os, const _Tp& value) {
+            os.write(reinterpret_cast<const char*>(std::addressof(value)), sizeof(_Tp));
+        }
+
+        template <class _Istream>
+        static _Tp decode(_Istream& is) {
+            _Tp _value{};
+            is.read(reinterpret_cast<char*>(std::addressof(_value)), sizeof(_Tp));
+            return _value;
+        }
+    };
+
+    template <class _Key, class _Value>
+    struct element_codec<std::pair<const _Key, _Value>> {
+        template <class _Ostream>
+        static void encode(_Ostream& os, const std::pair<const _Key, _Value>& value) {
+            element_codec<_Key>::encode(os, value.first);
+            element_codec<_Value>::encode(os, value.second);
+        }
+
+        template <class _Istream>
+        static std::pair<_Key, _Value> decode(_Istream& is) {
+            _Key _key = element_codec<_Key>::decode(is);
+            return { std::move(_key), element_codec<_Value>::decode(is) };
+        }
+    };
+
+    /**
+     *	@brief the header of a tree snapshot, which is written in native byte order.
+     */
+    struct _Tree_snapshot_header {
+        char          _magic[4]   = { 'X', 'B', 'S', 'T' };
+        std::uint8_t  _version    = 1;
+        std::uint8_t  _multi      = 0;
+        std::uint16_t _value_size = 0;  // sizeof(value_type), a snapshot of another type is rejected
+        std::uint64_t _size       = 0;
+    };
+
+    /**
+     *	@class tree_stats
+     *   @brief a snapshot of structural counters of a tree which is instantiated with TreeStats policy.
+     */
+    struct tree_stats {
+        size_t rotations;           // rotations done by rebalancing or splaying
+        size_t insert_fixup_steps;  // iterations of insert_fixup
+        size_t erase_fixup_steps;   // iterations of erase_fixup
+        size_t access_fixup_steps;  // iterations of access_fixup, only splay tree adjusts itself on access
+        size_t searches;            // calls of lower_bound/upper_bound search, including those issued by insertion
+        size_t comparisons;         // comparator calls of those searches, comparisons / searches is the mean path length
+
+        std::vector<size_t> depth_histogram;  // depth_histogram[d] is the number of nodes at depth d, the root is at depth 0
+    };
+
+    enum class _Tree_event { rotation, insert_fixup, erase_fixup, access_fixup, search, comparison, _Count };
+
+    /**
+     *	@brief per-tree state of trees without TreeStats policy. Counting is a no-op.
+     */
+    struct _Tree_state_base {
+        constexpr void count(_Tree_event) const noexcept {}
+    };
+
+    /**
+     *	@brief per-tree counters of trees with TreeStats policy. Counters are mutable, so that lookups of a const tree can
+     *	be counted too. They are relaxed atomics, since const lookups may run on several threads at once. Counts are exact,
+     *	but a snapshot taken while other threads count may mix counters from different moments.
+     */
+    struct _Tree_stats_state {
+        void count(_Tree_event event) const noexcept {
+            _counts[static_cast<size_t>(event)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        size_t get(_Tree_event event) const noexcept {
+            return _counts[static_cast<size_t>(event)].load(std::memory_order_relaxed);
+        }
+
+        void reset() noexcept {
+            for (auto& _count : _counts)
+                _count.store(0, std::memory_order_relaxed);
+        }
+
+        mutable std::atomic<size_t> _counts[static_cast<size_t>(_Tree_event::_Count)]{};
+    };
+
+    /**
+     *	@brief extends per-tree state by a finger, which is the node last found or inserted. Only non-const operations move
+     *	it, so that lookups of a const tree only read it and stay safe to run on several threads at once.
+     */
+    template <class _State, class _Node>
+    struct _Finger_tree_state : _State {
+        void forget(_Node* node) noexcept {
+            if (_finger == node)
+                _finger = nullptr;
+        }
+
+        typename _Node::_Linkptr _finger = nullptr;
+    };
+
+    /**
+     *	@brief traversal orders of _Tree_order_citer. first returns the first node of the tree of header, and next returns the
+     *	node after node. Both return header at the end. Every edge is passed at most twice, so a full scan is O(n).
+     */
+    struct _Tree_preorder {
+        template <class _Nodeptr>
+        static _Nodeptr first(_Nodeptr header) noexcept {
+            return header->_parent;
+        }
+
+        template <class _Nodeptr>
+        static _Nodeptr next(_Nodeptr node) noexcept {
+            if (!node->_left->is_nil())
+                return node->_left;
+            if (!node->_right->is_nil())
+                return node->_right;
+            for (; !node->is_real_root(); node = node->_parent)  // climbs to the first ancestor with an unvisited right
+                if (node == node->_parent->_left && !node->_parent->_right->is_nil())
+                    return node->_parent->_right;
+            return node->_parent;
+        }
+    };
+
+    struct _Tree_postorder {
+        template <class _Nodeptr>
+        static _Nodeptr first(_Nodeptr header) noexcept {
+            return header->_parent->is_nil() ? header : _Descend<_Nodeptr>(header->_parent);
+        }
+
+        template <class _Nodeptr>
+        static _Nodeptr next(_Nodeptr node) noexcept {
+            const _Nodeptr _parent = node->_parent;
+            if (!node->is_real_root() && node == _parent->_left && !_parent->_right->is_nil())
+                return _Descend<_Nodeptr>(_parent->_right);
+            return _parent;
+        }
+
+    private:
+        template <class _Nodeptr>
+        static _Nodeptr _Descend(_Nodeptr node) noexcept {  // the first node of subtree in postorder
+            while (true) {
+                if (!node->_left->is_nil())
+                    node = node->_left;
+                else if (!node->_right->is_nil())
+                    node = node->_right;
+                else
+                    return node;
+            }
+        }
+    };
+
+    /**
+     *	@class _Tree_order_citer
+     *   @brief const forward iterator of bs_tree in the traversal order _Order, which walks by parent pointers.
+     */
+    template <class _Nodeptr, class _Tp, class _Order>
+    class _Tree_order_citer {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = _Tp;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const _Tp*;
+        using reference         = const _Tp&;
+
+        _Tree_order_citer() noexcept = default;
+
+        static _Tree_order_citer begin_of(_Nodeptr header) noexcept { return _Tree_order_citer(_Order::first(header)); }
+        static _Tree_order_citer end_of(_Nodeptr header) noexcept { return _Tree_order_citer(header); }
+
+        XSTL_NODISCARD reference operator*() const noexcept {
+            XSTL_EXPECT(!_node->is_nil(), "cannot dereference end tree iterator");
+            return std::remove_pointer_t<_Nodeptr>::value_of(_node);
+        }
+        XSTL_NODISCARD pointer operator->() const noexcept { return std::addressof(**this); }
+
+        _Tree_order_citer& operator++() noexcept {
+            XSTL_EXPECT(!_node->is_nil(), "cannot increment end tree iterator");
+            _node = _Order::next(_node);
+            return *this;
+        }
+        _Tree_order_citer operator++(int) noexcept {
+            _Tree_order_citer _tmp = *this;
+            ++*this;
+            return _tmp;
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Tree_order_citer& lhs, const _Tree_order_citer& rhs) noexcept {
+            return lhs._node == rhs._node;
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Tree_order_citer& lhs, const _Tree_order_citer& rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+    private:
+        explicit _Tree_order_citer(_Nodeptr node) noexcept : _node(node) {}
+
+        _Nodeptr _node{};
+    };
+
+    /**
+     *	@class _Tree_level_citer
+     *   @brief const forward iterator of bs_tree in level order. It holds the queue of nodes to visit, whose front is the
+     *	current node, so a step is O(1) and the queue holds at most two levels. Copying an iterator copies its queue.
+     */
+    template <class _Nodeptr, class _Tp>
+    class _Tree_level_citer {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = _Tp;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const _Tp*;
+        using reference         = const _Tp&;
+
+        _Tree_level_citer() = default;
+
+        static _Tree_level_citer begin_of(_Nodeptr header) {
+            _Tree_level_citer _res;
+            if (!header->_parent->is_nil())
+                _res._queue.push_back(header->_parent);
+            return _res;
+        }
+        static _Tree_level_citer end_of(_Nodeptr) { return _Tree_level_citer(); }
+
+        XSTL_NODISCARD reference operator*() const noexcept {
+            XSTL_EXPECT(!_queue.empty(), "cannot dereference end tree iterator");
+            return std::remove_pointer_t<_Nodeptr>::value_of(_queue.front());
+        }
+        XSTL_NODISCARD pointer operator->() const noexcept { return std::addressof(**this); }
+
+        _Tree_level_citer& operator++() {
+            XSTL_EXPECT(!_queue.empty(), "cannot increment end tree iterator");
+            const _Nodeptr _node = _queue.front();
+            _queue.pop_front();
+            if (!_node->_left->is_nil())
+                _queue.push_back(_node->_left);
+            if (!_node->_right->is_nil())
+                _queue.push_back(_node->_right);
+            return *this;
+        }
+        _Tree_level_citer operator++(int) {
+            _Tree_level_citer _tmp = *this;
+            ++*this;
+            return _tmp;
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Tree_level_citer& lhs, const _Tree_level_citer& rhs) noexcept {
+            return lhs._queue.empty() ? rhs._queue.empty() : !rhs._queue.empty() && lhs._queue.front() == rhs._queue.front();
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Tree_level_citer& lhs, const _Tree_level_citer& rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+    private:
+        std::deque<_Nodeptr> _queue;
+    };
+
+    /**
+     *	@class _Tree_view
+     *   @brief all elements of the tree of header in the order of _Iter, see preorder(), postorder() and level_order().
+     *	It can be iterated any number of times.
+     */
+    template <class _Nodeptr, class _Iter>
+    class _Tree_view {
+    public:
+        using iterator       = _Iter;
+        using const_iterator = _Iter;
+
+        explicit _Tree_view(_Nodeptr header) noexcept : _header(header) {}
+
+        XSTL_NODISCARD iterator begin() const { return _Iter::begin_of(_header); }
+        XSTL_NODISCARD iterator end() const { return _Iter::end_of(_header); }
+
+    private:
+        _Nodeptr _header;
+    };
+
+    /**
+     *	@class _Frozen_citer
+     *   @brief bidirectional iterator of _Frozen_tree. It holds the 1-based index of its element in the implicit tree of
+     *	Eytzinger layout, where children of k are 2k and 2k + 1, and index 0 means end. Steps climb or descend the implicit
+     *	tree by bit operations without touching elements.
+     */
+    template <class _Tp, class _Size>
+    class _Frozen_citer {
+        template <class, class, bool>
+        friend class _Frozen_tree;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = _Tp;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const _Tp*;
+        using reference         = const _Tp&;
+
+        _Frozen_citer() noexcept = default;
+
+        XSTL_NODISCARD reference operator*() const noexcept {
+            XSTL_EXPECT(_index != 0, "cannot dereference end frozen iterator");
+            return _data[_index - 1];
+        }
+        XSTL_NODISCARD pointer operator->() const noexcept { return std::addressof(**this); }
+
+        _Frozen_citer& operator++() noexcept {
+            XSTL_EXPECT(_index != 0, "cannot increment end frozen iterator");
+            _index = next(_index, _size);
+            return *this;
+        }
+        _Frozen_citer operator++(int) noexcept {
+            _Frozen_citer _tmp = *this;
+            ++*this;
+            return _tmp;
+        }
+
+        _Frozen_citer& operator--() noexcept {
+            XSTL_EXPECT(_index != first(_size), "cannot decrement begin frozen iterator");
+            _index = prev(_index, _size);
+            return *this;
+        }
+        _Frozen_citer operator--(int) noexcept {
+            _Frozen_citer _tmp = *this;
+            --*this;
+            return _tmp;
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Frozen_citer& lhs, const _Frozen_citer& rhs) noexcept {
+            return lhs._index == rhs._index;
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Frozen_citer& lhs, const _Frozen_citer& rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+        /**
+         *	@return index of the leftmost element of an implicit tree of size elements, or 0 if it is empty
+         */
+        static _Size first(_Size size) noexcept {
+            if (size == 0)
+                return 0;
+            _Size _index = 1;
+            while (_index * 2 <= size)
+                _index *= 2;
+            return _index;
+        }
+
+        static _Size next(_Size index, _Size size) noexcept {
+            if (index * 2 + 1 <= size) {  // leftmost of right subtree
+                for (index = index * 2 + 1; index * 2 <= size; index *= 2)
+                    ;
+                return index;
+            }
+            return index >> (std::countr_one(index) + 1);  // climb while index is a right child, then go to parent
+        }
+
+        static _Size prev(_Size index, _Size size) noexcept {
+            if (index == 0) {  // rightmost of tree
+                for (index = 1; index * 2 + 1 <= size; index = index * 2 + 1)
+                    ;
+                return index;
+            }
+            if (index * 2 <= size) {  // rightmost of left subtree
+                for (index *= 2; index * 2 + 1 <= size; index = index * 2 + 1)
+                    ;
+                return index;
+            }
+            return index >> (std::countr_zero(index) + 1);  // climb while index is a left child, then go to parent
+        }
+
+    private:
+        _Frozen_citer(const _Tp* data, _Size size, _Size index) noexcept : _data(data), _size(size), _index(index) {}
+
+        const _Tp* _data  = nullptr;
+        _Size      _size  = 0;
+        _Size      _index = 0;
+    };
+
+    /**
+     *	@class _Frozen_tree
+     *   @brief an immutable ordered index made by freeze(). All elements are stored in a single array in Eytzinger layout,
+     *	namely the level order of a complete binary tree, so a search touches no pointer. The top levels are shared by
+     *	all searches and stay in cache, and a search prefetches the cache line of its descendants four levels below, whose
+     *	16 elements are adjacent. Searches choose children by a comparison result rather than a branch.
+     */
+    template <class _Cate, class _Alloc, bool _Mfl>
+    class _Frozen_tree {
+    public:
+        using key_type               = typename _Cate::key_type;
+        using value_type             = typename _Cate::value_type;
+        using key_compare            = typename _Cate::key_compare;
+        using value_compare          = typename _Cate::value_compare;
+        using allocator_type         = _Alloc;
+        using size_type              = typename std::allocator_traits<_Alloc>::size_type;
+        using difference_type        = typename std::allocator_traits<_Alloc>::difference_type;
+        using reference              = const value_type&;
+        using const_reference        = const value_type&;
+        using const_iterator         = _Frozen_citer<value_type, size_type>;
+        using iterator               = const_iterator;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+        using reverse_iterator       = const_reverse_iterator;
+
+    private:
+        static constexpr bool      _Multi           = _Mfl;
+        static constexpr size_type _Prefetch_stride = 16;  // descendants four levels below
+
+    public:
+        _Frozen_tree() : _tpl(std::ignore, std::ignore) {}
+
+        /**
+         *	@brief constructs an index of size elements of [first, last), which must be sorted by key.
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Frozen_tree(_Iter first, _Iter last, size_type size, const key_compare& cmpr = key_compare(),
+                     const allocator_type& alloc = allocator_type())
+            : _tpl(cmpr, alloc) {
+            std::vector<const value_type*> _slots(size + 1);
+            for (size_type _index = const_iterator::first(size); first != last; ++first) {
+                XSTL_EXPECT(_index != 0, "frozen tree is built from too many elements");
+                _slots[_index] = std::addressof(*first);
+                _index         = const_iterator::next(_index, size);
+            }
+            _Get_vals().reserve(size);
+            for (size_type _index = 1; _index <= size; ++_index)
+                _Get_vals().emplace_back(*_slots[_index]);
+        }
+
+        XSTL_NODISCARD const_iterator begin() const noexcept { return _Make_iter(const_iterator::first(size())); }
+        XSTL_NODISCARD const_iterator end() const noexcept { return _Make_iter(0); }
+        XSTL_NODISCARD const_iterator cbegin() const noexcept { return begin(); }
+        XSTL_NODISCARD const_iterator cend() const noexcept { return end(); }
+        XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+        XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+        XSTL_NODISCARD const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+        XSTL_NODISCARD const_reverse_iterator crend() const noexcept { return rend(); }
 
-        bool     _is_nil = true;
-        _Nodeptr _left{ nullptr };
-        _Nodeptr _right{ nullptr };
-        _Nodeptr _parent{ nullptr };
-        _Tp      _value{};
+        XSTL_NODISCARD size_type size() const noexcept { return _Get_vals().size(); }
+        XSTL_NODISCARD bool      empty() const noexcept { return _Get_vals().empty(); }
 
-        template <class _Alnode>
-        inline static _Nodeptr create_root(_Alnode& alloc) {
-            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
-            _Nodeptr _node = alloc.allocate(1);
-            init_node(_node, _node, _node, _node, BLACK, true);
-            return _node;
+        /**
+         *   @brief return an iterator pointing to the first element that is not less than key.
+         */
+        XSTL_NODISCARD const_iterator lower_bound(const key_type& key) const { return _Make_iter(_Lower_bound(key)); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator lower_bound(const _Key& key) const {
+            return _Make_iter(_Lower_bound(key));
         }
 
-        template <class _Alnode, class... _Args>
-        inline static _Nodeptr create_node(_Alnode& alloc, _Nodeptr root, _Args&&... args) {
-            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
-            _Nodeptr _node = alloc.allocate(1);
-            std::allocator_traits<_Alnode>::construct(alloc, std::addressof(_node->_value), std::forward<_Args>(args)...);
-            init_node(_node, root, root, root, BLACK, false);
-            return _node;
+        /**
+         *   @brief return an iterator pointing to the first element that is greater than key.
+         */
+        XSTL_NODISCARD const_iterator upper_bound(const key_type& key) const { return _Make_iter(_Upper_bound(key)); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator upper_bound(const _Key& key) const {
+            return _Make_iter(_Upper_bound(key));
         }
 
-        inline bool is_real_root() const noexcept { return this == _parent->_parent; }
-        inline bool is_left() const noexcept { return this == _parent->_left; }
-        inline bool is_right() const noexcept { return this == _parent->_right; }
-
-        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
-                                       bool is_nil) {
-            node->_left   = left;
-            node->_right  = right;
-            node->_parent = parent;
-            node->_prop   = attr;
-            node->_is_nil = is_nil;
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const {
+            return _Equal_range(key);
         }
-
-        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
-            construct_in_place(node->_left, left);
-            construct_in_place(node->_right, right);
-            construct_in_place(node->_parent, parent);
-            node->_prop   = attr;
-            node->_is_nil = is_nil;
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const _Key& key) const {
+            return _Equal_range(key);
         }
 
-        template <class _Alnode>
-        void static destroy_node(_Alnode& alloc, _Nodeptr node) noexcept {
-            static_assert(std::is_same_v<typename _Alnode::value_type, _Node>, "Allocator's value_type is not consist with node");
-            std::allocator_traits<_Alnode>::destroy(alloc, std::addressof(node->_value));
-            std::allocator_traits<_Alnode>::deallocate(alloc, node, 1);
+        XSTL_NODISCARD const_iterator find(const key_type& key) const { return _Make_iter(_Find(key)); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator find(const _Key& key) const {
+            return _Make_iter(_Find(key));
         }
 
-        inline static _Nodeptr leftmost(_Nodeptr node) noexcept {
-            while (!node->_left->_is_nil)
-                node = node->_left;
-            return node;
+        XSTL_NODISCARD size_type count(const key_type& key) const { return _Count(key); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD size_type count(const _Key& key) const {
+            return _Count(key);
         }
 
-        inline static _Nodeptr rightmost(_Nodeptr node) noexcept {
-            while (!node->_right->_is_nil)
-                node = node->_right;
-            return node;
+        XSTL_NODISCARD bool contains(const key_type& key) const { return _Find(key) != 0; }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD bool contains(const _Key& key) const {
+            return _Find(key) != 0;
         }
 
-        inline static _Nodeptr find_inorder_predecessor(_Nodeptr node) noexcept {
-            if (!node->_left->_is_nil)
-                return rightmost(node->_left);
-            _Nodeptr _parent{};
-            while (!(_parent = node->_parent)->_is_nil && node->is_left())
-                node = _parent;
-            if (!node->_is_nil)
-                node = _parent;
-            return node;
+        /**
+         *	@return the mapped value of the element with key, which must be present
+         */
+        XSTL_REQUIRES(!_Mfl && !std::is_same_v<key_type, value_type>)
+        XSTL_NODISCARD const auto& at(const key_type& key) const {
+            const size_type _index = _Find(key);
+            if (_index == 0)
+                throw std::out_of_range("invalid frozen map<K, T> key");
+            return _Get_vals()[_index - 1].second;
         }
 
-        inline static _Nodeptr find_inorder_successor(_Nodeptr node) noexcept {
-            if (!node->_right->_is_nil)
-                return leftmost(node->_right);
-            while (!node->_parent->_is_nil && node->is_right())
-                node = node->_parent;
-            return node->_parent;
+        XSTL_NODISCARD key_compare    key_comp() const { return _Get_cmpr(); }
+        XSTL_NODISCARD allocator_type get_allocator() const noexcept { return _Get_vals().get_allocator(); }
+
+    private:
+        const_iterator _Make_iter(size_type index) const noexcept {
+            return const_iterator(_Get_vals().data(), size(), index);
         }
-    };
 
-    template <class _Alnode>
-    struct _Tree_temp_node {  // for exception safety
-        using _Alnode_traits = std::allocator_traits<_Alnode>;
-        using _Nodeptr       = typename _Alnode_traits::pointer;
-        using _Node          = typename std::remove_pointer_t<_Nodeptr>;
+        /**
+         *	@brief descends the implicit tree, going right if pred holds for the key of current element. The path ends
+         *	below a leaf, and the answer is the last element where it went left, i.e. the parent after dropping the
+         *	trailing right turns and the final left turn.
+         *	@return index of the first element whose key satisfies !pred(key), or 0 if there is no such element
+         */
+        template <class _Pred>
+        size_type _Partition_point(_Pred pred) const {
+            const value_type* const _data  = _Get_vals().data();
+            const size_type         _size  = size();
+            size_type               _index = 1;
+            while (_index <= _size) {
+                XSTL_PREFETCH(_data + ((std::min)(_index * _Prefetch_stride, _size) - 1));
+                _index = 2 * _index + static_cast<size_type>(pred(_Cate::kfn(_data[_index - 1])));
+            }
+            return _index >> (std::countr_one(_index) + 1);
+        }
 
-        explicit _Tree_temp_node(_Alnode& alloc) : _alnode(alloc), _node(alloc.allocate(1)) {
-            _Node::init_node(_node, _node, _node, _node, BLACK, true);
+        template <class _Key>
+        size_type _Lower_bound(const _Key& key) const {
+            return _Partition_point([&](const auto& curr) { return _Get_cmpr()(curr, key); });
         }
 
-        template <class... _Args>
-        _Tree_temp_node(_Alnode& alloc, _Nodeptr root, _Args&&... values) : _Tree_temp_node(alloc) {
-            _Alnode_traits::construct(_alnode, std::addressof(_node->_value), std::forward<_Args>(values)...);
-            _Node::init_node(_node, root, root, root, RED, false);
+        template <class _Key>
+        size_type _Upper_bound(const _Key& key) const {
+            return _Partition_point([&](const auto& curr) { return !_Get_cmpr()(key, curr); });
         }
 
-        _Tree_temp_node(const _Tree_temp_node&)            = delete;
-        _Tree_temp_node& operator=(const _Tree_temp_node&) = delete;
+        template <class _Key>
+        size_type _Find(const _Key& key) const {
+            const size_type _index = _Lower_bound(key);
+            return _index == 0 || _Get_cmpr()(key, _Cate::kfn(_Get_vals()[_index - 1])) ? 0 : _index;
+        }
 
-        XSTL_NODISCARD _Nodeptr release() noexcept { return std::exchange(_node, nullptr); }
+        template <class _Key>
+        std::pair<const_iterator, const_iterator> _Equal_range(const _Key& key) const {
+            const size_type _first = _Lower_bound(key);
+            if constexpr (_Multi)
+                return { _Make_iter(_first), _Make_iter(_Upper_bound(key)) };
+            else if (_first == 0 || _Get_cmpr()(key, _Cate::kfn(_Get_vals()[_first - 1])))
+                return { _Make_iter(_first), _Make_iter(_first) };
+            else
+                return { _Make_iter(_first), _Make_iter(const_iterator::next(_first, size())) };
+        }
 
-        ~_Tree_temp_node() {
-            if (_node)
-                _Node::destroy_node(_alnode, _node);
+        template <class _Key>
+        size_type _Count(const _Key& key) const {
+            if constexpr (_Multi) {
+                const auto _range = _Equal_range(key);
+                return static_cast<size_type>(std::distance(_range.first, _range.second));
+            } else
+                return _Find(key) != 0;
         }
 
-        _Nodeptr _node = nullptr;
-        _Alnode& _alnode;
+        inline const key_compare&                     _Get_cmpr() const noexcept { return std::get<0>(_tpl); }
+        inline std::vector<value_type, _Alloc>&       _Get_vals() noexcept { return std::get<1>(_tpl); }
+        inline const std::vector<value_type, _Alloc>& _Get_vals() const noexcept { return std::get<1>(_tpl); }
+
+        compressed_tuple<key_compare, std::vector<value_type, _Alloc>> _tpl;
     };
 
     /**
@@ -176,130 +1077,11 @@ namespace xstl {
         using reference       = value_type&;
         using const_reference = const value_type&;
 
-#ifdef PREORDER_ITERATOR
-        static void incr(_Nodeptr& node) noexcept {
-            if (!node->_left->_is_nil)
-                node = node->_left;
-            else if (!node->_right->_is_nil)
-                node = node->_right;
-            else {
-                _Nodeptr _suc = node->_parent;
-                while (node != _suc->_parent) {
-                    if (node == _suc->_left && !_suc->_right->_is_nil) {
-                        node = _suc->_right;
-                        return;
-                    }
-                    node = std::exchange(_suc, _suc->_parent);
-                }
-                node = _suc;
-            }
-        }
-
-        static void _Decr(_Nodeptr& node) noexcept {
-            if (node->_is_nil) {
-                node = node->_right;
-                while (!node->_left->_is_nil || !node->_right->_is_nil) {
-                    node = _Node::rightmost(node);
-                    if (!node->_left->_is_nil)
-                        node = node->_left;
-                }
-            }
-            else {
-                _Nodeptr _pre = node->_parent;
-                if (node->is_right() && !_pre->_left->_is_nil && !node->is_real_root()) {
-                    _pre = _pre->_left;
-                    while (!_pre->_right->_is_nil || !_pre->_left->_is_nil) {
-                        _pre = _Node::rightmost(_pre);
-                        if (!_pre->_left->_is_nil)
-                            _pre = _pre->_left;
-                    }
-                }
-                node = _pre;
-            }
-        }
-#elif defined POSTORDER_ITERATOR
-        static void incr(_Nodeptr& node) noexcept {
-            _Nodeptr _suc = node->_parent;
-            if (node->is_left() && !_suc->_right->_is_nil && !node->is_real_root()) {
-                _suc = _suc->_right;
-                while (!_suc->_left->_is_nil || !_suc->_right->_is_nil) {
-                    _suc = _Node::leftmost(_suc);
-                    if (!_suc->_right->_is_nil)
-                        _suc = _suc->_right;
-                }
-            }
-            node = _suc;
-        }
-
-        static void _Decr(_Nodeptr& node) noexcept {
-            if (node->_is_nil)
-                node = node->_parent;
-            else if (!node->_right->_is_nil)
-                node = node->_right;
-            else if (!node->_left->_is_nil)
-                node = node->_left;
-            else {
-                for (_Nodeptr _pre = node->_parent;; _pre = _pre->_parent) {
-                    if (node == _pre->_right && !_pre->_left->_is_nil) {
-                        node = _pre->_left;
-                        return;
-                    }
-                    node = _pre;
-                }
-            }
-        }
-#elif defined LEVEL_ORDER_ITERATOR
-        static _Nodeptr _Fwd_explore(_Nodeptr node, size_type height) noexcept {
-            if (height == 0 || node->_is_nil)
-                return node;
-            _Nodeptr _res = _Fwd_explore(node->_left, height - 1);
-            if (!_res->_is_nil)
-                return _res;
-            return _Fwd_explore(node->_right, height - 1);
-        }
-
-        static _Nodeptr _Incr(_Nodeptr node, size_type height = 0) noexcept {
-            if (node->is_real_root())
-                return _Fwd_explore(node, height + 1);
-            if (node->is_left()) {
-                _Nodeptr _res = _Fwd_explore(node->_parent->_right, height);
-                if (!_res->_is_nil)
-                    return _res;
-            }
-            return _Incr(node->_parent, height + 1);
-        }
-
-        static void incr(_Nodeptr& node) noexcept { node = _Incr(node); }
-
-        static _Nodeptr _Backwd_explore(_Nodeptr node, int height) noexcept {
-            if (height == 0 || node->_is_nil)
-                return node;
-            _Nodeptr _res = _Backwd_explore(node->_right, height - 1);
-            if (!_res->_is_nil)
-                return _res;
-            return _Backwd_explore(node->_left, height - 1);
-        }
-
-        static _Nodeptr _Decr(_Nodeptr node, int height) noexcept {
-            if (node->is_real_root())
-                return _Backwd_explore(node, height - 1);
-            if (node->is_right()) {
-                _Nodeptr _res = _Backwd_explore(node->_parent->_left, height);
-                if (!_res->_is_nil)
-                    return _res;
-            }
-            return _Decr(node->_parent, height + 1);
-        }
-
-        static void _Decr(_Nodeptr& node) noexcept { node = _Decr(node, 0); }
-#else  // INORDER_ITERATOR
-
         static void incr(_Nodeptr& node) noexcept { node = _Node::find_inorder_successor(node); }
 
         static void _Decr(_Nodeptr& node) noexcept {
-            node = node->_is_nil ? node->_right : _Node::find_inorder_predecessor(node);
+            node = node->is_nil() ? node->_right : _Node::find_inorder_predecessor(node);
         }
-#endif
 
         static void decr(_Nodeptr& node) noexcept {
             auto _oldnode = node;
@@ -307,11 +1089,11 @@ namespace xstl {
             _Decr(node);
             XSTL_EXPECT(_oldnode != node, "iterators cannot decrease");
         }
-        static value_type& extract(_Nodeptr node) noexcept { return node->_value; }
+        static value_type& extract(_Nodeptr node) noexcept { return _Node::value_of(node); }
 
         static bool dereferable(const _Self* tree, _Nodeptr node) noexcept { return node != tree->_root; }
 
-        static bool increasable(const _Self*, _Nodeptr node) noexcept { return !node->_is_nil; }
+        static bool increasable(const _Self*, _Nodeptr node) noexcept { return !node->is_nil(); }
 
         static bool decreasable(const _Self* tree, _Nodeptr node) noexcept {
             return true;  // always true because verification should be after decreasing
@@ -325,7 +1107,7 @@ namespace xstl {
 
         void init() noexcept { _Node::assign_node(_root, _root, _root, _root, BLACK, true); }
 
-        _Nodeptr _root{};
+        typename _Node::_Linkptr _root{};
     };
     //}  // namespace
     /**
@@ -342,6 +1124,7 @@ namespace xstl {
         using _Altp_traits              = typename _Traits::_Altp_traits;
         using _Alnode_type              = typename _Altp_traits::template rebind_alloc<_Node>;
         using _Alnode_traits            = std::allocator_traits<_Alnode_type>;
+        using _Tree_state               = typename _Traits::_Tree_state;
 
     public:
         friend struct _Tree_accessor;
@@ -361,13 +1144,19 @@ namespace xstl {
 
         using const_iterator = typename _Traits::const_iterator;
         using iterator       = typename _Traits::iterator;
-#ifndef LEVEL_ORDER_ITERATOR
         using const_reverse_iterator = std::reverse_iterator<const_iterator>;
         using reverse_iterator       = std::reverse_iterator<iterator>;
-#endif
-        using node_type = typename _Traits::node_type;
+        using node_type              = typename _Traits::node_type;
+        using preorder_view          = _Tree_view<_Nodeptr, _Tree_order_citer<_Nodeptr, value_type, _Tree_preorder>>;
+        using postorder_view         = _Tree_view<_Nodeptr, _Tree_order_citer<_Nodeptr, value_type, _Tree_postorder>>;
+        using level_order_view       = _Tree_view<_Nodeptr, _Tree_level_citer<_Nodeptr, value_type>>;
+        using frozen_type            = _Frozen_tree<typename _Traits::_Traits_category, allocator_type, _Traits::_Multi>;
 
-        static constexpr bool _Multi = _Traits::_Multi;
+        static constexpr bool      _Multi       = _Traits::_Multi;
+        static constexpr size_type _Batch_width = 8;  // lookups in flight of _Find_batch
+
+        static constexpr size_type _Merge_splice_ratio  = 64;  // merge splices a source smaller than 1/64 of tree node by node
+        static constexpr size_type _Merge_rebuild_ratio = 2;   // merge rebuilds both trees for a source larger than 1/2 of tree
 
         struct insert_return_type {
             iterator  position;
@@ -378,27 +1167,11 @@ namespace xstl {
     public:
         XSTL_NODISCARD iterator       begin() noexcept { return _Make_iter(cbegin().base()); }
         XSTL_NODISCARD const_iterator begin() const noexcept { return cbegin(); }
-        XSTL_NODISCARD const_iterator cbegin() const noexcept {
-            _Nodeptr _root = _Get_root();
-#if defined(PREORDER_ITERATOR) || defined(LEVEL_ORDER_ITERATOR)
-            return _Make_citer(_root->_parent);
-#elif defined POSTORDER_ITERATOR
-            _Nodeptr _curr = _root->_left != _root->_parent ? _root->_left : _root->_right;
-            while (!_curr->_left->_is_nil || !_curr->_right->_is_nil) {
-                _curr = _Node::leftmost(_curr);
-                if (!_curr->_right->_is_nil)
-                    _curr = _curr->_right;
-            }
-            return _Make_citer(_curr);
-#else
-            return _Make_citer(_root->_left);
-#endif
-        }
+        XSTL_NODISCARD const_iterator cbegin() const noexcept { return _Make_citer(_Get_root()->_left); }
         XSTL_NODISCARD iterator       end() noexcept { return _Make_iter(_Get_root()); }
         XSTL_NODISCARD const_iterator end() const noexcept { return cend(); }
         XSTL_NODISCARD const_iterator cend() const noexcept { return _Make_citer(const_cast<_Nodeptr>(_Get_root())); }
 
-#ifndef LEVEL_ORDER_ITERATOR
         XSTL_NODISCARD reverse_iterator       rbegin() noexcept { return reverse_iterator(_Make_iter(crbegin().base().base())); }
         XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return crbegin(); }
 
@@ -408,7 +1181,14 @@ namespace xstl {
         XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return crend(); }
 
         XSTL_NODISCARD const_reverse_iterator crend() const noexcept { return const_reverse_iterator(cbegin()); }
-#endif
+
+        /**
+         *	@brief views elements in preorder, postorder or level order. Each view visits all elements in O(n), and its
+         *	iterators are invalidated as iterators of the tree are. Elements cannot be modified through views.
+         */
+        XSTL_NODISCARD preorder_view    preorder() const noexcept { return preorder_view(_Get_root()); }
+        XSTL_NODISCARD postorder_view   postorder() const noexcept { return postorder_view(_Get_root()); }
+        XSTL_NODISCARD level_order_view level_order() const noexcept { return level_order_view(_Get_root()); }
         /**
          *	@brief constructs an empty bs_tree.
          *	@param cmpr : comparison function object to use for all comparisons of keys
@@ -416,9 +1196,9 @@ namespace xstl {
          */
         _Bs_tree() { _Init(); }
 
-        explicit _Bs_tree(const key_compare& cmpr) : _tpl(cmpr, std::ignore, std::ignore) { _Init(); }
+        explicit _Bs_tree(const key_compare& cmpr) : _tpl(cmpr, std::ignore, std::ignore, std::ignore) { _Init(); }
 
-        _Bs_tree(const key_compare& cmpr, const allocator_type& alloc) : _tpl(cmpr, alloc, std::ignore) { _Init(); }
+        _Bs_tree(const key_compare& cmpr, const allocator_type& alloc) : _tpl(cmpr, alloc, std::ignore, std::ignore) { _Init(); }
 
         /**
          *   @brief constructs the bs_tree with the copy of the contents of other.
@@ -428,23 +1208,23 @@ namespace xstl {
          */
         _Bs_tree(const _Bs_tree& other) : _Bs_tree(other, other._Getal()) {}
 
-        _Bs_tree(const _Bs_tree& other, const allocator_type& alloc) : _tpl(other.key_comp(), alloc, std::ignore) {
+        _Bs_tree(const _Bs_tree& other, const allocator_type& alloc) : _tpl(other.key_comp(), alloc, std::ignore, std::ignore) {
             _Init();
-            scoped_guard _guard([&] { _Node::destroy_node(_Getal(), _Get_root()); });
+            scoped_guard _guard([&] { _Node::destroy_root(_Getal(), _Get_root()); });
             _Copy<copy_op_tag>(other);
             _guard.dismiss();
         }
 
-        _Bs_tree(_Bs_tree&& other) : _tpl(other.key_cmpr(), other._Getal(), std::ignore) {
+        _Bs_tree(_Bs_tree&& other) : _tpl(other.key_comp(), other._Getal(), std::ignore, std::ignore) {
             _Init();
             _Swap_excluding_cmpr(other);
         }
 
-        _Bs_tree(_Bs_tree&& other, const allocator_type& alloc) : _tpl(other.key_comp(), alloc, std::ignore) {
+        _Bs_tree(_Bs_tree&& other, const allocator_type& alloc) : _tpl(other.key_comp(), alloc, std::ignore, std::ignore) {
             _Init();
             if constexpr (!_Alnode_traits::is_always_equal::value) {
                 if (_Getal() != other._Getal()) {
-                    scoped_guard _guard([&] { _Node::destroy_node(_Getal(), _Get_root()); });
+                    scoped_guard _guard([&] { _Node::destroy_root(_Getal(), _Get_root()); });
                     _Copy<move_op_tag>(other);
                     _guard.dismiss();
                     return;
@@ -593,6 +1373,14 @@ namespace xstl {
 
             return _Emplace_hint(position.base(), std::forward<_Args>(values)...);
         }
+        /**
+         *   @brief inserts a new element after the last one in amortized O(1) if its key is greater than (or equal to, for
+         *	multi trees) the last key, which is the common case of ingesting sorted keys. Otherwise it is inserted as emplace.
+         *   @param values : arguments to forward to the constructor of the element
+         *	@return a pair consisting of an iterator to the inserted element
+         */
+        template <class... _Args>
+        std::pair<iterator, bool> append_back(_Args&&... values);
 
         /**
          *   @brief return an iterator pointing to the first element that is not less than key.
@@ -649,6 +1437,72 @@ namespace xstl {
         template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
         XSTL_NODISCARD bool contains(const _Key& key) const;
 
+        /**
+         *	@brief writes a snapshot of the tree, namely a header of its size and multiplicity followed by all elements in
+         *	order, each written by _Codec.
+         *	@param os : std::ostream or obitstream to write to.
+         */
+        template <class _Codec = element_codec<value_type>, class _Ostream>
+        void save(_Ostream& os) const;
+
+        /**
+         *	@brief replaces contents by a snapshot written by save of a tree with an equivalent comparator. Elements are linked
+         *	into a balanced tree in O(n) without comparisons or rebalancing. If the snapshot is malformed, failbit of is is set
+         *	and contents are unchanged.
+         *	@param is : std::istream or ibitstream to read from.
+         */
+        template <class _Codec = element_codec<value_type>, class _Istream>
+        void load(_Istream& is);
+
+        /**
+         *	@brief copies all elements into an immutable index in Eytzinger layout, see _Frozen_tree. It costs O(n) and
+         *	leaves the tree unchanged.
+         */
+        XSTL_NODISCARD frozen_type freeze() const { return frozen_type(cbegin(), cend(), _size, key_comp(), get_allocator()); }
+
+        /**
+         *	@brief finds every key in [first, last). Lookups run in groups in lock-step and prefetch their next nodes, so that
+         *	cache misses of different lookups overlap. Lookups of a sorted group compare shared nodes of their paths once.
+         *	@param first : the beginning of range of keys to search for.
+         *	@param last : the end of range of keys to search for.
+         *	@param out : receives an iterator for every key in order, which is end() if there is no such element.
+         *	@return output iterator past the last element written.
+         */
+        template <class _Iter, class _OutIter, XSTL_REQUIRES_(is_forward_iterator_v<_Iter>)>
+        _OutIter find_batch(_Iter first, _Iter last, _OutIter out) {
+            _Find_batch(first, last, [&](_Nodeptr node) {
+                if (!node->is_nil())
+                    _Traits::access_fixup(this, node);
+                *out = _Make_iter(node);
+                ++out;
+            });
+            return out;
+        }
+        template <class _Iter, class _OutIter, XSTL_REQUIRES_(is_forward_iterator_v<_Iter>)>
+        _OutIter find_batch(_Iter first, _Iter last, _OutIter out) const {
+            _Find_batch(first, last, [&](_Nodeptr node) {
+                *out = _Make_citer(node);
+                ++out;
+            });
+            return out;
+        }
+
+        /**
+         *	@brief checks every key in [first, last) like find_batch.
+         *	@param first : the beginning of range of keys to search for.
+         *	@param last : the end of range of keys to search for.
+         *	@param out : receives whether there is an element with key equivalent to every key in order.
+         *	@return output iterator past the last element written.
+         */
+        template <class _Iter, class _OutIter, XSTL_REQUIRES_(is_forward_iterator_v<_Iter>)>
+        _OutIter contains_batch(_Iter first, _Iter last, _OutIter out) const {
+            _Find_batch(first, last, [&](_Nodeptr node) {
+                *out = !node->is_nil();
+                ++out;
+            });
+            return out;
+        }
+
         /*
          *	@brief unlinks the node that contains the element pointed to by position and returns a node handle that owns it
          *	@param position : a valid iterator into this container
@@ -666,7 +1520,11 @@ namespace xstl {
         /*
         *	@brief Attempts to extract each element in source and insert it into *this using the comparison object of *this.
         If there is an element in *this with key equivalent to the key of an element from source, then that element is not
-        extracted from source. *	@param x : compatible container to transfer the nodes from
+        extracted from source. Nodes are transferred without allocation, in one of three ways by the sizes n of *this and
+        m of source: a small source is spliced node by node in O(m log n), a moderate one is inserted in order, each search
+        starting from the last inserted node, in O(m log(n / m)), and a comparable one is merged with *this into one sorted
+        sequence, from which both trees are rebuilt in O(n + m).
+        *	@param x : compatible container to transfer the nodes from
         */
         template <class _Other_traits>
         void merge(_Bs_tree<_Other_traits, _MixIn...>& x);
@@ -675,6 +1533,35 @@ namespace xstl {
             merge(x);
         }
 
+        /**
+         *	@brief replaces the key of the element at position by new_key. The node is kept, so iterators and references to
+         *	it stay valid. If new_key still fits between the neighbours, it costs O(1). Otherwise the node is relinked at its
+         *	new position by a search starting from the nearer neighbour, an erase fixup and an insert fixup. Only sets and
+         *	multisets are supported, since the key of a map element is const, which extract() and node_type::key() change.
+         *	If a comparison or the assignment of the key throws, the element is linked back at its old position, so nothing
+         *	is changed as long as the assignment gives the strong guarantee.
+         *	@param position : iterator to the element to update
+         *	@param new_key : key to assign to the element
+         *	@return a pair consisting of an iterator to the element and true, or, for unique trees where another element has
+         *	a key equivalent to new_key, an iterator to that element and false, in which case nothing is changed.
+         */
+        template <class _Key>
+        std::pair<iterator, bool> update_key(const_iterator position, _Key&& new_key);
+
+        /**
+         *	@brief restores the order of the tree after the key of the element at position was modified in place, in the same
+         *	way as update_key. For unique trees, the element at position is extracted if the modified key is equivalent to the
+         *	key of another element, so the tree stays valid. Only sets and multisets are supported as update_key. If a
+         *	comparison throws, the element is linked back at its old position and stays in the tree, whose order is then
+         *	only restored by calling reposition again or by erasing the element.
+         *	@param position : iterator to the element whose key was modified
+         *	@return an insert_return_type as insert(node_type&&), with an iterator to the element, true and an empty node, or,
+         *	for unique trees where another element has an equivalent key, an iterator to that element, false and a node
+         *	owning the extracted element.
+         */
+        insert_return_type reposition(const_iterator position) noexcept(
+            is_nothrow_comparable_v<key_compare, key_type, key_type>);
+
         /**
          *   @brief removes the element at position.
          *   @param position : iterator to the element to remove
@@ -700,9 +1587,11 @@ namespace xstl {
         }
 
         /**
-         *   @brief removes the elements in the range [first, last).
-         *   @param first : the beginning of range of elements to insert
-         *	@param last : the end of range of elements to insert
+         *   @brief removes the elements in the range [first, last). Erasing k of n elements one by one costs O(k log n) with
+         *   rebalancing, so once k * log2(n) >= n - k the range is destroyed in a single batch and the rest is rebuilt balanced
+         *   in O(n), skipping rebalancing of every erased element. Thus the whole erase costs O(min(k log n, n)).
+         *   @param first : the beginning of range of elements to erase
+         *	@param last : the end of range of elements to erase
          *	@return iterator following the last removed element.
          */
         iterator erase(const_iterator first, const_iterator last) noexcept;
@@ -733,6 +1622,57 @@ namespace xstl {
          *	@brief get the width of tree.
          */
         XSTL_NODISCARD size_type width() const;
+        /**
+         *	@return the number of nodes at each depth, the root is at depth 0
+         */
+        XSTL_NODISCARD std::vector<size_type> depth_histogram() const;
+        /**
+         *	@brief takes a snapshot of structural counters and depth histogram. Only available with TreeStats policy.
+         */
+        XSTL_REQUIRES(_Traits::_Count_stats)
+        XSTL_NODISCARD tree_stats stats() const {
+            const _Tree_state& _state = _Get_state();
+            const auto         _hist  = depth_histogram();
+            tree_stats         _res{};
+            _res.rotations          = _state.get(_Tree_event::rotation);
+            _res.insert_fixup_steps = _state.get(_Tree_event::insert_fixup);
+            _res.erase_fixup_steps  = _state.get(_Tree_event::erase_fixup);
+            _res.access_fixup_steps = _state.get(_Tree_event::access_fixup);
+            _res.searches           = _state.get(_Tree_event::search);
+            _res.comparisons        = _state.get(_Tree_event::comparison);
+            _res.depth_histogram.assign(_hist.begin(), _hist.end());
+            return _res;
+        }
+        /**
+         *	@brief sets all structural counters to zero. Only available with TreeStats policy.
+         */
+        XSTL_REQUIRES(_Traits::_Count_stats)
+        void reset_stats() noexcept { _Get_state().reset(); }
+        /**
+         *	@return the number of elements whose keys are less than key. Only available with trees which store sizes of
+         *	subtrees, namely wb trees.
+         */
+        XSTL_REQUIRES(_Traits::_Order_statistics)
+        XSTL_NODISCARD size_type rank(const key_type& key) const {
+            size_type _res = 0;
+            for (_Nodeptr _node = _Get_root()->_parent; !_node->is_nil();) {
+                if (_Get_cmpr()(KFN(_node), key)) {
+                    _res += static_cast<size_type>(_node->_left->_prop) + 1;
+                    _node = _node->_right;
+                }
+                else
+                    _node = _node->_left;
+            }
+            return _res;
+        }
+        /**
+         *	@return iterator to the n-th smallest element, which counts from 0, or end() if n >= size(). Only available with
+         *	trees which store sizes of subtrees, namely wb trees.
+         */
+        XSTL_REQUIRES(_Traits::_Order_statistics)
+        XSTL_NODISCARD iterator nth(size_type n) noexcept { return _Make_iter(_Nth(n)); }
+        XSTL_REQUIRES(_Traits::_Order_statistics)
+        XSTL_NODISCARD const_iterator nth(size_type n) const noexcept { return _Make_citer(_Nth(n)); }
         /**
          *	@return returns the number of elements in the bs_tree
          */
@@ -772,7 +1712,7 @@ namespace xstl {
 
         ~_Bs_tree() {
             clear();
-            _Node::destroy_node(_Getal(), _Get_root());
+            _Node::destroy_root(_Getal(), _Get_root());
         }
 
         template <class _Traits, template <class, class> class... _MixIn>
@@ -783,11 +1723,11 @@ namespace xstl {
                 return false;
             _Nodeptr _curr1 = lhs._Get_root()->_left, _curr2 = rhs._Get_root()->_left;
             for (;;) {
-                if (_curr1->_is_nil)
-                    return _curr2->_is_nil;
-                if (_curr2->_is_nil)
+                if (_curr1->is_nil())
+                    return _curr2->is_nil();
+                if (_curr2->is_nil())
                     return false;
-                if (!std::equal_to<>{}(_curr1->_value, _curr2->_value))
+                if (!std::equal_to<>{}(_Node::value_of(_curr1), _Node::value_of(_curr2)))
                     return false;
 
                 _curr1 = _Node::find_inorder_successor(_curr1);
@@ -804,11 +1744,11 @@ namespace xstl {
             _Nodeptr _curr1 = lhs._Get_root()->_left, _curr2 = rhs._Get_root()->_left;
             auto     _cmpr = synth_three_way{};
             for (;;) {
-                if (_curr1->_is_nil)
-                    return _curr2->_is_nil ? std::strong_ordering::equal : std::strong_ordering::less;
-                if (_curr2->_is_nil)
+                if (_curr1->is_nil())
+                    return _curr2->is_nil() ? std::strong_ordering::equal : std::strong_ordering::less;
+                if (_curr2->is_nil())
                     return std::strong_ordering::greater;
-                if (const auto _res = _cmpr(_curr1->_value, _curr2->_value); _res != 0)
+                if (const auto _res = _cmpr(_Node::value_of(_curr1), _Node::value_of(_curr2)); _res != 0)
                     return _res;
 
                 _curr1 = _Node::find_inorder_successor(_curr1);
@@ -826,16 +1766,16 @@ namespace xstl {
             using _Nodeptr  = typename _Traits::_Nodeptr;
             using _Node     = typename _Traits::_Node;
             _Nodeptr _curr1 = lhs._Get_root()->_left, _curr2 = rhs._Get_root()->_left;
-            while (!_curr1->_is_nil && !_curr2->_is_nil) {
-                if (std::less<>{}(_curr1->_value, _curr2->_value))
+            while (!_curr1->is_nil() && !_curr2->is_nil()) {
+                if (std::less<>{}(_Node::value_of(_curr1), _Node::value_of(_curr2)))
                     return true;
-                else if (std::less<>{}(_curr2->_value, _curr1->_value))
+                else if (std::less<>{}(_Node::value_of(_curr2), _Node::value_of(_curr1)))
                     return false;
                 _curr1 = _Node::find_inorder_successor(_curr1);
                 _curr2 = _Node::find_inorder_successor(_curr2);
             }
 
-            return _curr1->_is_nil && !_curr2->_is_nil;
+            return _curr1->is_nil() && !_curr2->is_nil();
         }
 
         template <class _Traits, template <class, class> class... _MixIn>
@@ -877,19 +1817,67 @@ namespace xstl {
         };
 
         void _Destroy(_Nodeptr node) noexcept {
-            while (!node->_is_nil) {
-                _Destroy(node->_right);
-                _Node::destroy_node(_Getal(), std::exchange(node, node->_left));
+            while (!node->is_nil()) {  // rotate left children up until there is none, so that degenerate trees need no stack
+                if (node->_left->is_nil())
+                    _Node::destroy_node(_Getal(), std::exchange(node, node->_right));
+                else {
+                    _Nodeptr _left = node->_left;
+                    node->_left    = _left->_right;
+                    _left->_right  = node;
+                    node           = _left;
+                }
             }
         }
         void _Init() { _Get_val()._root = _Node::create_root(_Getal()); }
+
+        template <class _Key>
+        static constexpr bool _Prefix_search = _Traits::_Prefix_node && std::is_convertible_v<const _Key&, std::string_view>;
+
+        /**
+         *	@brief computes the prefix of key, which searches compare with prefixes of nodes before keys, see _Prefix_tree_node.
+         */
+        template <class _Key>
+        static auto _Search_prefix(const _Key& key) noexcept {
+            if constexpr (_Prefix_search<_Key>)
+                return _Node::make_prefix(key);
+            else
+                return nullptr;
+        }
+        template <class _Key, class _Prefix>
+        bool _Node_less(_Nodeptr node, const _Key& key, _Prefix prefix) const {  // node.key < key
+            if constexpr (_Prefix_search<_Key>)
+                if (node->_prefix != prefix)
+                    return node->_prefix < prefix;
+            return _Get_cmpr()(KFN(node), key);
+        }
+        template <class _Key, class _Prefix>
+        bool _Key_less(const _Key& key, _Prefix prefix, _Nodeptr node) const {  // key < node.key
+            if constexpr (_Prefix_search<_Key>)
+                if (prefix != node->_prefix)
+                    return prefix < node->_prefix;
+            return _Get_cmpr()(key, KFN(node));
+        }
+
+        template <bool _Upper, class _Key>
+        std::pair<_Nodeptr, _Nodeptr> _Search_start(const _Key&, _Nodeptr) const;
         template <class _Key>
-        _Find_result _Lower_bound(const _Key& value) const;
+        _Find_result _Lower_bound(const _Key& value, _Nodeptr from = nullptr) const;
         template <class _Key>
-        _Find_result _Upper_bound(const _Key& value) const;
+        _Find_result _Upper_bound(const _Key& value, _Nodeptr from = nullptr) const;
+        // searches of a non-const tree move the finger to where they end
+        template <class _Key>
+        _Find_result _Lower_bound(const _Key& value, _Nodeptr from = nullptr) {
+            return _Move_finger(std::as_const(*this)._Lower_bound(value, from));
+        }
+        template <class _Key>
+        _Find_result _Upper_bound(const _Key& value, _Nodeptr from = nullptr) {
+            return _Move_finger(std::as_const(*this)._Upper_bound(value, from));
+        }
+        template <class _Iter, class _Fn>
+        void _Find_batch(_Iter, _Iter, _Fn) const;
         template <class _Key>
         std::pair<_Nodeptr, _Nodeptr> _Equal_range(const _Key& value) const noexcept(
-            is_nothrow_comparable_v<key_compare, value_type, _Key>&& is_nothrow_comparable_v<key_compare, _Key, value_type>);
+            is_nothrow_comparable_v<key_compare, key_type, _Key>&& is_nothrow_comparable_v<key_compare, _Key, key_type>);
 
         inline _Nodeptr _Insert_at(const _Inspack&, _Nodeptr);
         template <class... _Args>
@@ -898,11 +1886,57 @@ namespace xstl {
         _Find_hint_result _Find_hint(const _Nodeptr, const _Key&);
         template <class... _Args>
         iterator _Emplace_hint(_Nodeptr, _Args&&...);
+        template <class _Fn>
+        void _Walk_depth(_Fn) const;
         template <class _Tag>
         void _Copy(const _Self&);
+        template <class _Tag, class _Creator>
+        _Nodeptr _Clone_node(_Nodeptr, _Nodeptr, _Creator&);
+        template <class _Tag, class _Creator>
+        _Nodeptr _Copy_nodes(_Nodeptr, _Nodeptr, _Creator&);
+#if USE_THREADS
         template <class _Tag>
-        _Nodeptr    _Copy_nodes(_Nodeptr, _Nodeptr);
-        _Nodeptr    _Erase(_Nodeptr);
+        static constexpr bool _Parallel_copyable =
+            _Alnode_traits::is_always_equal::value
+            && (std::is_same_v<_Tag, copy_op_tag> ? std::is_nothrow_copy_constructible_v<value_type>
+                                                    : std::is_nothrow_move_constructible_v<value_type>);
+        static constexpr size_type _Parallel_copy_threshold = size_type{ 1 } << 16;
+
+        template <class _Tag>
+        _Nodeptr _Copy_nodes_parallel(_Nodeptr, size_type);
+        template <class _Tag, class _Creator>
+        _Nodeptr _Fork_copy(_Nodeptr, _Nodeptr, _Creator&, unsigned int) noexcept;
+#endif
+        void        _Unlink(_Nodeptr) noexcept;
+        inline _Nodeptr _Nth(size_type n) const noexcept {
+            _Nodeptr _node = _Get_root()->_parent;
+            while (!_node->is_nil()) {
+                const size_type _left = static_cast<size_type>(_node->_left->_prop);
+                if (n == _left)
+                    break;
+                if (n < _left)
+                    _node = _node->_left;
+                else {
+                    n -= _left + 1;
+                    _node = _node->_right;
+                }
+            }
+            return _node;
+        }
+        void        _Rebuild(_Nodeptr*, size_type) noexcept;
+        bool        _Erase_by_rebuild(_Nodeptr, _Nodeptr) noexcept;
+        template <class _Other_traits>  // whether the other tree is in the order of this one, which fast merges rely on
+        static constexpr bool _Same_order =
+            std::is_same_v<key_compare, typename _Other_traits::key_compare> && std::is_empty_v<key_compare>;
+        template <class _Other_traits>
+        bool _Merge_by_rebuild(_Bs_tree<_Other_traits, _MixIn...>&);
+        template <class _Other_traits>
+        bool _Merge_by_finger(_Bs_tree<_Other_traits, _MixIn...>&);
+        template <class _Key>
+        bool                      _Fits(_Nodeptr, const _Key&) const;
+        template <class _Key, class _Assign>
+        std::pair<_Nodeptr, bool> _Relink(_Nodeptr, const _Key&, _Assign, bool);
+        _Inspack                  _Between(_Nodeptr, _Nodeptr) const noexcept;
         inline void _Check_max_size(const char* msg = "map/set too long") const {
             if (max_size() == _size)
                 throw std::length_error(msg);
@@ -910,7 +1944,20 @@ namespace xstl {
         void _Swap_excluding_cmpr(_Self& other) {
             using std::swap;
             _Get_val().swap(other._Get_val());
-            swap(_size, _size);
+            swap(_size, other._size);
+            if constexpr (_Traits::_Finger_search)
+                swap(_Get_state()._finger, other._Get_state()._finger);
+        }
+
+        void _Forget_finger() noexcept {
+            if constexpr (_Traits::_Finger_search)
+                _Get_state()._finger = nullptr;
+        }
+
+        _Find_result _Move_finger(const _Find_result& res) noexcept {
+            if constexpr (_Traits::_Finger_search)
+                _Get_state()._finger = res._pack._parent->is_nil() ? nullptr : res._pack._parent;
+            return res;
         }
 
         inline iterator       _Make_iter(_Nodeptr node) const noexcept { return iterator(node, std::addressof(_Get_val())); }
@@ -930,18 +1977,32 @@ namespace xstl {
         inline const _Scary_val&   _Get_val() const noexcept { return std::get<2>(_tpl); }
         inline _Nodeptr            _Get_root() noexcept { return std::get<2>(_tpl)._root; }
         inline const _Nodeptr      _Get_root() const noexcept { return std::get<2>(_tpl)._root; }
+        inline _Tree_state&        _Get_state() noexcept { return std::get<3>(_tpl); }
+        inline const _Tree_state&  _Get_state() const noexcept { return std::get<3>(_tpl); }
 
-        compressed_tuple<key_compare, _Alnode_type, _Scary_val> _tpl;
-        size_type                                               _size = 0;
+        compressed_tuple<key_compare, _Alnode_type, _Scary_val, _Tree_state> _tpl;
+        size_type                                                            _size = 0;
     };
 
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Tag>
     void _Bs_tree<_Traits, _MixIn...>::_Copy(const _Self& other) {
         _Nodeptr _root = _Get_root();
-        _root->_parent = _Copy_nodes<_Tag>(other._Get_root()->_parent, _root);
-        _size          = other._size;
-        if (!_root->_parent->_is_nil) {  // nonempty tree, look for new smallest and largest
+#if USE_THREADS
+        if constexpr (_Parallel_copyable<_Tag>) {
+            if (other._size >= _Parallel_copy_threshold && std::thread::hardware_concurrency() > 1)
+                _root->_parent = _Copy_nodes_parallel<_Tag>(other._Get_root()->_parent, other._size);
+        }
+        if (_root->_parent == _root)
+#endif
+        {
+            auto _creator  = [this](auto&&... args) {
+                return _Node::create_node(_Getal(), _Get_root(), std::forward<decltype(args)>(args)...);
+            };
+            _root->_parent = _Copy_nodes<_Tag>(other._Get_root()->_parent, _root, _creator);
+        }
+        _size = other._size;
+        if (!_root->_parent->is_nil()) {  // nonempty tree, look for new smallest and largest
             _root->_left  = _Node::leftmost(_root->_parent);
             _root->_right = _Node::rightmost(_root->_parent);
         }
@@ -949,56 +2010,181 @@ namespace xstl {
             _root->_left  = _root;
             _root->_right = _root;
         }
+        _Node::rethread(_root);
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Tag, class _Creator>
+    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Clone_node(_Nodeptr src, _Nodeptr dst,
+                                                                                              _Creator& creator) {
+        _Nodeptr _node;
+        if constexpr (std::is_same_v<_Tag, copy_op_tag>)
+            _node = creator(src->_value);
+        else {
+            if constexpr (std::is_same_v<key_type, value_type>)  // is set
+                _node = creator(std::move(src->_value));
+            else  // is map
+                _node = creator(std::move(src->_value.first), std::move(src->_value.second));
+        }
+        _node->_parent = dst;
+        _node->set_prop(src->prop());
+        return _node;
+    }
+
+    /**
+     *   @brief copies the subtree rooted at src in preorder. It walks along parent pointers instead of recursing, so that a
+     *   degenerate tree cannot exhaust the stack.
+     *   @return the root of copied subtree, or the header if src is nil
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Tag, class _Creator>
+    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Copy_nodes(_Nodeptr src, _Nodeptr dst,
+                                                                                              _Creator& creator) {
+        const _Nodeptr _head = _Get_root();
+        if (src->is_nil())
+            return _head;
+        const _Nodeptr _subroot = _Clone_node<_Tag>(src, dst, creator);
+        _Nodeptr       _from = src, _to = _subroot;
+        try {
+            for (;;) {  // a child of new node still points to head iff it has not been copied yet
+                if (!_from->_left->is_nil() && _to->_left == _head) {
+                    _from = _from->_left;
+                    _to   = _to->_left = _Clone_node<_Tag>(_from, _to, creator);
+                }
+                else if (!_from->_right->is_nil() && _to->_right == _head) {
+                    _from = _from->_right;
+                    _to   = _to->_right = _Clone_node<_Tag>(_from, _to, creator);
+                }
+                else if (_from == src)
+                    break;
+                else {
+                    _from = _from->_parent;
+                    _to   = _to->_parent;
+                }
+            }
+        } catch (...) {
+            _Destroy(_subroot);
+            throw;
+        }
+        return _subroot;
     }
 
+#if USE_THREADS
+    /**
+     *   @brief copies a large tree with several threads. All nodes are allocated on the calling thread in one batch, because
+     *   allocators are not required to be thread safe, and then handed out to workers, which only construct values.
+     *   @return the root of copied tree, or the header if the batch cannot be allocated or no thread can be started
+     */
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Tag>
-    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Copy_nodes(_Nodeptr src, _Nodeptr dst) {
-        _Nodeptr _subroot = _Get_root();
-        if (!src->_is_nil) {
-            _Nodeptr _node;
-            if constexpr (std::is_same_v<_Tag, copy_op_tag>)
-                _node = _Node::create_node(_Getal(), _subroot, src->_value);
-            else {
-                if constexpr (std::is_same_v<key_type, value_type>)  // is set
-                    _node = _Node::create_node(_Getal(), _subroot, std::move(src->_value));
-                else  // is map
-                    _node = _Node::create_node(_Getal(), _subroot, std::move(src->_value->first), std::move(src->_value->second));
-            }
-            _node->_parent = dst;
-            _node->_prop   = src->_prop;
-            if (_subroot->_is_nil)
-                _subroot = _node;
+    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Copy_nodes_parallel(_Nodeptr  src,
+                                                                                                       size_type count) {
+        std::vector<_Nodeptr> _batch;
+        try {
+            _batch.reserve(count);
+            while (_batch.size() != count)
+                _batch.push_back(_Getal().allocate(1));
+        } catch (...) {  // fall back to sequential copy, which reports the failure by itself
+            for (_Nodeptr _node : _batch)
+                _Getal().deallocate(_node, 1);
+            return _Get_root();
+        }
+
+        std::atomic<size_type> _next{ 0 };
+        auto                   _creator = [&](auto&&... args) {
+            const _Nodeptr _node = _batch[_next.fetch_add(1, std::memory_order_relaxed)];
+            _Node::construct_node(_Getal(), _node, _Get_root(), std::forward<decltype(args)>(args)...);
+            return _node;
+        };
+        unsigned int _depth = 0;  // forks 2^depth tasks, which is slightly more than hardware threads
+        for (unsigned int _threads = std::thread::hardware_concurrency(); _threads > 1; _threads >>= 1)
+            ++_depth;
+        return _Fork_copy<_Tag>(src, _Get_root(), _creator, _depth + 1);
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Tag, class _Creator>
+    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr
+        _Bs_tree<_Traits, _MixIn...>::_Fork_copy(_Nodeptr src, _Nodeptr dst, _Creator& creator, unsigned int depth) noexcept {
+        if (depth == 0 || src->is_nil())
+            return _Copy_nodes<_Tag>(src, dst, creator);  // never throws, since values are nothrow constructible
+        const _Nodeptr        _node = _Clone_node<_Tag>(src, dst, creator);
+        std::future<_Nodeptr> _left;
+        if (!src->_left->is_nil()) {
             try {
-                _node->_left  = _Copy_nodes<_Tag>(src->_left, _node);
-                _node->_right = _Copy_nodes<_Tag>(src->_right, _node);
-            } catch (...) {
-                _Destroy(_node);
-                throw;
+                _left = std::async(std::launch::async, [this, src, _node, &creator, depth] {
+                    return _Fork_copy<_Tag>(src->_left, _node, creator, depth - 1);
+                });
+            } catch (...) {  // no more thread available, copy left subtree on this thread later
             }
         }
-        return _subroot;
+        _node->_right = _Fork_copy<_Tag>(src->_right, _node, creator, depth - 1);
+        _node->_left  = _left.valid() ? _left.get() : _Fork_copy<_Tag>(src->_left, _node, creator, 0);
+        return _node;
     }
+#endif
 
     template <class _Traits, template <class, class> class... _MixIn>
-    typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Erase(_Nodeptr node) {
+    void _Bs_tree<_Traits, _MixIn...>::_Unlink(_Nodeptr node) noexcept {
         const _Nodeptr _root = _Get_root();
-        _Nodeptr       _suc  = nullptr;
         if (_root->_left == node)
-            _suc = _root->_left = node->_right->_is_nil ? node->_parent : _Node::leftmost(node->_right);
+            _root->_left = node->_right->is_nil() ? node->_parent : _Node::leftmost(node->_right);
         if (_root->_right == node)
-            _suc = _root->_right = node->_left->_is_nil ? node->_parent : _Node::rightmost(node->_left);
-        if (_root->_parent == node)
-            _root->_parent = _suc ? _suc : node->_right->_is_nil ? _root : _Node::leftmost(node->_right);
-        _Nodeptr _parent = _Traits::extract_node(this, node);
-        _Node::destroy_node(_Getal(), node);
-        return _parent;
+            _root->_right = node->_left->is_nil() ? node->_parent : _Node::rightmost(node->_left);
+        _Node::unthread(node);
+        _Traits::erase_fixup(this, _Traits::extract_node(this, node));
+        --_size;
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    void _Bs_tree<_Traits, _MixIn...>::_Rebuild(_Nodeptr* nodes, size_type count) noexcept {
+        const _Nodeptr _root = _Get_root();
+        _root->_parent       = _Traits::build(this, nodes, count);
+        _root->_left         = count == 0 ? _root : nodes[0];
+        _root->_right        = count == 0 ? _root : nodes[count - 1];
+        _size                = count;
+        _Node::rethread(_root);
+        _Forget_finger();
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    bool _Bs_tree<_Traits, _MixIn...>::_Erase_by_rebuild(_Nodeptr first, _Nodeptr last) noexcept {
+        // erasing k nodes one by one costs up to O(k log n) with rebalancing, and a rebuild costs O(n), so the range is rebuilt
+        // once k * log2(n) >= n - k. Walking the range gives up after O(k) steps if it is shorter than that.
+        if (first == last)
+            return false;
+        size_type _log = 0;
+        for (size_type _n = _size; _n > 1; _n >>= 1)
+            ++_log;
+        const size_type       _threshold = (_size + _log) / (_log + 1);
+        std::vector<_Nodeptr> _erased, _kept;
+        try {
+            _Nodeptr _node = first;
+            for (; _node != last && _erased.size() != _threshold; _node = _Node::find_inorder_successor(_node))
+                _erased.push_back(_node);
+            if (_erased.size() != _threshold)
+                return false;
+            for (; _node != last; _node = _Node::find_inorder_successor(_node))
+                _erased.push_back(_node);
+            _kept.reserve(_size - _erased.size());
+            for (_node = _Get_root()->_left; _node != first; _node = _Node::find_inorder_successor(_node))
+                _kept.push_back(_node);
+            for (_node = last; !_node->is_nil(); _node = _Node::find_inorder_successor(_node))
+                _kept.push_back(_node);
+        } catch (...) {
+            return false;
+        }
+        _Node::destroy_nodes(_Getal(), _erased.data(), _erased.size());  // after the walks, since they climb through erased nodes
+        _Rebuild(_kept.data(), _kept.size());
+        return true;
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
     typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr _Bs_tree<_Traits, _MixIn...>::_Insert_at(const _Inspack& pack,
                                                                                              _Nodeptr        new_node) {
         _Nodeptr _root    = _Get_root();
+        new_node->_left   = _root;  // node extracted from another tree still links to its header
+        new_node->_right  = _root;
         new_node->_parent = pack._parent;
         if (pack._parent == _root)
             _root->_parent = _root->_left = _root->_right = new_node;
@@ -1014,8 +2200,12 @@ namespace xstl {
                     _root->_right = new_node;
             }
         }
+        _Node::cache_key(new_node);  // key of node_type may be modified after extracted
+        _Node::thread_child(new_node);
         _Traits::insert_fixup(this, new_node);
         ++_size;
+        if constexpr (_Traits::_Finger_search)
+            _Get_state()._finger = new_node;
         return new_node;
     }
 
@@ -1030,7 +2220,7 @@ namespace xstl {
         if constexpr (_In_place_key_extractor::extractable && !_Multi) {
             const auto& _key = _In_place_key_extractor::extract(values...);
             _res             = _Lower_bound(_key);
-            if (!_res._curr->_is_nil && !_Get_cmpr()(_key, KFN(_res._curr)))  // key has existed in the tree
+            if (!_res._curr->is_nil() && !_Get_cmpr()(_key, KFN(_res._curr)))  // key has existed in the tree
                 return { _Make_iter(_res._curr), false };
             _Check_max_size();
             _new_node = _Tree_temp_node<_Alnode_type>(_Getal(), _Get_root(), std::forward<_Args>(values)...).release();
@@ -1042,7 +2232,7 @@ namespace xstl {
                 _res = _Upper_bound(_key);
             else {
                 _res = _Lower_bound(_key);
-                if (!_res._curr->_is_nil && !_Get_cmpr()(_key, KFN(_res._curr)))  // key has existed in the tree
+                if (!_res._curr->is_nil() && !_Get_cmpr()(_key, KFN(_res._curr)))  // key has existed in the tree
                     return { _Make_iter(_res._curr), false };
             }
             _Check_max_size();
@@ -1051,6 +2241,25 @@ namespace xstl {
         return { _Make_iter(_Insert_at(_res._pack, _new_node)), true };
     }
 
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class... _Args>
+    std::pair<typename _Bs_tree<_Traits, _MixIn...>::iterator, bool>
+    _Bs_tree<_Traits, _MixIn...>::append_back(_Args&&... values) {
+        _Tree_temp_node<_Alnode_type> _tmp_node(_Getal(), _Get_root(), std::forward<_Args>(values)...);
+        const key_type&               _key  = _Traits::kfn(_tmp_node._node->_value);
+        const _Nodeptr                _last = _Get_root()->_right;
+        _Inspack                      _pack{ _last, _Inspos::RIGHT };
+        if (!empty() && (_Multi ? _Get_cmpr()(_key, KFN(_last)) : !_Get_cmpr()(KFN(_last), _key))) {
+            const _Find_result _res = _Multi ? _Upper_bound(_key) : _Lower_bound(_key);
+            if constexpr (!_Multi)
+                if (!_res._curr->is_nil() && !_Get_cmpr()(_key, KFN(_res._curr)))  // key has existed in the tree
+                    return { _Make_iter(_res._curr), false };
+            _pack = _res._pack;
+        }
+        _Check_max_size();
+        return { _Make_iter(_Insert_at(_pack, _tmp_node.release())), true };
+    }
+
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Key>
     typename _Bs_tree<_Traits, _MixIn...>::_Find_hint_result _Bs_tree<_Traits, _MixIn...>::_Find_hint(const _Nodeptr hint,
@@ -1058,43 +2267,36 @@ namespace xstl {
         if (empty())
             return { { hint }, true };
         _Nodeptr _curr = hint;
-        if (hint->_is_nil)
+        if (hint->is_nil())
             _curr = _Get_root()->_right;
         if (_Get_cmpr()(key, KFN(_curr))) {  // if key < curr.key, may insert at position where before hint
-            for (_Nodeptr _pre = _Node::find_inorder_predecessor(_curr); !_pre->_is_nil;
-                 _pre          = _Node::find_inorder_predecessor(_pre)) {
+            for (_Nodeptr _next = _curr, _pre = _Node::find_inorder_predecessor(_curr); !_pre->is_nil();
+                 _next = _pre, _pre = _Node::find_inorder_predecessor(_pre)) {
                 if (!_Get_cmpr()(key, KFN(_pre))) {    // if pre.key <= key
                     if (!_Get_cmpr()(KFN(_pre), key))  // if pre.key == key
                         if constexpr (!_Multi)
                             return { { _pre }, false };
-                    return { { _pre, _Inspos::RIGHT }, true };
+                    return { _Between(_pre, _next), true };
                 }
             }
             return { { _Get_root()->_left, _Inspos::LEFT }, true };
         }
-        else {  // key >= curr.key
-            for (_Nodeptr _suc = nullptr;; _curr = _suc) {
-                if (!_Get_cmpr()(KFN(_curr), key)) {  // if key == curr.key
-                    if constexpr (_Multi) {
-                        do {
-                            if (_curr->_right->_is_nil)
-                                return { { _curr, _Inspos::RIGHT }, true };
-                        } while (!_Get_cmpr()(key, KFN(_curr->_right))
-                                 && (_curr = _curr->_right, true));  // travelling while suc->_right.key == key
-                        return { { _curr, _Inspos::LEFT }, true };
-                    }
-                    else
-                        return { { _curr }, false };
-                }
-                // key > curr.key
-                _suc = _Node::find_inorder_successor(_curr);
-                if (!_suc->_is_nil) {
-                    if (_Get_cmpr()(key, KFN(_suc)))  // key < suc.key
-                        return { { _suc, _Inspos::LEFT }, true };
-                }
-                else
-                    return { { _Get_root()->_right, _Inspos::RIGHT }, true };
-            }
+        if (!_Get_cmpr()(KFN(_curr), key)) {  // if key == curr.key
+            if constexpr (!_Multi)
+                return { { _curr }, false };
+            else if (!hint->is_nil())  // just before hint
+                return { _Between(_Node::find_inorder_predecessor(_curr), _curr), true };
+        }
+        for (;;) {  // key >= curr.key, travelling to the last node whose key <= key
+            const _Nodeptr _suc = _Node::find_inorder_successor(_curr);
+            if (_suc->is_nil())
+                return { { _curr, _Inspos::RIGHT }, true };
+            if (_Get_cmpr()(key, KFN(_suc)))  // key < suc.key
+                return { _Between(_curr, _suc), true };
+            if constexpr (!_Multi)
+                if (!_Get_cmpr()(KFN(_suc), key))  // key == suc.key
+                    return { { _suc }, false };
+            _curr = _suc;
         }
     }
 
@@ -1129,11 +2331,11 @@ namespace xstl {
     typename _Bs_tree<_Traits, _MixIn...>::iterator _Bs_tree<_Traits, _MixIn...>::erase(const_iterator position) noexcept {
         XSTL_EXPECT(std::addressof(_Get_val()) == CAST2SCARY(position._Get_cont()), "tree iterator insert outside range");
 
-        if (position.base()->_is_nil)
+        if (position.base()->is_nil())
             return end();
         _Nodeptr _curr = (position++).base();
-        _Traits::erase_fixup(this, _Erase(_curr));
-        --_size;
+        _Unlink(_curr);
+        _Node::destroy_node(_Getal(), _curr);
         return _Make_iter(position.base());
     }
 
@@ -1147,6 +2349,8 @@ namespace xstl {
         if (first == begin() && last == end())
             clear();
         else {
+            if (_Erase_by_rebuild(first.base(), last.base()))  // a range for which a rebuild is cheaper
+                return _Make_iter(last.base());
             while (first != last)
                 erase(first++);
             return _Make_iter(first.base());
@@ -1154,14 +2358,54 @@ namespace xstl {
         return begin();
     }
 
+    /**
+     *	@brief finds where a search for the lower (_Upper = false) or upper (_Upper = true) bound of key starts. Without a
+     *	finger it is root. Otherwise it climbs from the finger to the lowest node x, such that the result is in the subtree
+     *	of x or is the nearest ancestor greater than that subtree. Climbing only compares at the turning points of the path.
+     *	@param from : a node of tree used as the finger if it is not null, whether the tree has FingerSearch or not.
+     *	@return the node to descend from, and the node which is the result if the descent finds nothing greater
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <bool _Upper, class _Key>
+    std::pair<typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr, typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr>
+    _Bs_tree<_Traits, _MixIn...>::_Search_start(const _Key& key, _Nodeptr from) const {
+        const _Nodeptr _root = const_cast<_Nodeptr>(_Get_root());
+        if constexpr (_Traits::_Finger_search)
+            if (!from)
+                from = _Get_state()._finger;
+        if (_Nodeptr _curr = from) {
+            const auto _prefix = _Search_prefix(key);
+            const auto _before = [&](_Nodeptr node) {  // whether node precedes the result
+                _Get_state().count(_Tree_event::comparison);
+                return _Upper ? !_Key_less(key, _prefix, node) : _Node_less(node, key, _prefix);
+            };
+            const bool _right = _before(_curr);  // whether the result is on the right of finger
+            while (true) {
+                _Nodeptr _up = _curr;  // climbs to the nearest ancestor greater (or less) than the subtree of _curr
+                while (!_up->is_real_root() && (_right ? _up->is_right() : _up->is_left()))
+                    _up = _up->_parent;
+                if (_up->is_real_root())
+                    return { _curr, _right ? _root : _curr };
+                if (_before(_up->_parent) != _right)
+                    return { _curr, _right ? _up->_parent : _curr };
+                _curr = _up->_parent;
+            }
+        }
+        return { _root->_parent, _root };
+    }
+
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Key>
-    typename _Bs_tree<_Traits, _MixIn...>::_Find_result _Bs_tree<_Traits, _MixIn...>::_Lower_bound(const _Key& key) const {
-        _Nodeptr     _curr = _Get_root()->_parent;
-        _Find_result _res{ { _Get_root()->_parent }, const_cast<_Nodeptr>(_Get_root()) };
-        while (!_curr->_is_nil) {
+    typename _Bs_tree<_Traits, _MixIn...>::_Find_result _Bs_tree<_Traits, _MixIn...>::_Lower_bound(const _Key& key,
+                                                                                                   _Nodeptr    from) const {
+        auto [_curr, _bound] = _Search_start<false>(key, from);
+        _Find_result _res{ { _curr }, _bound };
+        const auto   _prefix = _Search_prefix(key);
+        _Get_state().count(_Tree_event::search);
+        while (!_curr->is_nil()) {
+            _Get_state().count(_Tree_event::comparison);
             _res._pack._parent = _curr;
-            if (!_Get_cmpr()(KFN(_curr), key)) {  // curr.key >= key
+            if (!_Node_less(_curr, key, _prefix)) {  // curr.key >= key
                 _res._pack._pos = _Inspos::LEFT;
                 _res._curr      = _curr;
                 _curr           = _curr->_left;
@@ -1174,6 +2418,113 @@ namespace xstl {
         return _res;
     }
 
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Codec, class _Ostream>
+    void _Bs_tree<_Traits, _MixIn...>::save(_Ostream& os) const {
+        _Tree_snapshot_header _header;
+        _header._multi      = _Multi;
+        _header._value_size = static_cast<std::uint16_t>(sizeof(value_type));
+        _header._size       = _size;
+        os.write(reinterpret_cast<const char*>(std::addressof(_header)), sizeof(_header));
+        for (_Nodeptr _node = _Get_root()->_left; os && !_node->is_nil(); _node = _Node::find_inorder_successor(_node))
+            _Codec::encode(os, _node->_value);
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Codec, class _Istream>
+    void _Bs_tree<_Traits, _MixIn...>::load(_Istream& is) {
+        const _Tree_snapshot_header _expected;
+        _Tree_snapshot_header       _header;
+        is.read(reinterpret_cast<char*>(std::addressof(_header)), sizeof(_header));
+        if (!is || std::memcmp(_header._magic, _expected._magic, sizeof(_header._magic)) != 0
+            || _header._version != _expected._version || (_header._multi && !_Multi)
+            || _header._value_size != static_cast<std::uint16_t>(sizeof(value_type)) || _header._size > max_size()) {
+            is.setstate(is.failbit);
+            return;
+        }
+        std::vector<_Nodeptr> _nodes;
+        scoped_guard          _guard([&] {
+            for (_Nodeptr _node : _nodes)
+                _Node::destroy_node(_Getal(), _node);
+        });
+        // the stored size is not trusted for allocation, so a corrupt header fails in decoding rather than in reserve
+        _nodes.reserve(static_cast<size_type>((std::min)(_header._size, std::uint64_t{ 1 } << 16)));
+        while (_nodes.size() != _header._size) {
+            auto _value = _Codec::decode(is);
+            if (!is)
+                return;
+            if (_nodes.size() == _nodes.capacity())  // before creating node, which would leak if push_back threw
+                _nodes.reserve(_nodes.size() * 2);
+            _nodes.push_back(_Node::create_node(_Getal(), _Get_root(), std::move(_value)));
+        }
+        _guard.dismiss();
+        _Destroy(_Get_root()->_parent);
+        _Rebuild(_nodes.data(), _nodes.size());
+    }
+
+    /**
+     *	@brief calls fn with the node found or the header for every key in [first, last), in order. A group of lookups descends
+     *	one level per round, so that the prefetch of a lookup has the other lookups of the group to hide behind. In a sorted
+     *	group, lookups at the same node are adjacent, and those not greater than the node are found by a binary search.
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Iter, class _Fn>
+    void _Bs_tree<_Traits, _MixIn...>::_Find_batch(_Iter first, _Iter last, _Fn fn) const {
+        struct _Lookup {
+            _Iter    _key;
+            _Nodeptr _curr;
+            _Nodeptr _bound;
+        };
+        const _Nodeptr _root = const_cast<_Nodeptr>(_Get_root());
+        _Lookup        _group[_Batch_width];
+        while (first != last) {
+            size_type _width  = 0;
+            bool      _sorted = true;
+            for (; _width < _Batch_width && first != last; ++_width, ++first) {
+                if (_width != 0 && _sorted) {
+                    _Get_state().count(_Tree_event::comparison);
+                    _sorted = !_Get_cmpr()(*first, *_group[_width - 1]._key);
+                }
+                _group[_width] = { first, _root->_parent, _root };
+                _Get_state().count(_Tree_event::search);
+            }
+            for (bool _pending = true; _pending;) {
+                _pending = false;
+                for (size_type i = 0, j; i < _width; i = j) {
+                    const _Nodeptr _curr = _group[i]._curr;
+                    j                    = i + 1;
+                    if (_curr->is_nil())
+                        continue;
+                    if (_sorted)
+                        while (j < _width && _group[j]._curr == _curr)
+                            ++j;
+                    size_type _lo = i, _hi = j;  // finds the first lookup whose key is greater than curr.key
+                    while (_lo < _hi) {
+                        const size_type _mid = _lo + (_hi - _lo) / 2;
+                        _Get_state().count(_Tree_event::comparison);
+                        if (_Get_cmpr()(KFN(_curr), *_group[_mid]._key))
+                            _hi = _mid;
+                        else
+                            _lo = _mid + 1;
+                    }
+                    for (size_type k = i; k < _lo; ++k) {
+                        _group[k]._bound = _curr;
+                        _group[k]._curr  = _curr->_left;
+                    }
+                    for (size_type k = _lo; k < j; ++k)
+                        _group[k]._curr = _curr->_right;
+                    XSTL_PREFETCH(std::addressof(*_group[i]._curr));
+                    XSTL_PREFETCH(std::addressof(*_group[j - 1]._curr));
+                    _pending = true;
+                }
+            }
+            for (size_type i = 0; i < _width; ++i) {
+                const _Nodeptr _bound = _group[i]._bound;
+                fn(_bound->is_nil() || _Get_cmpr()(*_group[i]._key, KFN(_bound)) ? _root : _bound);
+            }
+        }
+    }
+
     template <class _Traits, template <class, class> class... _MixIn>
     auto _Bs_tree<_Traits, _MixIn...>::insert(node_type&& nh) {
         if (nh.empty()) {
@@ -1189,7 +2540,7 @@ namespace xstl {
         }
         else {
             const auto _res = _Lower_bound(KFN(_new_node));
-            if (!_res._curr->_is_nil && !_Get_cmpr()(KFN(_new_node), KFN(_res._curr)))
+            if (!_res._curr->is_nil() && !_Get_cmpr()(KFN(_new_node), KFN(_res._curr)))
                 return insert_return_type{ _Make_iter(_res._curr), false, std::move(nh) };
             _Check_max_size();
             return insert_return_type{ _Make_iter(_Insert_at(_res._pack, _Tree_accessor::release(nh))), true, std::move(nh) };
@@ -1204,7 +2555,7 @@ namespace xstl {
             return end();
         const _Nodeptr _new_node = _Tree_accessor::get_ptr(nh);
         const auto     _res      = _Find_hint(hint.base(), KFN(_new_node));
-        if (_res.insertable == false)
+        if (!_res._insertable)
             return _Make_iter(_res._pack._parent);
         _Check_max_size();
         return _Make_iter(_Insert_at(_res._pack, _Tree_accessor::release(nh)));
@@ -1234,12 +2585,16 @@ namespace xstl {
 
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Key>
-    typename _Bs_tree<_Traits, _MixIn...>::_Find_result _Bs_tree<_Traits, _MixIn...>::_Upper_bound(const _Key& key) const {
-        _Nodeptr     _curr = _Get_root()->_parent;
-        _Find_result _res{ { _Get_root()->_parent }, const_cast<_Nodeptr>(_Get_root()) };
-        while (!_curr->_is_nil) {
+    typename _Bs_tree<_Traits, _MixIn...>::_Find_result _Bs_tree<_Traits, _MixIn...>::_Upper_bound(const _Key& key,
+                                                                                                   _Nodeptr    from) const {
+        auto [_curr, _bound] = _Search_start<true>(key, from);
+        _Find_result _res{ { _curr }, _bound };
+        const auto   _prefix = _Search_prefix(key);
+        _Get_state().count(_Tree_event::search);
+        while (!_curr->is_nil()) {
+            _Get_state().count(_Tree_event::comparison);
             _res._pack._parent = _curr;
-            if (_Get_cmpr()(key, KFN(_curr))) {  // curr.key > key
+            if (_Key_less(key, _prefix, _curr)) {  // curr.key > key
                 _res._pack._pos = _Inspos::LEFT;
                 _res._curr      = _curr;
                 _curr           = _curr->_left;
@@ -1278,19 +2633,19 @@ namespace xstl {
     template <class _Key>
     std::pair<typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr, typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr>
     _Bs_tree<_Traits, _MixIn...>::_Equal_range(const _Key& key) const noexcept(
-        is_nothrow_comparable_v<key_compare, value_type, _Key>&& is_nothrow_comparable_v<key_compare, _Key, value_type>) {
-        auto _first = _Get_root(), _second = _Get_root();
-        auto _curr = _Get_root()->_parent;
-        while (!_curr->_is_nil)
+        is_nothrow_comparable_v<key_compare, key_type, _Key>&& is_nothrow_comparable_v<key_compare, _Key, key_type>) {
+        _Nodeptr _first = _Get_root(), _second = _Get_root();
+        _Nodeptr _curr  = _Get_root()->_parent;
+        while (!_curr->is_nil())
             if (_Get_cmpr()(KFN(_curr), key))
                 _curr = _curr->_right;
             else {
-                if (_second->_is_nil && _Get_cmpr()(key, KFN(_curr)))
+                if (_second->is_nil() && _Get_cmpr()(key, KFN(_curr)))
                     _second = _curr;
                 _first = std::exchange(_curr, _curr->_left);
             }
-        _curr = _second->_is_nil ? _Get_root()->_parent : _second->_left;
-        while (!_curr->_is_nil)
+        _curr = _second->is_nil() ? _Get_root()->_parent : _second->_left;
+        while (!_curr->is_nil())
             if (_Get_cmpr()(key, KFN(_curr)))
                 _second = std::exchange(_curr, _curr->_left);
             else
@@ -1334,7 +2689,7 @@ namespace xstl {
             const auto _res = _Equal_range(key);
             return std::distance(_Make_unchecked_citer(_res.first), _Make_unchecked_citer(_res.second));
         }
-        if (const auto _curr = _Lower_bound(key)._curr; !_curr->_is_nil)
+        if (const auto _curr = _Lower_bound(key)._curr; !_curr->is_nil())
             if (!_Get_cmpr()(key, KFN(_curr)))
                 return 1;
         return 0;
@@ -1349,14 +2704,14 @@ namespace xstl {
 
     template <class _Traits, template <class, class> class... _MixIn>
     bool _Bs_tree<_Traits, _MixIn...>::contains(const key_type& key) const {
-        return !find(key).base()->_is_nil;
+        return !find(key).base()->is_nil();
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
     typename _Bs_tree<_Traits, _MixIn...>::node_type _Bs_tree<_Traits, _MixIn...>::extract(const_iterator position) {
         XSTL_EXPECT(std::addressof(_Get_val()) == CAST2SCARY(position._Get_cont()), "tree iterator insert outside range");
 
-        _Traits::extract_node(this, position.base());
+        _Unlink(position.base());
         return _Tree_accessor::make_handle<node_type>(position.base(), _Getal());
     }
 
@@ -1369,13 +2724,13 @@ namespace xstl {
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Key, class, class>
     bool _Bs_tree<_Traits, _MixIn...>::contains(const _Key& key) const {
-        return !find(key).base()->_is_nil;
+        return !find(key).base()->is_nil();
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Other_traits>
     void _Bs_tree<_Traits, _MixIn...>::merge(_Bs_tree<_Other_traits, _MixIn...>& x) {
-        static_assert(std::is_same_v<_Nodeptr, typename _Bs_tree<_Other_traits, _MixIn...>::_Nodeptr>,
+        static_assert(std::is_same_v<_Nodeptr, typename _Other_traits::_Nodeptr>,
                       "merge() requires an argument with a compatible node type.");
         static_assert(std::is_same_v<allocator_type, typename _Bs_tree<_Other_traits, _MixIn...>::allocator_type>,
                       "merge() requires an argument with the same allocator type.");
@@ -1384,15 +2739,27 @@ namespace xstl {
             if XSTL_UNLIKELY (this == std::addressof(x))
                 return;
         if constexpr (!_Alnode_traits::is_always_equal::value)
-            XSTL_EXPECT(_Getal() != x._Getal(), "tree allocators incompatible for merge");
-
+            XSTL_EXPECT(_Getal() == x._Getal(), "tree allocators incompatible for merge");
+
+        const size_type _count = x.size();
+        if (_count == 0)
+            return;
+        if constexpr (_Same_order<_Other_traits>)
+            if (max_size() - _size >= _count) {  // otherwise splicing throws when tree is full
+                if (_count * _Merge_rebuild_ratio > _size) {
+                    if (_Merge_by_rebuild(x))
+                        return;
+                }
+                else if (_count * _Merge_splice_ratio > _size && _Merge_by_finger(x))
+                    return;
+            }
         _Nodeptr _curr = _Tree_accessor::root(std::addressof(x))->_left;
-        while (!_curr->_is_nil) {
+        while (!_curr->is_nil()) {
             const _Nodeptr _node = _curr;
-            if (!_curr->_right->_is_nil)  // increase _curr, find in-order successor
+            if (!_curr->_right->is_nil())  // increase _curr, find in-order successor
                 _curr = _Node::leftmost(_curr->_right);
             else {
-                while (!_curr->_parent->_is_nil && _curr == _curr->_parent->_right)
+                while (!_curr->_parent->is_nil() && _curr == _curr->_parent->_right)
                     _curr = _curr->_parent;
                 _curr = _curr->_parent;
             }
@@ -1401,57 +2768,265 @@ namespace xstl {
                 _res = _Upper_bound(KFN(_node));
             else {
                 _res = _Lower_bound(KFN(_node));
-                if (!_res._curr->_is_nil && !_Get_cmpr()(KFN(_node), KFN(_res._curr)))
+                if (!_res._curr->is_nil() && !_Get_cmpr()(KFN(_node), KFN(_res._curr)))
                     continue;
             }
             _Check_max_size();
-            _Other_traits::extract_node(std::addressof(x), _node);
+            _Tree_accessor::unlink(std::addressof(x), _node);
             _Insert_at(_res._pack, _node);
         }
     }
 
+    /**
+     *	@brief merges nodes of tree and x into one sorted sequence, in which elements of tree precede equivalent ones of x,
+     *	then rebuilds tree from it and x from the nodes left by a unique tree. Both sequences share one array, the merged
+     *	one growing from the front and the left one from the back. Nodes are only relinked after all comparisons, so a
+     *	comparison which throws leaves both trees unchanged.
+     *	@return false if the array cannot be allocated, and nothing is changed
+     */
     template <class _Traits, template <class, class> class... _MixIn>
-    typename _Bs_tree<_Traits, _MixIn...>::size_type _Bs_tree<_Traits, _MixIn...>::height() const noexcept {
-#ifdef __cpp_explicit_this_parameter
-        auto _get_height = [&](this auto self,
-#else
-        std::function<size_type(_Nodeptr)> _get_height = [&](
-#endif
-                               _Nodeptr node) {
-            return node->_is_nil ? 0
-                                 : (std::max)(
-#ifdef __cpp_explicit_this_parameter
-                                       self(node->_left), self(node->right)
-#else
-                                       _get_height(node->_left), _get_height(node->_right)
-#endif
-                                           )
-                                       + 1;
-        };
-        return _get_height(_Get_root()->_parent);
+    template <class _Other_traits>
+    bool _Bs_tree<_Traits, _MixIn...>::_Merge_by_rebuild(_Bs_tree<_Other_traits, _MixIn...>& x) {
+        std::vector<_Nodeptr> _nodes;
+        try {
+            _nodes.resize(_size + x.size());
+        } catch (...) {
+            return false;
+        }
+        size_type _merged = 0, _left = _nodes.size();
+        _Nodeptr  _curr = _Get_root()->_left, _other = _Tree_accessor::root(std::addressof(x))->_left;
+        while (!_curr->is_nil() || !_other->is_nil()) {
+            if (_other->is_nil() || (!_curr->is_nil() && !_Get_cmpr()(KFN(_other), KFN(_curr)))) {
+                _nodes[_merged++] = _curr;
+                _curr             = _Node::find_inorder_successor(_curr);
+                continue;
+            }
+            if constexpr (!_Multi)
+                if (_merged != 0 && !_Get_cmpr()(KFN(_nodes[_merged - 1]), KFN(_other))) {
+                    _nodes[--_left] = _other;
+                    _other          = _Node::find_inorder_successor(_other);
+                    continue;
+                }
+            _nodes[_merged++] = _other;
+            _other            = _Node::find_inorder_successor(_other);
+        }
+        std::reverse(_nodes.begin() + _left, _nodes.end());
+        _Rebuild(_nodes.data(), _merged);
+        _Tree_accessor::rebuild(std::addressof(x), _nodes.data() + _left, _nodes.size() - _left);
+        return true;
     }
 
+    /**
+     *	@brief inserts nodes of x in order, and each search climbs from the node inserted last as FingerSearch does, which
+     *	costs O(log d) for a distance d between neighbouring insertions. Nodes left by a unique tree are rebuilt into x. If
+     *	a comparison throws, x is rebuilt from the nodes which have not been inserted yet.
+     *	@return false if the array of nodes of x cannot be allocated, and nothing is changed
+     */
     template <class _Traits, template <class, class> class... _MixIn>
-    typename _Bs_tree<_Traits, _MixIn...>::size_type _Bs_tree<_Traits, _MixIn...>::width() const {
-        if (empty())
-            return 0;
-        std::queue<_Nodeptr> _wid;
-        size_type            _w = 1, _curw = _w;
-        _wid.push(_Get_root()->_parent);
-        while (!_wid.empty()) {
-            for (; _curw > 0; --_curw) {
-                _Nodeptr _front = _wid.front();
-                _wid.pop();
-                if (!_front->_left->_is_nil)
-                    _wid.push(_front->_left);
-                if (!_front->_right->_is_nil)
-                    _wid.push(_front->_right);
+    template <class _Other_traits>
+    bool _Bs_tree<_Traits, _MixIn...>::_Merge_by_finger(_Bs_tree<_Other_traits, _MixIn...>& x) {
+        std::vector<_Nodeptr> _nodes;
+        try {
+            _nodes.reserve(x.size());
+        } catch (...) {
+            return false;
+        }
+        for (_Nodeptr _curr = _Tree_accessor::root(std::addressof(x))->_left; !_curr->is_nil();
+             _curr          = _Node::find_inorder_successor(_curr))
+            _nodes.push_back(_curr);
+        const _Nodeptr _root = _Get_root();
+        _Nodeptr       _last = nullptr;
+        size_type      _left = 0, _next = 0;
+        try {
+            for (; _next != _nodes.size(); ++_next) {
+                const _Nodeptr _node = _nodes[_next];
+                _Find_result   _res;
+                if constexpr (_Multi)
+                    _res = _Upper_bound(KFN(_node), _last);
+                else {
+                    _res = _Lower_bound(KFN(_node), _last);
+                    if (!_res._curr->is_nil() && !_Get_cmpr()(KFN(_node), KFN(_res._curr))) {
+                        _nodes[_left++] = _node;
+                        continue;
+                    }
+                }
+                _Node::assign_node(_node, _root, _root, _root, RED, false);  // same as a node extracted from x
+                _Insert_at(_res._pack, _node);
+                _last = _node;
+            }
+        } catch (...) {  // nodes from _next on are untouched, and follow those left in order
+            _left = std::move(_nodes.begin() + _next, _nodes.end(), _nodes.begin() + _left) - _nodes.begin();
+            _Tree_accessor::rebuild(std::addressof(x), _nodes.data(), _left);
+            throw;
+        }
+        _Tree_accessor::rebuild(std::addressof(x), _nodes.data(), _left);
+        return true;
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Key>
+    std::pair<typename _Bs_tree<_Traits, _MixIn...>::iterator, bool>
+    _Bs_tree<_Traits, _MixIn...>::update_key(const_iterator position, _Key&& new_key) {
+        static_assert(std::is_same_v<key_type, value_type>, "update_key only supports sets and multisets");
+        XSTL_EXPECT(std::addressof(_Get_val()) == CAST2SCARY(position._Get_cont()), "tree iterator outside range");
+        const _Nodeptr _node   = position.base();
+        XSTL_EXPECT(!_node->is_nil(), "cannot update key of end tree iterator");
+        const auto     _assign = [&] { _Node::value_of(_node) = std::forward<_Key>(new_key); };
+        if (_Fits(_node, new_key)) {
+            _assign();
+            _Node::cache_key(_node);
+            return { _Make_iter(_node), true };
+        }
+        const auto _res = _Relink(_node, new_key, _assign, false);
+        return { _Make_iter(_res.first), _res.second };
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    typename _Bs_tree<_Traits, _MixIn...>::insert_return_type _Bs_tree<_Traits, _MixIn...>::reposition(
+        const_iterator position) noexcept(
+        is_nothrow_comparable_v<key_compare, key_type, key_type>) {
+        static_assert(std::is_same_v<key_type, value_type>, "reposition only supports sets and multisets");
+        XSTL_EXPECT(std::addressof(_Get_val()) == CAST2SCARY(position._Get_cont()), "tree iterator outside range");
+        const _Nodeptr _node = position.base();
+        XSTL_EXPECT(!_node->is_nil(), "cannot reposition end tree iterator");
+        _Node::cache_key(_node);
+        if (_Fits(_node, KFN(_node)))
+            return insert_return_type{ _Make_iter(_node), true, {} };
+        const auto _res = _Relink(_node, KFN(_node), [] {}, true);
+        if (_res.second)
+            return insert_return_type{ _Make_iter(_res.first), true, {} };
+        return insert_return_type{ _Make_iter(_res.first), false, _Tree_accessor::make_handle<node_type>(_node, _Getal()) };
+    }
+
+    /**
+     *	@return whether key is in order between the neighbours of node
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Key>
+    bool _Bs_tree<_Traits, _MixIn...>::_Fits(_Nodeptr node, const _Key& key) const {
+        const _Nodeptr _prev = _Node::find_inorder_predecessor(node), _next = _Node::find_inorder_successor(node);
+        if constexpr (_Multi)  // prev.key <= key <= next.key
+            return (_prev->is_nil() || !_Get_cmpr()(key, KFN(_prev))) && (_next->is_nil() || !_Get_cmpr()(KFN(_next), key));
+        else  // prev.key < key < next.key
+            return (_prev->is_nil() || _Get_cmpr()(KFN(_prev), key)) && (_next->is_nil() || _Get_cmpr()(key, KFN(_next)));
+    }
+
+    /**
+     *	@brief unlinks node and links it again by key, after assign() has made key the key of node. The search starts from
+     *	the neighbour on the side key moved to, which is usually near the new position. For unique trees, a key equivalent
+     *	to the predecessor counts as moved to its side, since the search finds the predecessor then. If a comparison or
+     *	assign() throws, node is linked back between its old neighbours, which needs no comparison.
+     *	@param extract : whether node is left unlinked, rather than linked back, if another element has a key equivalent
+     *	to key in a unique tree, in which case assign() is not called
+     *	@return the node relinked and true, or for unique trees the element with equivalent key and false
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Key, class _Assign>
+    std::pair<typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr, bool>
+    _Bs_tree<_Traits, _MixIn...>::_Relink(_Nodeptr node, const _Key& key, _Assign assign, bool extract) {
+        const _Nodeptr _prev = _Node::find_inorder_predecessor(node), _next = _Node::find_inorder_successor(node);
+        bool           _backward;
+        if constexpr (_Multi)
+            _backward = !_prev->is_nil() && _Get_cmpr()(key, KFN(_prev));
+        else
+            _backward = !_prev->is_nil() && !_Get_cmpr()(KFN(_prev), key);
+        _Nodeptr _from = _backward ? _prev : _next;
+        if (_from->is_nil())  // the search starts at root or the finger then
+            _from = nullptr;
+        _Unlink(node);
+        _Find_result _res;
+        bool         _unique = true;
+        try {
+            if constexpr (_Multi)
+                _res = _Upper_bound(key, _from);
+            else {
+                _res    = _Lower_bound(key, _from);
+                _unique = _res._curr->is_nil() || _Get_cmpr()(key, KFN(_res._curr));
+            }
+            if (_unique)
+                assign();
+        } catch (...) {
+            _Insert_at(_Between(_prev, _next), node);
+            throw;
+        }
+        if (!_unique) {
+            if (!extract)
+                _Insert_at(_Between(_prev, _next), node);
+            return { _res._curr, false };
+        }
+        _Insert_at(_res._pack, node);
+        return { node, true };
+    }
+
+    /**
+     *	@brief finds where a node is linked between in-order neighbours prev and next, either as left child of next or as
+     *	right child of prev, one of which must be free. Either may be nil at an end of the tree.
+     */
+    template <class _Traits, template <class, class> class... _MixIn>
+    typename _Bs_tree<_Traits, _MixIn...>::_Inspack _Bs_tree<_Traits, _MixIn...>::_Between(_Nodeptr prev,
+                                                                                         _Nodeptr next) const noexcept {
+        if (next->is_nil())
+            return prev->is_nil() ? _Inspack{ _Get_root(), _Inspos::LEFT } : _Inspack{ prev, _Inspos::RIGHT };
+        if (next->_left->is_nil())
+            return { next, _Inspos::LEFT };
+        return { prev, _Inspos::RIGHT };
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    template <class _Fn>
+    void _Bs_tree<_Traits, _MixIn...>::_Walk_depth(_Fn fn) const {
+        _Nodeptr _node = _Get_root()->_parent;
+        if (_node->is_nil())
+            return;
+        size_type _depth = 0;
+        for (;;) {  // preorder walk along parent pointers, so that degenerate trees need no stack
+            fn(_depth);
+            if (!_node->_left->is_nil()) {
+                _node = _node->_left;
+                ++_depth;
+            }
+            else if (!_node->_right->is_nil()) {
+                _node = _node->_right;
+                ++_depth;
+            }
+            else {
+                for (;;) {  // climb up until there is an unvisited right subtree
+                    if (_node->is_real_root())
+                        return;
+                    const _Nodeptr _parent = _node->_parent;
+                    if (_node == _parent->_left && !_parent->_right->is_nil()) {
+                        _node = _parent->_right;
+                        break;
+                    }
+                    _node = _parent;
+                    --_depth;
+                }
             }
-            _curw = _wid.size();
-            if (_curw > _w)
-                _w = _curw;
         }
-        return _w;
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    typename _Bs_tree<_Traits, _MixIn...>::size_type _Bs_tree<_Traits, _MixIn...>::height() const noexcept {
+        size_type _height = 0;
+        _Walk_depth([&](size_type depth) noexcept { _height = (std::max)(_height, depth + 1); });
+        return _height;
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    typename _Bs_tree<_Traits, _MixIn...>::size_type _Bs_tree<_Traits, _MixIn...>::width() const {
+        const auto _hist = depth_histogram();
+        return _hist.empty() ? 0 : *std::max_element(_hist.begin(), _hist.end());
+    }
+
+    template <class _Traits, template <class, class> class... _MixIn>
+    std::vector<typename _Bs_tree<_Traits, _MixIn...>::size_type> _Bs_tree<_Traits, _MixIn...>::depth_histogram() const {
+        std::vector<size_type> _hist;
+        _Walk_depth([&](size_type depth) {
+            if (depth == _hist.size())
+                _hist.push_back(0);
+            ++_hist[depth];
+        });
+        return _hist;
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
@@ -1469,7 +3044,7 @@ namespace xstl {
                 return;
             for (size_type i = 1; i < size; i++)
                 out << (_visited[i] ? static_cast<const _Elem*>("  │") : static_cast<const _Elem*>("   "));
-            if (node->_is_nil)
+            if (node->is_nil())
                 out << (position ? static_cast<const _Elem*>("  ├─ ") : static_cast<const _Elem*>("  └─ "))
                     << static_cast<_Elem>('\n');
             else {
@@ -1479,8 +3054,8 @@ namespace xstl {
                     out << static_cast<const _Elem*>("  └─ ");
                 else
                     out << static_cast<const _Elem*>("  ├─ ");
-                out << node->_value << static_cast<_Elem>('\n');
-                if (!node->_left->_is_nil || !node->_right->_is_nil) {
+                out << _Node::value_of(node) << static_cast<_Elem>('\n');
+                if (!node->_left->is_nil() || !node->_right->is_nil()) {
                     _visited[size + 1] = true;
 #ifdef __cpp_explicit_this_parameter
                     self(node->_right, size + 1, 1);
@@ -1500,7 +3075,7 @@ namespace xstl {
     template <class _Traits, template <class, class> class... _MixIn>
     typename _Bs_tree<_Traits, _MixIn...>::iterator _Bs_tree<_Traits, _MixIn...>::find(const key_type& key) {
         auto _res = _Lower_bound(key);
-        return (_res._curr->_is_nil || _Get_cmpr()(key, KFN(_res._curr)))
+        return (_res._curr->is_nil() || _Get_cmpr()(key, KFN(_res._curr)))
                    ? end()
                    : (_Traits::access_fixup(this, _res._curr), _Make_iter(_res._curr));
     }
@@ -1508,14 +3083,14 @@ namespace xstl {
     template <class _Traits, template <class, class> class... _MixIn>
     typename _Bs_tree<_Traits, _MixIn...>::const_iterator _Bs_tree<_Traits, _MixIn...>::find(const key_type& key) const {
         auto _res = _Lower_bound(key);
-        return (_res._curr->_is_nil || _Get_cmpr()(key, KFN(_res._curr))) ? cend() : _Make_citer(_res._curr);
+        return (_res._curr->is_nil() || _Get_cmpr()(key, KFN(_res._curr))) ? cend() : _Make_citer(_res._curr);
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
     template <class _Key, class, class>
     typename _Bs_tree<_Traits, _MixIn...>::iterator _Bs_tree<_Traits, _MixIn...>::find(const _Key& key) {
         auto _res = _Lower_bound(key);
-        return (_res._curr->_is_nil || _Get_cmpr()(key, KFN(_res._curr)))
+        return (_res._curr->is_nil() || _Get_cmpr()(key, KFN(_res._curr)))
                    ? end()
                    : (_Traits::access_fixup(this, _res._curr), _Make_iter(_res._curr));
     }
@@ -1524,7 +3099,7 @@ namespace xstl {
     template <class _Key, class, class>
     typename _Bs_tree<_Traits, _MixIn...>::const_iterator _Bs_tree<_Traits, _MixIn...>::find(const _Key& key) const {
         auto _res = _Lower_bound(key);
-        return (_res._curr->_is_nil || _Get_cmpr()(key, KFN(_res._curr))) ? cend() : _Make_citer(_res._curr);
+        return (_res._curr->is_nil() || _Get_cmpr()(key, KFN(_res._curr))) ? cend() : _Make_citer(_res._curr);
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
@@ -1542,11 +3117,12 @@ namespace xstl {
         _Destroy(_Get_root()->_parent);
         _Get_val().init();
         _size = 0;
+        _Forget_finger();
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
     bool _Bs_tree<_Traits, _MixIn...>::empty() const noexcept {
-        return _Get_root()->_parent->_is_nil;
+        return _Get_root()->_parent->is_nil();
     }
 
     template <class _Traits, template <class, class> class... _MixIn>
@@ -1561,7 +3137,7 @@ namespace xstl {
         if constexpr (alloc_pocca_v<_Alnode_type>) {
             if (_al != _other_al) {
                 const _Nodeptr _new_root = _Node::create_root(_other_al);
-                _Node::destroy_node(_al, _Get_root());
+                _Node::destroy_root(_al, _Get_root());
                 _Get_root() = _new_root;
             }
         }
@@ -1587,7 +3163,8 @@ namespace xstl {
         if constexpr (_pocma_val == pocma_values::Propagate) {
             if (_al != _other_al) {
                 const _Nodeptr _new_root = std::exchange(rhs._Get_root(), _Node::create_root(_other_al));
-                _Node::destroy_node(_al, _Get_root());
+                rhs._Forget_finger();
+                _Node::destroy_root(_al, _Get_root());
                 alloc_pocma(_al, _other_al);
                 _Get_root() = _new_root;
                 _size       = std::exchange(rhs._size, size_type{ 0 });
@@ -1622,7 +3199,7 @@ namespace xstl {
         using _Nodeptr   = typename _Traits::_Nodeptr;
         using _Scary_val = typename _Traits::_Scary_val;
         using _Alnode_type =
-            typename std::allocator_traits<typename _Traits::allocator_type>::template rebind_alloc<_Tree_node<value_type>>;
+            typename std::allocator_traits<typename _Traits::allocator_type>::template rebind_alloc<typename _Traits::_Node>;
         using _Alnode_traits = std::allocator_traits<_Alnode_type>;
 
     public:
@@ -1713,8 +3290,8 @@ namespace xstl {
         mapped_type& at(const key_type& key) { return const_cast<mapped_type&>(const_cast<const _Map*>(this)->at(key)); }
 
         const mapped_type& at(const key_type& key) const {
-            const auto _res = _Tree_accessor::find_lower_bound(_Derptr(), key);
-            if (_res._curr->_is_nil || _Derptr()->key_comp()(key, KFN(_res._curr)))
+            const auto _res = _Tree_accessor::find_lower_bound(static_cast<const _Derived*>(this), key);
+            if (_res._curr->is_nil() || _Derptr()->key_comp()(key, KFN(_res._curr)))
                 throw std::out_of_range("invalid map<K, T> key");
             return _res._curr->_value.second;
         }
@@ -1729,7 +3306,7 @@ namespace xstl {
         std::pair<_Nodeptr, bool> _Try_emplace(_Key&& key, _Mapped&&... mapped_value) {
             const auto _res  = _Tree_accessor::find_lower_bound(_Derptr(), key);
             auto       _cmpr = _Derptr()->key_comp();
-            if (!_res._curr->_is_nil && !_cmpr(key, KFN(_res._curr)))
+            if (!_res._curr->is_nil() && !_cmpr(key, KFN(_res._curr)))
                 return { _res._curr, false };
             _Tree_accessor::check_max_size(_Derptr());
             // clang-format off
@@ -1760,7 +3337,7 @@ namespace xstl {
         std::pair<iterator, bool> _Insert_or_assign(_Key&& key, _Mapped&& mapped_value) {
             const auto _res  = _Tree_accessor::find_lower_bound(_Derptr(), key);
             const auto _cmpr = _Derptr()->key_comp();
-            if (!_res._curr->_is_nil && !_cmpr(key, KFN(_res._curr))) {
+            if (!_res._curr->is_nil() && !_cmpr(key, KFN(_res._curr))) {
                 _res._pack._parent->_value.second = std::forward<_Mapped>(mapped_value);
                 return { _Tree_accessor::make_iter(_Derptr(), _res._pack._parent), false };
             }
@@ -1896,6 +3473,11 @@ namespace xstl {
             return tree->_Get_root();
         }
 
+        template <class _Traits, template <class, class> class... _MixIn>
+        inline static auto& /*_Tree_state*/ state(_Bs_tree<_Traits, _MixIn...>* tree) noexcept {
+            return tree->_Get_state();
+        }
+
         template <class _Traits, template <class, class> class... _MixIn>
         inline static auto /*_Nodeptr*/ insert_at(_Bs_tree<_Traits, _MixIn...>*                          tree,
                                                   const typename _Bs_tree<_Traits, _MixIn...>::_Inspack& pack,
@@ -1903,11 +3485,27 @@ namespace xstl {
             return tree->_Insert_at(pack, new_node);
         }
 
+        template <class _Traits, template <class, class> class... _MixIn>
+        inline static void unlink(_Bs_tree<_Traits, _MixIn...>*                      tree,
+                                  typename _Bs_tree<_Traits, _MixIn...>::_Nodeptr node) noexcept {
+            tree->_Unlink(node);
+        }
+
+        template <class _Traits, template <class, class> class... _MixIn>
+        inline static void rebuild(_Bs_tree<_Traits, _MixIn...>* tree, typename _Traits::_Nodeptr* nodes, size_t count) noexcept {
+            tree->_Rebuild(nodes, count);
+        }
+
         template <class _Key, class _Traits, template <class, class> class... _MixIn>
         inline static auto /*_Find_result*/ find_lower_bound(_Bs_tree<_Traits, _MixIn...>* tree, const _Key& key) noexcept {
             return tree->_Lower_bound(key);
         }
 
+        template <class _Key, class _Traits, template <class, class> class... _MixIn>
+        inline static auto /*_Find_result*/ find_lower_bound(const _Bs_tree<_Traits, _MixIn...>* tree, const _Key& key) noexcept {
+            return tree->_Lower_bound(key);
+        }
+
         template <class _Key, class _Traits, template <class, class> class... _MixIn>
         inline static auto /*_Find_result*/ find_upper_bound(_Bs_tree<_Traits, _MixIn...>* tree, const _Key& key) noexcept {
             return tree->_Upper_bound(key);
@@ -1975,49 +3573,256 @@ namespace xstl {
                 static const _Tp&     extract(const _Tp& value) noexcept { return value; }
             };
 
-            static const _Tp& kfn(const _Tp& value) { return value; }
+            static const _Tp& kfn(const _Tp& value) { return value; }
+        };
+
+        template <class _Key, class _Value, class _Compare>
+        struct _Map_traits {
+            using key_type    = _Key;
+            using value_type  = std::pair<const _Key, _Value>;
+            using key_compare = _Compare;
+            struct value_compare {
+                XSTL_NODISCARD bool operator()(const value_type& lhs, const value_type& rhs) const {
+                    return key_compare()(lhs.first, rhs.first);
+                }
+            };
+
+            template <class _Derived>
+            struct node_handle_base {
+                using mapped_type = _Value;
+
+                key_type&    key() const noexcept { return static_cast<const _Derived*>(this)->_Getptr()->_value.first; }
+                mapped_type& mapped() const noexcept { return static_cast<const _Derived*>(this)->_Getptr()->_value.second; }
+            };
+
+            template <class... Args>
+            struct in_place_key_extract {
+                static constexpr bool extractable = false;
+            };
+
+            template <>
+            struct in_place_key_extract<_Key, _Value> {
+                static constexpr bool extractable = true;
+                static const _Key&    extract(const _Key& key, const _Value&) noexcept { return key; }
+            };
+
+            static const _Key& kfn(const std::pair<const _Key, _Value>& value) { return value.first; }
+        };
+
+        /**
+         * Node policy is used to determine the layout of tree node.
+         * There are two choices:
+         * 1. default: _Tree_node, which holds an int as balance data and a bool as nil flag. Trees whose keys are std::string
+         * or std::string_view compared by std::less use _Prefix_tree_node instead, which caches the first 8 bytes of key.
+         * 2. CompactNode: _Compact_tree_node, which packs colour and nil flag into the low bits of parent pointer. It can only be
+         * used by trees which store at most one bit of balance data, namely bs, splay and rb trees.
+         * 3. ThreadedNode: _Threaded_tree_node, which links in-order neighbours, so that iterators step in O(1) worst case
+         * instead of climbing parent pointers.
+         * 4. OffsetNode: _Offset_tree_node, which links nodes by offset_ptr. A tree of it allocated by segment_allocator and
+         * constructed in the memory_segment can be used by every process mapping the segment, see memory_segment for locking.
+         * Lookups of splay trees and of FingerSearch write the tree, so they must hold the lock as writers do.
+         */
+        struct _Tree_node_policy {};
+
+        template <class _Key>
+        struct _Is_char_string : std::false_type {};
+        template <class _Alloc>
+        struct _Is_char_string<std::basic_string<char, std::char_traits<char>, _Alloc>> : std::true_type {};
+        template <>
+        struct _Is_char_string<std::string_view> : std::true_type {};
+
+        template <class _Cate, class... _Policies>
+        struct _Select_node_policy {
+            using _Tp = typename _Cate::value_type;
+
+            template <class _Ty, bool = std::is_convertible_v<_Ty, _Tree_node_policy>>
+            struct _Is_node_policy : std::false_type {};
+            template <class _Ty>
+            struct _Is_node_policy<_Ty, true> : std::true_type {
+                using type = typename _Ty::template node<_Tp>;
+            };
+
+            using _Key     = typename _Cate::key_type;
+            using _Compare = typename _Cate::key_compare;
+            // prefixes are only ordered as keys compared by operator< of strings, other trees would never read them
+            static constexpr bool _Prefix = _Is_char_string<_Key>::value
+                                         && (std::is_same_v<_Compare, std::less<>> || std::is_same_v<_Compare, std::less<_Key>>);
+
+            using type = select_type_t<_Is_node_policy<_Policies>...,
+                                       std::conditional_t<_Prefix, _Prefix_tree_node<_Tp>, _Tree_node<_Tp>>>;
+        };
+
+        /**
+         * Stats policy is used to determine whether a tree counts its structural work, i.e. rotations, fixup iterations and
+         * comparisons of searches. Counters are read by stats(). Without TreeStats, the per-tree state is empty and takes no
+         * space because of compressed_tuple.
+         */
+        struct _Tree_stats_policy {};
+
+        template <class... _Policies>
+        struct _Select_stats_policy {
+            template <class _Ty>
+            struct _Is_stats_policy : std::is_convertible<_Ty, _Tree_stats_policy> {
+                using type = _Tree_stats_state;
+            };
+
+            using type                  = select_type_t<_Is_stats_policy<_Policies>..., _Tree_state_base>;
+            static constexpr bool value = std::is_same_v<type, _Tree_stats_state>;
+        };
+
+        /**
+         * Finger policy is used to determine whether a tree remembers the node last found or inserted, and starts the next
+         * search from it. A search climbs from the finger to the lowest subtree that must contain the key, then descends,
+         * so sequential and nearly-sorted accesses cost O(log d) on balanced trees, where d is the distance from finger.
+         */
+        struct _Tree_finger_policy {};
+
+        template <class... _Policies>
+        struct _Select_finger_policy : std::disjunction<std::is_convertible<_Policies, _Tree_finger_policy>...> {};
+
+        /**
+         * Priority policy is used by treap to determine the priority of a new node.
+         * There are two choices:
+         * 1. default: priorities are drawn from a splitmix64 generator owned by each tree. Trees are seeded from a global
+         * sequence, so a single-threaded program builds the same treaps on every run.
+         * 2. HashPriority: priority is the mixed hash of key, so the shape of treap only depends on the set of keys. Equal
+         * keys of a multi-treap would share one priority and degenerate into a chain, so there the hash only takes the
+         * high half of priority and the low half is drawn from the generator of tree, which keeps runs of equal keys
+         * balanced.
+         */
+        struct _Treap_priority_policy {};
+
+        template <class... _Policies>
+        struct _Select_priority_policy : std::disjunction<std::is_convertible<_Policies, _Treap_priority_policy>...> {};
+
+        inline std::uint64_t _Splitmix64(std::uint64_t x) noexcept {
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+        inline std::uint64_t _Next_tree_seed() noexcept {
+            static std::atomic<std::uint64_t> _trees{ 0 };
+            return _Splitmix64(_trees.fetch_add(1, std::memory_order_relaxed));
+        }
+
+        /**
+         *	@brief extends per-tree state by a splitmix64 generator, which is used by randomized trees.
+         */
+        template <class _State>
+        struct _Random_tree_state : _State {
+            std::uint64_t next() noexcept { return _Splitmix64(_seed += 0x9E3779B97F4A7C15ull); }
+
+            std::uint64_t _seed = _Next_tree_seed();
+        };
+
+        /**
+         *	@brief extends per-tree state by the maximum size since the whole tree was rebuilt, which is used by scapegoat
+         *	tree. It only decides when erasures rebuild the tree, so it need not follow elements when trees are swapped.
+         */
+        template <class _State>
+        struct _Scapegoat_tree_state : _State {
+            size_t _max_size = 0;
+        };
+
+        /**
+         * Splay policies are used by splay tree to reduce the rotations of lookups.
+         * Mode decides how a node is splayed:
+         * 1. default: full splaying, which moves node to root.
+         * 2. SemiSplay: semi-splaying, which only lifts the parent at a zig-zig step and continues from it. Node ends about
+         * halfway to the root, while each step does at most one rotation less.
+         * Trigger decides whether access_fixup splays at all. Insertion and erasure always splay.
+         * 1. default: always.
+         * 2. SplayProbability<N>: with probability 1/N, drawn from a generator owned by each tree.
+         * 3. SplayDepth<D>: only if node is deeper than D, so hot nodes near root cost no rotation.
+         */
+        struct _Splay_mode_policy {};
+        struct _Splay_trigger_policy {};
+
+        template <class... _Policies>
+        struct _Select_splay_mode : std::disjunction<std::is_convertible<_Policies, _Splay_mode_policy>...> {};
+
+        struct _Splay_always : _Splay_trigger_policy {
+            static constexpr bool random = false;
+
+            template <class _State, class _Nodeptr>
+            static constexpr bool accept(_State&, _Nodeptr) noexcept {
+                return true;
+            }
+        };
+
+        template <class... _Policies>
+        struct _Select_splay_trigger {
+            template <class _Ty>
+            struct _Is_trigger_policy : std::is_convertible<_Ty, _Splay_trigger_policy> {
+                using type = _Ty;
+            };
+
+            using type = select_type_t<_Is_trigger_policy<_Policies>..., _Splay_always>;
         };
+    }  // namespace
 
-        template <class _Key, class _Value, class _Compare>
-        struct _Map_traits {
-            using key_type    = _Key;
-            using value_type  = std::pair<const _Key, _Value>;
-            using key_compare = _Compare;
-            struct value_compare {
-                XSTL_NODISCARD bool operator()(const value_type& lhs, const value_type& rhs) const {
-                    return key_compare()(lhs.first, rhs.first);
-                }
-            };
+    struct CompactNode : _Tree_node_policy {
+        template <class _Tp>
+        using node = _Compact_tree_node<_Tp>;
+    };
 
-            template <class _Derived>
-            struct node_handle_base {
-                using mapped_type = _Value;
+    struct ThreadedNode : _Tree_node_policy {
+        template <class _Tp>
+        using node = _Threaded_tree_node<_Tp>;
+    };
 
-                key_type&    key() const noexcept { return static_cast<const _Derived*>(this)->_Getptr()->_value.first; }
-                mapped_type& mapped() const noexcept { return static_cast<const _Derived*>(this)->_Getptr()->_value.second; }
-            };
+    struct OffsetNode : _Tree_node_policy {
+        template <class _Tp>
+        using node = _Offset_tree_node<_Tp>;
+    };
 
-            template <class... Args>
-            struct in_place_key_extract {
-                static constexpr bool extractable = false;
-            };
+    struct TreeStats : _Tree_stats_policy {};
 
-            template <>
-            struct in_place_key_extract<_Key, _Value> {
-                static constexpr bool extractable = true;
-                static const _Key&    extract(const _Key& key, const _Value&) noexcept { return key; }
-            };
+    struct FingerSearch : _Tree_finger_policy {};
 
-            static const _Key& kfn(const std::pair<const _Key, _Value>& value) { return value.first; }
-        };
+    struct HashPriority : _Treap_priority_policy {};
 
-        template <class _Cate, class _Alloc, bool _Mfl, class _CRTP = void>
-        struct bs_traits {
+    struct SemiSplay : _Splay_mode_policy {};
+
+    template <unsigned _Denominator>
+    struct SplayProbability : _Splay_trigger_policy {
+        static_assert(_Denominator > 0, "splay probability must be 1/N with N > 0");
+
+        static constexpr bool random = true;
+
+        template <class _State, class _Nodeptr>
+        static bool accept(_State& state, _Nodeptr) noexcept {
+            return state.next() % _Denominator == 0;
+        }
+    };
+
+    template <size_t _Depth>
+    struct SplayDepth : _Splay_trigger_policy {
+        static constexpr bool random = false;
+
+        template <class _State, class _Nodeptr>
+        static bool accept(_State&, _Nodeptr node) noexcept {
+            size_t _depth = 0;
+            for (; !node->is_real_root() && _depth <= _Depth; node = node->_parent)
+                ++_depth;
+            return _depth > _Depth;
+        }
+    };
+
+    namespace {
+        /**
+         *	@class _Tree_traits
+         *   @brief the common part of all tree traits. _CRTP is the most derived traits, which may hide fixup functions and
+         *	extract_node_impl.
+         */
+        template <class _Cate, class _Alloc, bool _Mfl, class _CRTP, class... _Policies>
+        struct _Tree_traits {
             using key_type        = typename _Cate::key_type;
             using value_type      = typename _Cate::value_type;
             using key_compare     = typename _Cate::key_compare;
             using value_compare   = typename _Cate::value_compare;
-            using _Node           = _Tree_node<value_type>;
+            using _Node           = typename _Select_node_policy<_Cate, _Policies...>::type;
             using _Nodeptr        = _Node*;
             using allocator_type  = _Alloc;
             using _Altp_traits    = std::allocator_traits<allocator_type>;
@@ -2035,58 +3840,72 @@ namespace xstl {
                 std::conditional_t<std::is_same_v<key_type, value_type>, const_iterator, iter_adapter::bid_iter<_Scary_val>>;
 
             using _Traits_category = _Cate;
-            using node_type        = _Node_handle<_Tree_node<value_type>, _Alloc, typename _Cate::node_handle_base>;
+            using node_type        = _Node_handle<_Node, _Alloc, typename _Cate::node_handle_base>;
             template <class... _Args>
             using _In_place_key_extractor = typename _Cate::template in_place_key_extract<_Args...>;
 
-            static constexpr bool _Multi = _Mfl;
+            static constexpr bool _Multi        = _Mfl;
+            static constexpr bool _Compact_node = std::is_same_v<_Node, _Compact_tree_node<value_type>>;
+            static constexpr bool _Prefix_node  = std::is_same_v<_Node, _Prefix_tree_node<value_type>>;
+            static constexpr bool _Count_stats   = _Select_stats_policy<_Policies...>::value;
+            static constexpr bool _Finger_search = _Select_finger_policy<_Policies...>::value;
+            static constexpr bool _Order_statistics = false;  // whether _prop of every node is the size of its subtree
+
+            using _Stats_state = typename _Select_stats_policy<_Policies...>::type;
+            using _Tree_state  = std::conditional_t<_Finger_search, _Finger_tree_state<_Stats_state, _Node>,
+                                                   _Stats_state>;  // derived traits may extend it
 
             static const auto& kfn(const typename _Cate::value_type& value) { return _Cate::kfn(value); }
 
             template <class _Traits, template <class, class> class... _MixIn>
             static void insert_fixup(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) noexcept {}
-            template <class _Crtp,
-                      class = decltype(&std::declval<_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>>()::insert_fixup),
-                      template <class, class> class... _MixIn>
-            static void insert_fixup(_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>* tree, _Nodeptr node) {
-                static_cast<_Crtp*>(this)->insert_fixup(tree, node);
-            }
 
             template <class _Traits, template <class, class> class... _MixIn>
             static void erase_fixup(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) noexcept {
                 insert_fixup(tree, node);
             }
-            template <class _Crtp,
-                      class = decltype(&std::declval<_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>>()::erase_fixup),
-                      template <class, class> class... _MixIn>
-            static void erase_fixup(_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>* tree, _Nodeptr node) {
-                static_cast<_Crtp*>(this)->erase_fixup(tree, node);
-            }
 
             template <class _Traits, template <class, class> class... _MixIn>
             static void access_fixup(_Bs_tree<_Traits, _MixIn...>*, _Nodeptr) noexcept {
                 // DO NOTHING
             }
-            template <class _Crtp,
-                      class = decltype(&std::declval<_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>>()::access_fixup),
-                      template <class, class> class... _MixIn>
-            static void access_fixup(_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>* tree, _Nodeptr node) {
-                static_cast<_Crtp*>(this)->access_fixup(tree, node);
-            }
 
             template <class _Traits, template <class, class> class... _MixIn>
             static _Nodeptr extract_node(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) {
-                const _Nodeptr _parent = extract_node_impl(tree, node), _root = _Tree_accessor::root(tree);
-                _Node::assign_node(node, _root, _root, _root, BLACK, node->_is_nil);
+                if constexpr (_Finger_search)
+                    _Tree_accessor::state(tree).forget(node);
+                const _Nodeptr _parent = _CRTP::extract_node_impl(tree, node), _root = _Tree_accessor::root(tree);
+                _Node::assign_node(node, _root, _root, _root, RED, node->is_nil());  // ready to insert, like _Tree_temp_node
                 return _parent;
             }
 
+            /**
+             *	@brief links nodes[0, count), which are in order, into a balanced tree. Every node gets its balance data from
+             *	build_fixup after its children are built.
+             *	@return root of the new tree
+             */
+            template <class _Traits, template <class, class> class... _MixIn>
+            static _Nodeptr build(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr* nodes, size_t count) noexcept {
+                size_t _max_depth = 0;
+                while ((count >> _max_depth) > 1)
+                    ++_max_depth;
+                return _Build_balanced(tree, nodes, count, _Tree_accessor::root(tree), 0, _max_depth);
+            }
+
+            /**
+             *	@brief sets balance data of a node built by build. Leaves of a built tree are at max_depth or max_depth - 1.
+             */
+            static void build_fixup(_Nodeptr, size_t /*depth*/, size_t /*max_depth*/) noexcept {
+                // DO NOTHING
+            }
+
         protected:
             template <class _Traits, template <class, class> class... _MixIn>
             inline static _Nodeptr rotate_left(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Tree_accessor::state(tree).count(_Tree_event::rotation);
                 _Nodeptr _pivot = node->_right;
                 node->_right    = _pivot->_left;
-                if (!_pivot->_left->_is_nil)
+                if (!_pivot->_left->is_nil())
                     _pivot->_left->_parent = node;
                 _pivot->_parent = node->_parent;
                 if (node->is_real_root())
@@ -2100,9 +3919,10 @@ namespace xstl {
 
             template <class _Traits, template <class, class> class... _MixIn>
             inline static _Nodeptr rotate_right(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Tree_accessor::state(tree).count(_Tree_event::rotation);
                 _Nodeptr _pivot = node->_left;
                 node->_left     = _pivot->_right;
-                if (!_pivot->_right->_is_nil)
+                if (!_pivot->_right->is_nil())
                     _pivot->_right->_parent = node;
                 _pivot->_parent = node->_parent;
                 if (node->is_real_root())
@@ -2114,6 +3934,70 @@ namespace xstl {
                 return _pivot;
             }
 
+            template <class _Traits, template <class, class> class... _MixIn>
+            static _Nodeptr _Build_balanced(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr* nodes, size_t count, _Nodeptr parent,
+                                            size_t depth, size_t max_depth) noexcept {
+                const _Nodeptr _root = _Tree_accessor::root(tree);
+                if (count == 0)
+                    return _root;
+                const size_t   _mid  = count / 2;
+                const _Nodeptr _node = nodes[_mid];
+                _node->_parent       = parent;
+                _node->_left         = _Build_balanced(tree, nodes, _mid, _node, depth + 1, max_depth);
+                _node->_right        = _Build_balanced(tree, nodes + _mid + 1, count - _mid - 1, _node, depth + 1, max_depth);
+                _CRTP::build_fixup(_node, depth, max_depth);
+                return _node;
+            }
+
+            /**
+             *	@brief relinks the subtree of node, which has count nodes, into a balanced one in O(count) without allocation.
+             *	Nodes are flattened into a list through _right from the greatest one, then linked in the same shape as build.
+             *	Depths passed to build_fixup are relative to the subtree.
+             *	@return root of the rebuilt subtree
+             */
+            template <class _Traits, template <class, class> class... _MixIn>
+            static _Nodeptr rebuild_subtree(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node, size_t count) noexcept {
+                const _Nodeptr _parent  = node->_parent;
+                const bool     _is_root = node->is_real_root(), _is_left = !_is_root && node->is_left();
+                _Nodeptr       _head = _Tree_accessor::root(tree), _curr = _Node::rightmost(node);
+                for (size_t i = 0; i < count; ++i) {  // predecessors never read _right of greater nodes
+                    const _Nodeptr _pre = _Node::find_inorder_predecessor(_curr);
+                    _curr->_right       = _head;
+                    _head               = _curr;
+                    _curr               = _pre;
+                }
+                size_t _max_depth = 0;
+                while ((count >> _max_depth) > 1)
+                    ++_max_depth;
+                const _Nodeptr _sub = _Build_list(tree, _head, count, 0, _max_depth);
+                _sub->_parent       = _parent;
+                if (_is_root)
+                    _parent->_parent = _sub;
+                else if (_is_left)
+                    _parent->_left = _sub;
+                else
+                    _parent->_right = _sub;
+                return _sub;
+            }
+
+            template <class _Traits, template <class, class> class... _MixIn>
+            static _Nodeptr _Build_list(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr& head, size_t count, size_t depth,
+                                        size_t max_depth) noexcept {
+                if (count == 0)
+                    return _Tree_accessor::root(tree);
+                const size_t   _mid  = count / 2;
+                const _Nodeptr _left = _Build_list(tree, head, _mid, depth + 1, max_depth), _node = head;
+                head                 = head->_right;
+                _node->_left         = _left;
+                _node->_right        = _Build_list(tree, head, count - _mid - 1, depth + 1, max_depth);
+                if (!_node->_left->is_nil())
+                    _node->_left->_parent = _node;
+                if (!_node->_right->is_nil())
+                    _node->_right->_parent = _node;
+                _CRTP::build_fixup(_node, depth, max_depth);
+                return _node;
+            }
+
             /**
              *	@brief take node from tree.the old position will be occupied by its successor.
              *	@param tree : current tree
@@ -2122,11 +4006,13 @@ namespace xstl {
              */
             template <class _Traits, template <class, class> class... _MixIn>
             static void take_node(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node, _Nodeptr suc) noexcept {
-                if (node->is_left())
+                if (node->is_real_root())  // header links leftmost and rightmost by _left and _right, check root first
+                    _Tree_accessor::root(tree)->_parent = suc;
+                else if (node == node->_parent->_left)
                     node->_parent->_left = suc;
-                else if (node->is_right())
+                else
                     node->_parent->_right = suc;
-                if (!suc->_is_nil)
+                if (!suc->is_nil())
                     suc->_parent = node->_parent;
             }
 
@@ -2134,25 +4020,18 @@ namespace xstl {
              *	@brief extract node from tree and find its successor to replace the old node
              *	@param tree : current tree
              *	@param node : the node need to be extracted.
-             *	@return parent of node.
+             *	@return the lowest node whose subtree has changed, which is where erase_fixup starts.
              */
-            template <
-                class _Crtp,
-                class = decltype(&std::declval<_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>>()::extract_node_impl),
-                template <class, class> class... _MixIn>
-            static _Nodeptr extract_node_impl(_Bs_tree<bs_traits<_Cate, _Alloc, _Mfl, _Crtp>, _MixIn...>* tree, _Nodeptr node) {
-                return static_cast<_Crtp*>(this)->extract_node_impl(tree, node);
-            }
-
             template <class _Traits, template <class, class> class... _MixIn>
             static _Nodeptr extract_node_impl(_Bs_tree<_Traits, _MixIn...>* tree, _Nodeptr node) noexcept {
-                if (node->_left->_is_nil)
+                if (node->_left->is_nil())
                     take_node(tree, node, node->_right);
-                else if (node->_right->_is_nil)
+                else if (node->_right->is_nil())
                     take_node(tree, node, node->_left);
                 else {
-                    _Nodeptr _suc = _Node::leftmost(node->_right);
+                    _Nodeptr _suc = _Node::leftmost(node->_right), _changed = _suc;
                     if (_suc->_parent != node) {
+                        _changed = _suc->_parent;
                         take_node(tree, _suc, _suc->_right);
                         _suc->_right          = node->_right;
                         _suc->_right->_parent = _suc;
@@ -2160,30 +4039,48 @@ namespace xstl {
                     take_node(tree, node, _suc);
                     _suc->_left          = node->_left;
                     _suc->_left->_parent = _suc;
+                    return _changed;
                 }
                 return node->_parent;
             }
+
         };
 
-        template <class _Cate, class _Alloc, bool _Mfl>
-        struct avl_traits : public bs_traits<_Cate, _Alloc, _Mfl, avl_traits<_Cate, _Alloc, _Mfl>> {
-            using _Self      = avl_traits<_Cate, _Alloc, _Mfl>;
-            using _Base      = bs_traits<_Cate, _Alloc, _Mfl, _Self>;
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct bs_traits : public _Tree_traits<_Cate, _Alloc, _Mfl, bs_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {};
+
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct avl_traits
+            : public _Tree_traits<_Cate, _Alloc, _Mfl, avl_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self      = avl_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base      = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
             using _Nodeptr   = typename _Base::_Nodeptr;
             using _Node      = typename _Base::_Node;
             using value_type = typename _Base::value_type;
+            static_assert(!_Base::_Compact_node, "avl tree stores height in every node, which cannot be packed by CompactNode");
 
             using _Base::rotate_left;
             using _Base::rotate_right;
 
             template <template <class, class> class... _MixIn>
             static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                erase_fixup(tree, node);
+                _Rebalance<_Tree_event::insert_fixup>(tree, node);
             }
 
             template <template <class, class> class... _MixIn>
             static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                for (_Nodeptr _curr = node; !_curr->_is_nil; _curr = _curr->_parent) {
+                _Rebalance<_Tree_event::erase_fixup>(tree, node);
+            }
+
+            static void build_fixup(_Nodeptr node, size_t, size_t) noexcept {
+                node->_prop = (std::max)(node->_left->_prop, node->_right->_prop) + 1;
+            }
+
+        private:
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Rebalance(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
+                for (_Nodeptr _curr = node; !_curr->is_nil(); _curr = _curr->_parent) {
+                    _Tree_accessor::state(tree).count(_Event);
                     _Nodeptr _left = _curr->_left, _right = _curr->_right;
                     _curr->_prop = (std::max)(_left->_prop, _right->_prop) + 1;
                     if (_left->_prop - _right->_prop == 2) {
@@ -2199,7 +4096,6 @@ namespace xstl {
                 }
             }
 
-        private:
             template <template <class, class> class... _MixIn>
             inline static void _Rotate_left(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
                 _Nodeptr _pivot = rotate_left(tree, node);
@@ -2215,73 +4111,212 @@ namespace xstl {
             }
         };
 
-        template <class _Cate, class _Alloc, bool _Mfl>
-        struct treap_traits : public bs_traits<_Cate, _Alloc, _Mfl, treap_traits<_Cate, _Alloc, _Mfl>> {
-            using _Self    = treap_traits<_Cate, _Alloc, _Mfl>;
-            using _Base    = bs_traits<_Cate, _Alloc, _Mfl, _Self>;
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct treap_traits
+            : public _Tree_traits<_Cate, _Alloc, _Mfl, treap_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self    = treap_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base    = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
             using _Nodeptr = typename _Base::_Nodeptr;
+            static_assert(!_Base::_Compact_node, "treap stores priority in every node, which cannot be packed by CompactNode");
             using _Base::rotate_left;
             using _Base::rotate_right;
 
+            static constexpr bool _Hash_priority = _Select_priority_policy<_Policies...>::value;
+
+            using _Tree_state = std::conditional_t<_Hash_priority && !_Mfl, typename _Base::_Tree_state,
+                                                   _Random_tree_state<typename _Base::_Tree_state>>;
+
             template <template <class, class> class... _MixIn>
             static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                node->_prop = _mt();
-                erase_fixup(tree, node);
+                _Assign_priority(tree, node);
+                _Sift_up<_Tree_event::insert_fixup>(tree, node);
             }
 
             template <template <class, class> class... _MixIn>
-            static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
+            static void erase_fixup(_Bs_tree<_Self, _MixIn...>*, _Nodeptr) noexcept {
+                // DO NOTHING, since extract_node_impl keeps the heap order
+            }
+
+            /**
+             *	@brief rotates node down to a node with at most one child, through its child of higher priority, then takes it.
+             */
+            template <template <class, class> class... _MixIn>
+            static _Nodeptr extract_node_impl(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                while (!node->_left->is_nil() && !node->_right->is_nil()) {
+                    _Tree_accessor::state(tree).count(_Tree_event::erase_fixup);
+                    if (node->_left->_prop < node->_right->_prop)
+                        rotate_right(tree, node);
+                    else
+                        rotate_left(tree, node);
+                }
+                _Base::take_node(tree, node, node->_left->is_nil() ? node->_right : node->_left);
+                return node->_parent;
+            }
+
+            /**
+             *	@brief draws priorities of nodes again, since they may be fresh, and links nodes in order into the only treap of
+             *	their priorities, which is a Cartesian tree built by a stack of its right spine in O(n).
+             */
+            template <template <class, class> class... _MixIn>
+            static _Nodeptr build(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr* nodes, size_t count) noexcept {
+                const _Nodeptr _nil  = _Tree_accessor::root(tree);
+                _Nodeptr       _root = _nil, _last = _nil;
+                for (size_t i = 0; i < count; ++i) {
+                    const _Nodeptr _node = nodes[i];
+                    _Assign_priority(tree, _node);
+                    _Nodeptr _child = _nil, _up = _last;
+                    while (!_up->is_nil() && _node->_prop < _up->_prop) {  // pops the right spine which sinks below node
+                        _child = _up;
+                        _up    = _up->_parent;
+                    }
+                    _node->_left   = _child;
+                    _node->_right  = _nil;
+                    _node->_parent = _up;
+                    if (!_child->is_nil())
+                        _child->_parent = _node;
+                    if (_up->is_nil())
+                        _root = _node;
+                    else
+                        _up->_right = _node;
+                    _last = _node;
+                }
+                return _root;
+            }
+
+        private:
+            template <template <class, class> class... _MixIn>
+            static void _Assign_priority(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                if constexpr (_Hash_priority) {
+                    const std::uint64_t _hash =
+                        _Splitmix64(std::hash<typename _Base::key_type>{}(_Base::kfn(_Base::_Node::value_of(node))));
+                    if constexpr (_Mfl)  // equal keys are ordered by the low half, drawn at random
+                        node->_prop = static_cast<int>((_hash >> 48 << 16) | (_Tree_accessor::state(tree).next() >> 48));
+                    else
+                        node->_prop = static_cast<int>(_hash >> 32);
+                }
+                else
+                    node->_prop = static_cast<int>(_Tree_accessor::state(tree).next() >> 32);
+            }
+
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Sift_up(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
                 while (!node->is_real_root() && node->_prop < node->_parent->_prop) {
+                    _Tree_accessor::state(tree).count(_Event);
                     if (node->is_right())
                         rotate_left(tree, node->_parent);
                     else
                         rotate_right(tree, node->_parent);
                 }
             }
-
-        private:
-            inline static std::mt19937 _mt{ std::random_device{}() };
         };
 
-        template <class _Cate, class _Alloc, bool _Mfl>
-        struct splay_traits : public bs_traits<_Cate, _Alloc, _Mfl, splay_traits<_Cate, _Alloc, _Mfl>> {
-            using _Self    = splay_traits<_Cate, _Alloc, _Mfl>;
-            using _Base    = bs_traits<_Cate, _Alloc, _Mfl, _Self>;
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct splay_traits
+            : public _Tree_traits<_Cate, _Alloc, _Mfl, splay_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self    = splay_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base    = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
             using _Nodeptr = typename _Base::_Nodeptr;
+            using _Trigger = typename _Select_splay_trigger<_Policies...>::type;
             using _Base::rotate_left;
             using _Base::rotate_right;
 
+            static constexpr bool _Semi_splay = _Select_splay_mode<_Policies...>::value;
+
+            using _Tree_state = std::conditional_t<_Trigger::random, _Random_tree_state<typename _Base::_Tree_state>,
+                                                   typename _Base::_Tree_state>;
+
             template <template <class, class> class... _MixIn>
             static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                while (!node->is_real_root()) {
-                    if (node->is_left()) {
-                        if (node->_parent->is_left() && !node->_parent->is_real_root())
-                            rotate_right(tree, node->_parent);
-                        rotate_right(tree, node->_parent);
-                    }
-                    else {
-                        if (node->_parent->is_right() && !node->_parent->is_real_root())
-                            rotate_left(tree, node->_parent);
-                        rotate_left(tree, node->_parent);
-                    }
-                }
+                _Splay<_Tree_event::insert_fixup>(tree, node);
             }
 
             template <template <class, class> class... _MixIn>
             static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                insert_fixup(tree, node);
+                _Splay<_Tree_event::erase_fixup>(tree, node);
             }
 
             template <template <class, class> class... _MixIn>
             static void access_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                insert_fixup(tree, node);
+                if (_Trigger::accept(_Tree_accessor::state(tree), node))
+                    _Splay<_Tree_event::access_fixup>(tree, node);
+            }
+
+        private:
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Splay(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
+                if constexpr (_Semi_splay)
+                    _Semi_splay_up<_Event>(tree, node);
+                else
+                    _Splay_up<_Event>(tree, node);
+            }
+
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Semi_splay_up(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
+                while (!node->is_real_root()) {
+                    _Tree_accessor::state(tree).count(_Event);
+                    const _Nodeptr _parent = node->_parent;
+                    if (_parent->is_real_root()) {  // zig
+                        if (node->is_left())
+                            rotate_right(tree, _parent);
+                        else
+                            rotate_left(tree, _parent);
+                    }
+                    else if (node->is_left() == _parent->is_left()) {  // zig-zig, lifts parent only and continues from it
+                        if (_parent->is_left())
+                            rotate_right(tree, _parent->_parent);
+                        else
+                            rotate_left(tree, _parent->_parent);
+                        node = _parent;
+                    }
+                    else if (node->is_left()) {  // zig-zag
+                        rotate_right(tree, _parent);
+                        rotate_left(tree, node->_parent);
+                    }
+                    else {
+                        rotate_left(tree, _parent);
+                        rotate_right(tree, node->_parent);
+                    }
+                }
+            }
+
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Splay_up(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
+                while (!node->is_real_root()) {
+                    _Tree_accessor::state(tree).count(_Event);
+                    const _Nodeptr _parent = node->_parent;
+                    if (_parent->is_real_root()) {  // zig
+                        if (node->is_left())
+                            rotate_right(tree, _parent);
+                        else
+                            rotate_left(tree, _parent);
+                    }
+                    else if (node->is_left() == _parent->is_left()) {  // zig-zig, rotates grandparent first
+                        if (_parent->is_left()) {
+                            rotate_right(tree, _parent->_parent);
+                            rotate_right(tree, _parent);
+                        }
+                        else {
+                            rotate_left(tree, _parent->_parent);
+                            rotate_left(tree, _parent);
+                        }
+                    }
+                    else if (node->is_left()) {  // zig-zag
+                        rotate_right(tree, _parent);
+                        rotate_left(tree, node->_parent);
+                    }
+                    else {
+                        rotate_left(tree, _parent);
+                        rotate_right(tree, node->_parent);
+                    }
+                }
             }
         };
 
-        template <class _Cate, class _Alloc, bool _Mfl>
-        struct rb_traits : public bs_traits<_Cate, _Alloc, _Mfl, rb_traits<_Cate, _Alloc, _Mfl>> {
-            using _Self    = rb_traits<_Cate, _Alloc, _Mfl>;
-            using _Base    = bs_traits<_Cate, _Alloc, _Mfl, _Self>;
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct rb_traits
+            : public _Tree_traits<_Cate, _Alloc, _Mfl, rb_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self    = rb_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base    = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
             using _Node    = typename _Base::_Node;
             using _Nodeptr = typename _Base::_Nodeptr;
 
@@ -2292,12 +4327,14 @@ namespace xstl {
             template <template <class, class> class... _MixIn>
             static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
                 _Nodeptr _uncle;
-                while (!node->is_real_root() && node->_parent->_prop == RED) {
+                while (!node->is_real_root() && node->_parent->prop() == RED) {
+                    _Tree_accessor::state(tree).count(_Tree_event::insert_fixup);
                     if (node->_parent == node->_parent->_parent->_left) {
                         _uncle = node->_parent->_parent->_right;
-                        if (_uncle->_prop == RED) {
-                            _uncle->_prop = node->_parent->_prop = BLACK;
-                            node->_parent->_parent->_prop        = RED;
+                        if (_uncle->prop() == RED) {
+                            _uncle->set_prop(BLACK);
+                            node->_parent->set_prop(BLACK);
+                            node->_parent->_parent->set_prop(RED);
 
                             node = node->_parent->_parent;
                         }
@@ -2306,16 +4343,17 @@ namespace xstl {
                                 node = node->_parent;
                                 rotate_left(tree, node);
                             }
-                            node->_parent->_prop          = BLACK;
-                            node->_parent->_parent->_prop = RED;
+                            node->_parent->set_prop(BLACK);
+                            node->_parent->_parent->set_prop(RED);
                             rotate_right(tree, node->_parent->_parent);
                         }
                     }
                     else {
                         _uncle = node->_parent->_parent->_left;
-                        if (_uncle->_prop == RED) {
-                            _uncle->_prop = node->_parent->_prop = BLACK;
-                            node->_parent->_parent->_prop        = RED;
+                        if (_uncle->prop() == RED) {
+                            _uncle->set_prop(BLACK);
+                            node->_parent->set_prop(BLACK);
+                            node->_parent->_parent->set_prop(RED);
 
                             node = node->_parent->_parent;
                         }
@@ -2324,126 +4362,319 @@ namespace xstl {
                                 node = node->_parent;
                                 rotate_right(tree, node);
                             }
-                            node->_parent->_prop          = BLACK;
-                            node->_parent->_parent->_prop = RED;
+                            node->_parent->set_prop(BLACK);
+                            node->_parent->_parent->set_prop(RED);
                             rotate_left(tree, node->_parent->_parent);
                         }
                     }
                 }
-                _Tree_accessor::root(tree)->_parent->_prop = BLACK;
+                _Tree_accessor::root(tree)->_parent->set_prop(BLACK);
             }
 
             template <template <class, class> class... _MixIn>
-            static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                _Nodeptr _bro;
-                while (!node->is_real_root() && node->_prop == BLACK) {
-                    if (node->is_left()) {
-                        _bro = node->_parent->_right;
-                        if (_bro->_prop == RED) {
-                            _bro->_prop          = BLACK;
-                            node->_parent->_prop = RED;
-                            rotate_left(tree, node->_parent);
-                            _bro = node->_parent->_right;
+            static void erase_fixup(_Bs_tree<_Self, _MixIn...>*, _Nodeptr) noexcept {
+                // DO NOTHING, since extract_node_impl has rebalanced tree
+            }
+
+            static void build_fixup(_Nodeptr node, size_t depth, size_t max_depth) noexcept {
+                node->set_prop(depth == max_depth && depth != 0 ? RED : BLACK);
+            }
+
+            /**
+             *	@brief takes node from tree and restores the red black properties. The fixed node may be the nil header, so
+             *	its parent is tracked apart instead of being written into it.
+             */
+            template <template <class, class> class... _MixIn>
+            static _Nodeptr extract_node_impl(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Nodeptr _fixnode, _fixparent;
+                int      _prop = node->prop();
+                if (node->_left->is_nil() || node->_right->is_nil()) {
+                    _fixnode   = node->_left->is_nil() ? node->_right : node->_left;
+                    _fixparent = node->_parent;
+                    take_node(tree, node, _fixnode);
+                }
+                else {
+                    _Nodeptr _suc = _Node::leftmost(node->_right);
+                    _prop         = _suc->prop();
+                    _fixnode      = _suc->_right;
+                    _fixparent    = _suc;
+                    if (_suc->_parent != node) {
+                        _fixparent = _suc->_parent;
+                        take_node(tree, _suc, _suc->_right);
+                        _suc->_right          = node->_right;
+                        _suc->_right->_parent = _suc;
+                    }
+                    take_node(tree, node, _suc);
+                    _suc->_left          = node->_left;
+                    _suc->_left->_parent = _suc;
+                    _suc->set_prop(node->prop());
+                }
+                if (_prop == BLACK)
+                    _Erase_rebalance(tree, _fixnode, _fixparent);
+                return _fixparent;
+            }
+
+        private:
+            template <template <class, class> class... _MixIn>
+            static void _Erase_rebalance(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node, _Nodeptr parent) noexcept {
+                const _Nodeptr _root = _Tree_accessor::root(tree);
+                _Nodeptr       _bro;
+                while (node != _root->_parent && node->prop() == BLACK) {
+                    _Tree_accessor::state(tree).count(_Tree_event::erase_fixup);
+                    if (node == parent->_left) {
+                        _bro = parent->_right;
+                        if (_bro->prop() == RED) {
+                            _bro->set_prop(BLACK);
+                            parent->set_prop(RED);
+                            rotate_left(tree, parent);
+                            _bro = parent->_right;
                         }
-                        if (_bro->_left->_prop == BLACK && _bro->_right->_prop == BLACK) {
-                            _bro->_prop   = RED;
-                            node          = node->_parent;
-                            node->_parent = node->_parent->_parent;
+                        if (_bro->_left->prop() == BLACK && _bro->_right->prop() == BLACK) {
+                            _bro->set_prop(RED);
+                            node        = parent;
+                            parent      = parent->_parent;
                         }
                         else {
-                            if (_bro->_right->_prop == BLACK) {
-                                _bro->_left->_prop = BLACK;
-                                _bro->_prop        = RED;
+                            if (_bro->_right->prop() == BLACK) {
+                                _bro->_left->set_prop(BLACK);
+                                _bro->set_prop(RED);
                                 rotate_right(tree, _bro);
-                                _bro = node->_parent->_right;
+                                _bro = parent->_right;
                             }
-                            _bro->_prop          = node->_parent->_prop;
-                            node->_parent->_prop = BLACK;
-                            _bro->_right->_prop  = BLACK;
-                            rotate_left(tree, node->_parent);
+                            _bro->set_prop(parent->prop());
+                            parent->set_prop(BLACK);
+                            _bro->_right->set_prop(BLACK);
+                            rotate_left(tree, parent);
                             break;
                         }
                     }
                     else {
-                        _bro = node->_parent->_left;
-                        if (_bro->_prop == RED) {
-                            _bro->_prop          = BLACK;
-                            node->_parent->_prop = RED;
-                            rotate_right(tree, node->_parent);
-                            _bro = node->_parent->_left;
+                        _bro = parent->_left;
+                        if (_bro->prop() == RED) {
+                            _bro->set_prop(BLACK);
+                            parent->set_prop(RED);
+                            rotate_right(tree, parent);
+                            _bro = parent->_left;
                         }
-                        if (_bro->_right->_prop == BLACK && _bro->_left->_prop == BLACK) {
-                            _bro->_prop   = RED;
-                            node          = node->_parent;
-                            node->_parent = node->_parent->_parent;
+                        if (_bro->_right->prop() == BLACK && _bro->_left->prop() == BLACK) {
+                            _bro->set_prop(RED);
+                            node        = parent;
+                            parent      = parent->_parent;
                         }
                         else {
-                            if (_bro->_left->_prop == BLACK) {
-                                _bro->_right->_prop = BLACK;
-                                _bro->_prop         = RED;
+                            if (_bro->_left->prop() == BLACK) {
+                                _bro->_right->set_prop(BLACK);
+                                _bro->set_prop(RED);
                                 rotate_left(tree, _bro);
-                                _bro = node->_parent->_left;
+                                _bro = parent->_left;
                             }
-                            _bro->_prop          = node->_parent->_prop;
-                            node->_parent->_prop = BLACK;
-                            _bro->_left->_prop   = BLACK;
-                            rotate_right(tree, node->_parent);
+                            _bro->set_prop(parent->prop());
+                            parent->set_prop(BLACK);
+                            _bro->_left->set_prop(BLACK);
+                            rotate_right(tree, parent);
                             break;
                         }
                     }
                 }
-                _Tree_accessor::root(tree)->_parent->_prop = BLACK;
+                node->set_prop(BLACK);
             }
+        };
+
+        /**
+         *	@class scapegoat_traits
+         *   @brief scapegoat tree stores no balance data in nodes. An insertion deeper than log(n) base 1/alpha climbs to
+         *	an ancestor whose child is heavier than alpha of it, and rebuilds its subtree. Erasures rebuild the whole tree once
+         *	it shrinks below alpha of its maximum size. Both cost amortized O(log n), so CompactNode can be used.
+         */
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct scapegoat_traits
+            : public _Tree_traits<_Cate, _Alloc, _Mfl, scapegoat_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self       = scapegoat_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base       = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
+            using _Nodeptr    = typename _Base::_Nodeptr;
+            using _Tree_state = _Scapegoat_tree_state<typename _Base::_Tree_state>;
 
             template <template <class, class> class... _MixIn>
-            static _Nodeptr extract_node_impl(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) {
-                _Nodeptr _fixnode;
-                int      _prop = node->_prop;
-                if (node->_left->_is_nil) {
-                    _fixnode = node->_right;
-                    take_node(tree, node, node->_right);
+            static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                const size_t _size     = tree->size() + 1;  // node has not been counted yet
+                size_t&      _max_size = _Tree_accessor::state(tree)._max_size;
+                _max_size              = (std::max)(_max_size, _size);
+                size_t _depth          = 0;
+                for (_Nodeptr _curr = node; !_curr->is_real_root(); _curr = _curr->_parent)
+                    ++_depth;
+                if (_depth <= _Alpha_height(_size))
+                    return;
+                for (size_t _weight = 1; !node->is_real_root(); node = node->_parent) {
+                    _Tree_accessor::state(tree).count(_Tree_event::insert_fixup);
+                    const _Nodeptr _parent = node->_parent;
+                    const size_t _parent_weight = _weight + 1 + _Count(node == _parent->_left ? _parent->_right : _parent->_left);
+                    if (_weight * _Alpha_den > _parent_weight * _Alpha_num) {
+                        _Base::rebuild_subtree(tree, _parent, _parent_weight);
+                        return;
+                    }
+                    _weight = _parent_weight;
                 }
-                else if (node->_right->_is_nil) {
-                    _fixnode = node->_left;
-                    take_node(tree, node, node->_left);
+            }
+
+            template <template <class, class> class... _MixIn>
+            static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr) noexcept {
+                const size_t _size     = tree->size() - 1;  // node has not been discounted yet
+                size_t&      _max_size = _Tree_accessor::state(tree)._max_size;
+                if (_size * _Alpha_den < _max_size * _Alpha_num) {
+                    _Tree_accessor::state(tree).count(_Tree_event::erase_fixup);
+                    if (_size != 0)
+                        _Base::rebuild_subtree(tree, _Tree_accessor::root(tree)->_parent, _size);
+                    _max_size = _size;
                 }
-                else {
-                    _Nodeptr _suc = _Node::leftmost(node->_right);
-                    _prop         = _suc->_prop;
-                    _fixnode      = _suc->_right;
-                    if (_suc->_parent == node)
-                        _fixnode->_parent = _suc;
-                    else {
-                        take_node(tree, _suc, _suc->_right);
-                        _suc->_right          = node->_right;
-                        _suc->_right->_parent = _suc;
+                else
+                    _max_size = (std::max)(_max_size, _size);
+            }
+
+            template <template <class, class> class... _MixIn>
+            static _Nodeptr build(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr* nodes, size_t count) noexcept {
+                _Tree_accessor::state(tree)._max_size = count;
+                return _Base::build(tree, nodes, count);
+            }
+
+        private:
+            static constexpr size_t _Alpha_num = 7;  // alpha = 0.7
+            static constexpr size_t _Alpha_den = 10;
+
+            static constexpr double _Log_inv_alpha = 0.35667494393873238;  // log(10 / 7)
+
+            static size_t _Alpha_height(size_t size) noexcept {
+                return static_cast<size_t>(std::log(static_cast<double>(size)) / _Log_inv_alpha);
+            }
+
+            /**
+             *	@brief counts nodes of the subtree of node by a preorder walk along parent pointers, like _Walk_depth, so
+             *	that the deep subtrees it is called on need no stack.
+             */
+            static size_t _Count(_Nodeptr node) noexcept {
+                if (node->is_nil())
+                    return 0;
+                size_t _count = 1;
+                for (_Nodeptr _curr = node;; ++_count) {
+                    if (!_curr->_left->is_nil())
+                        _curr = _curr->_left;
+                    else if (!_curr->_right->is_nil())
+                        _curr = _curr->_right;
+                    else
+                        for (;;) {  // climb up until there is an unvisited right subtree
+                            if (_curr == node)
+                                return _count;
+                            const _Nodeptr _parent = _curr->_parent;
+                            if (_curr == _parent->_left && !_parent->_right->is_nil()) {
+                                _curr = _parent->_right;
+                                break;
+                            }
+                            _curr = _parent;
+                        }
+                }
+            }
+        };
+
+        /**
+         *	@class wb_traits
+         *   @brief weight balanced tree, namely BB[alpha] tree with parameters <3, 2> of Hirai and Yamamoto. _prop of every
+         *	node is the size of its subtree, so that rank and nth run in O(log n). The weight of a subtree is its size plus
+         *	one, and no child weighs more than 3 times its sibling.
+         */
+        template <class _Cate, class _Alloc, bool _Mfl, class... _Policies>
+        struct wb_traits : public _Tree_traits<_Cate, _Alloc, _Mfl, wb_traits<_Cate, _Alloc, _Mfl, _Policies...>, _Policies...> {
+            using _Self    = wb_traits<_Cate, _Alloc, _Mfl, _Policies...>;
+            using _Base    = _Tree_traits<_Cate, _Alloc, _Mfl, _Self, _Policies...>;
+            using _Nodeptr = typename _Base::_Nodeptr;
+            static_assert(!_Base::_Compact_node, "wb tree stores size in every node, which cannot be packed by CompactNode");
+
+            using _Base::rotate_left;
+            using _Base::rotate_right;
+
+            static constexpr bool _Order_statistics = true;
+
+            template <template <class, class> class... _MixIn>
+            static void insert_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Rebalance<_Tree_event::insert_fixup>(tree, node);
+            }
+
+            template <template <class, class> class... _MixIn>
+            static void erase_fixup(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Rebalance<_Tree_event::erase_fixup>(tree, node);
+            }
+
+            static void build_fixup(_Nodeptr node, size_t, size_t) noexcept { _Update(node); }
+
+        private:
+            static constexpr int _Delta = 3;
+            static constexpr int _Gamma = 2;
+
+            inline static void _Update(_Nodeptr node) noexcept { node->_prop = node->_left->_prop + node->_right->_prop + 1; }
+
+            inline static bool _Balanced(_Nodeptr light, _Nodeptr heavy) noexcept {
+                return _Delta * (light->_prop + 1) >= heavy->_prop + 1;
+            }
+
+            inline static bool _Single(_Nodeptr inner, _Nodeptr outer) noexcept {
+                return inner->_prop + 1 < _Gamma * (outer->_prop + 1);
+            }
+
+            template <_Tree_event _Event, template <class, class> class... _MixIn>
+            static void _Rebalance(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                for (_Nodeptr _curr = node; !_curr->is_nil(); _curr = _curr->_parent) {
+                    _Tree_accessor::state(tree).count(_Event);
+                    _Update(_curr);
+                    const _Nodeptr _left = _curr->_left, _right = _curr->_right;
+                    if (!_Balanced(_left, _right)) {
+                        if (!_Single(_right->_left, _right->_right))
+                            _Rotate_right(tree, _right);
+                        _curr = _Rotate_left(tree, _curr);
+                    }
+                    else if (!_Balanced(_right, _left)) {
+                        if (!_Single(_left->_right, _left->_left))
+                            _Rotate_left(tree, _left);
+                        _curr = _Rotate_right(tree, _curr);
                     }
-                    take_node(tree, node, _suc);
-                    _suc->_left          = node->_left;
-                    _suc->_left->_parent = _suc;
-                    _suc->_prop          = node->_prop;
                 }
-                return _prop == BLACK ? _fixnode : _Tree_accessor::root(tree)->_parent;
+            }
+
+            template <template <class, class> class... _MixIn>
+            inline static _Nodeptr _Rotate_left(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Nodeptr _pivot = rotate_left(tree, node);
+                _Update(node);
+                _Update(_pivot);
+                return _pivot;
+            }
+
+            template <template <class, class> class... _MixIn>
+            inline static _Nodeptr _Rotate_right(_Bs_tree<_Self, _MixIn...>* tree, _Nodeptr node) noexcept {
+                _Nodeptr _pivot = rotate_right(tree, node);
+                _Update(node);
+                _Update(_pivot);
+                return _pivot;
             }
         };
     }  // namespace
 
 #define MAP_VALUE_TYPE std::pair<const _Key, _Value>
-#define DEFINE_ASSO_CONTAINER(NAME)                                                                                 \
-    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp)>                           \
-    using NAME##_set = _Bs_tree<NAME##_traits<_Set_traits<_Tp, _Compare>, _Alloc, false>>;                          \
-    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp)>                           \
-    using NAME##_multiset = _Bs_tree<NAME##_traits<_Set_traits<_Tp, _Compare>, _Alloc, true>>;                      \
-    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE)> \
-    using NAME##_map = _Bs_tree<NAME##_traits<_Map_traits<_Key, _Value, _Compare>, _Alloc, false>, _Map>;           \
-    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE)> \
-    using NAME##_multimap = _Bs_tree<NAME##_traits<_Map_traits<_Key, _Value, _Compare>, _Alloc, true>>;
+#define DEFINE_ASSO_CONTAINER(NAME)                                                                                     \
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp), class... _Policies>           \
+    using NAME##_set = _Bs_tree<NAME##_traits<_Set_traits<_Tp, _Compare>, _Alloc, false, _Policies...>>;                \
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp), class... _Policies>           \
+    using NAME##_multiset = _Bs_tree<NAME##_traits<_Set_traits<_Tp, _Compare>, _Alloc, true, _Policies...>>;            \
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),     \
+              class... _Policies>                                                                                       \
+    using NAME##_map = _Bs_tree<NAME##_traits<_Map_traits<_Key, _Value, _Compare>, _Alloc, false, _Policies...>, _Map>; \
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),     \
+              class... _Policies>                                                                                       \
+    using NAME##_multimap = _Bs_tree<NAME##_traits<_Map_traits<_Key, _Value, _Compare>, _Alloc, true, _Policies...>>;
 
     DEFINE_ASSO_CONTAINER(bs);
     DEFINE_ASSO_CONTAINER(avl);
     DEFINE_ASSO_CONTAINER(treap);
     DEFINE_ASSO_CONTAINER(splay);
     DEFINE_ASSO_CONTAINER(rb);
+    DEFINE_ASSO_CONTAINER(scapegoat);
+    DEFINE_ASSO_CONTAINER(wb);
 #undef MAP_VALUE_TYPE
 #undef DEFINE_ASSO_CONTAINER
 
@@ -0,0 +1,341 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file bs_tree_bench.cpp
+ *   @brief Benchmarks the trees of bs_tree.hpp against std::set/std::map. It is a standalone C++20 program with its own
+ *   main, which has no build target in this repository. Run it with element counts as arguments (default: 1024 16384
+ *   131072). The output has two tables, one line per workload on one container:
+ *      timing table, of plain xstl trees:
+ *          ops/s   : operations per second
+ *          p50/p99 : latency of a single operation in nanoseconds
+ *          peak    : peak bytes held by the container's allocator during the workload
+ *      rotation table, of the same trees with TreeStats policy, whose counters would skew the timings:
+ *          rot/op  : rotations per operation
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#include "bs_tree.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace bench {
+    /**
+     *   @brief memory held by counting_allocator, which is shared by all instantiations.
+     */
+    struct memory_counter {
+        inline static size_t current = 0;
+        inline static size_t peak    = 0;
+
+        static void reset_peak() noexcept { peak = current; }
+    };
+
+    template <class _Tp>
+    struct counting_allocator : std::allocator<_Tp> {
+        using value_type = _Tp;
+        template <class _Other>
+        struct rebind {
+            using other = counting_allocator<_Other>;
+        };
+
+        counting_allocator() = default;
+        template <class _Other>
+        counting_allocator(const counting_allocator<_Other>&) noexcept {}
+
+        _Tp* allocate(size_t n) {
+            memory_counter::current += n * sizeof(_Tp);
+            memory_counter::peak = (std::max)(memory_counter::peak, memory_counter::current);
+            return std::allocator<_Tp>::allocate(n);
+        }
+        void deallocate(_Tp* ptr, size_t n) noexcept {
+            memory_counter::current -= n * sizeof(_Tp);
+            std::allocator<_Tp>::deallocate(ptr, n);
+        }
+
+        template <class _Other>
+        bool operator==(const counting_allocator<_Other>&) const noexcept {
+            return true;
+        }
+        template <class _Other>
+        bool operator!=(const counting_allocator<_Other>&) const noexcept {
+            return false;
+        }
+    };
+
+    template <class _Key>
+    struct key_maker;
+
+    template <>
+    struct key_maker<std::int64_t> {
+        static std::int64_t make(std::uint64_t id) noexcept { return static_cast<std::int64_t>(id); }
+    };
+
+    template <>
+    struct key_maker<std::string> {  // fixed width keys with a shared prefix, so that comparisons are not decided by length
+        static std::string make(std::uint64_t id) {
+            char _buf[32];
+            std::snprintf(_buf, sizeof(_buf), "key:%016" PRIu64, id);
+            return _buf;
+        }
+    };
+
+    template <class _Container>
+    using key_of = typename _Container::key_type;
+
+    template <class _Container>
+    void insert_key(_Container& cont, const key_of<_Container>& key) {
+        if constexpr (std::is_same_v<typename _Container::key_type, typename _Container::value_type>)
+            cont.insert(key);
+        else
+            cont.emplace(key, typename _Container::mapped_type{});
+    }
+
+    /**
+     *   @brief rotations performed by cont so far. Containers which do not count them return -1.
+     */
+    template <class _Container>
+    long long rotations_of(const _Container& cont) {
+        if constexpr (requires { cont.stats(); })
+            return static_cast<long long>(cont.stats().rotations);
+        else
+            return -1;
+    }
+
+    /**
+     *   @brief samples ranks in [0, n) whose frequencies follow Zipf's law with exponent s.
+     */
+    class zipf_distribution {
+    public:
+        zipf_distribution(size_t n, double s) : _cdf(n) {
+            double _sum = 0;
+            for (size_t i = 0; i < n; ++i)
+                _cdf[i] = _sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+            for (double& _val : _cdf)
+                _val /= _sum;
+        }
+
+        template <class _Engine>
+        size_t operator()(_Engine& engine) {
+            const double _u = std::uniform_real_distribution<double>(0, 1)(engine);
+            return (std::min)(static_cast<size_t>(std::lower_bound(_cdf.begin(), _cdf.end(), _u) - _cdf.begin()),
+                              _cdf.size() - 1);
+        }
+
+    private:
+        std::vector<double> _cdf;
+    };
+
+    struct result {
+        double    ops_per_sec;
+        double    p50_ns;
+        double    p99_ns;
+        size_t    peak_bytes;
+        long long rotations;
+        size_t    ops;
+    };
+
+    /**
+     *   @brief times every call of op individually. The total time is the sum of all samples, so timer overhead is
+     *   included evenly for all containers.
+     */
+    template <class _Container, class _Op>
+    result measure(_Container& cont, size_t ops, _Op op) {
+        using clock = std::chrono::steady_clock;
+        std::vector<double> _samples(ops);
+        memory_counter::reset_peak();
+        const size_t    _base_bytes = memory_counter::current;
+        const long long _base_rot   = rotations_of(cont);
+        for (size_t i = 0; i < ops; ++i) {
+            const auto _start = clock::now();
+            op(i);
+            _samples[i] = std::chrono::duration<double, std::nano>(clock::now() - _start).count();
+        }
+        result _res{};
+        _res.ops        = ops;
+        _res.peak_bytes = memory_counter::peak - (std::min)(_base_bytes, memory_counter::peak);
+        _res.rotations  = _base_rot < 0 ? -1 : rotations_of(cont) - _base_rot;
+        double _total   = 0;
+        for (double _val : _samples)
+            _total += _val;
+        _res.ops_per_sec = ops == 0 ? 0 : ops / (_total * 1e-9);
+        if (ops != 0) {
+            std::nth_element(_samples.begin(), _samples.begin() + ops / 2, _samples.end());
+            _res.p50_ns = _samples[ops / 2];
+            std::nth_element(_samples.begin(), _samples.begin() + ops * 99 / 100, _samples.end());
+            _res.p99_ns = _samples[ops * 99 / 100];
+        }
+        return _res;
+    }
+
+    void report_timing(const char* container, const char* key, size_t n, const char* workload, const result& res) {
+        std::printf("%-14s %-8s %9zu %-12s %14.0f %10.0f %10.0f %12zu\n", container, key, n, workload, res.ops_per_sec,
+                    res.p50_ns, res.p99_ns, res.peak_bytes);
+    }
+
+    void report_rotations(const char* container, const char* key, size_t n, const char* workload, const result& res) {
+        const double _per_op = res.ops == 0 ? 0.0 : static_cast<double>(res.rotations) / res.ops;
+        std::printf("%-14s %-8s %9zu %-12s %8.3f\n", container, key, n, workload, _per_op);
+    }
+
+    /**
+     *   @brief runs all workloads on a container type and passes each result to report. Every workload starts from a
+     *   fresh container and the same seed.
+     */
+    template <class _Container, class _Report>
+    void run_workloads(const char* name, const char* key_name, size_t n, _Report report) {
+        using key_type = key_of<_Container>;
+        using maker    = key_maker<key_type>;
+
+        std::vector<std::uint64_t> _ids(n);  // ids of keys in the tree are even, odd ids are guaranteed to miss
+        for (size_t i = 0; i < n; ++i)
+            _ids[i] = i * 2;
+        std::vector<std::uint64_t> _shuffled = _ids;
+        std::shuffle(_shuffled.begin(), _shuffled.end(), std::mt19937_64(42));
+        std::vector<key_type> _keys;
+        _keys.reserve(n);
+        for (std::uint64_t _id : _shuffled)
+            _keys.push_back(maker::make(_id));
+        auto _fill = [&](_Container& cont) {
+            for (const auto& _key : _keys)
+                insert_key(cont, _key);
+        };
+
+        {  // sequential: ascending inserts, the worst case of an unbalanced tree
+            _Container            _cont;
+            std::vector<key_type> _sorted;
+            _sorted.reserve(n);
+            for (std::uint64_t _id : _ids)
+                _sorted.push_back(maker::make(_id));
+            report(name, key_name, n, "sequential", measure(_cont, n, [&](size_t i) { insert_key(_cont, _sorted[i]); }));
+        }
+        {  // uniform: random inserts, then random lookups
+            _Container _cont;
+            report(name, key_name, n, "uniform-ins", measure(_cont, n, [&](size_t i) { insert_key(_cont, _keys[i]); }));
+            std::mt19937_64                            _rng(7);
+            std::uniform_int_distribution<std::size_t> _pick(0, n - 1);
+            size_t                                     _hits = 0;
+            report(name, key_name, n, "uniform-find",
+                   measure(_cont, n, [&](size_t) { _hits += _cont.find(_keys[_pick(_rng)]) != _cont.end(); }));
+            if (_hits != n)
+                std::fprintf(stderr, "%s: uniform-find missed %zu keys\n", name, n - _hits);
+        }
+        {  // zipf: lookups concentrated on a few hot keys, which favours self-adjusting trees
+            _Container _cont;
+            _fill(_cont);
+            std::mt19937_64   _rng(11);
+            zipf_distribution _zipf(n, 0.99);
+            report(name, key_name, n, "zipf-find",
+                   measure(_cont, n, [&](size_t) { static_cast<void>(_cont.find(_keys[_zipf(_rng)])); }));
+        }
+        {  // churn: erase a present key and insert an absent one, keeping size constant
+            _Container _cont;
+            _fill(_cont);
+            std::vector<key_type> _fresh;
+            _fresh.reserve(n);
+            for (std::uint64_t _id : _shuffled)
+                _fresh.push_back(maker::make(_id + 1));
+            report(name, key_name, n, "churn", measure(_cont, n, [&](size_t i) {
+                       _cont.erase(_keys[i]);
+                       insert_key(_cont, _fresh[i]);
+                   }));
+        }
+        {  // scan: a lower_bound followed by an in-order walk of up to 64 elements
+            _Container _cont;
+            _fill(_cont);
+            std::mt19937_64                            _rng(13);
+            std::uniform_int_distribution<std::size_t> _pick(0, n - 1);
+            size_t                                     _visited = 0;
+            report(name, key_name, n, "scan-64", measure(_cont, n / 8 + 1, [&](size_t) {
+                       auto _iter = _cont.lower_bound(_keys[_pick(_rng)]);
+                       for (int j = 0; j < 64 && _iter != _cont.end(); ++j, ++_iter)
+                           ++_visited;
+                   }));
+        }
+        {  // mixed: 90% zipfian lookups, 5% inserts and 5% erases of uniform keys
+            _Container _cont;
+            _fill(_cont);
+            std::mt19937_64                            _rng(17);
+            zipf_distribution                          _zipf(n, 0.99);
+            std::uniform_int_distribution<std::size_t> _pick(0, n - 1);
+            std::uniform_int_distribution<int>         _dice(0, 99);
+            report(name, key_name, n, "mixed", measure(_cont, n, [&](size_t) {
+                       const int _roll = _dice(_rng);
+                       if (_roll < 90)
+                           static_cast<void>(_cont.find(_keys[_zipf(_rng)]));
+                       else if (_roll < 95)
+                           insert_key(_cont, maker::make(_ids[_pick(_rng)] + 1));
+                       else
+                           _cont.erase(_keys[_pick(_rng)]);
+                   }));
+        }
+    }
+
+    template <class _Tp>
+    using alloc = counting_allocator<_Tp>;
+    template <class _Key, class _Value>
+    using map_alloc = counting_allocator<std::pair<const _Key, _Value>>;
+
+    /**
+     *   @brief runs the set of every tree family with the given policies. std::set only joins the pass without policies,
+     *   since it has no counters.
+     */
+    template <class _Key, class... _Policies, class _Report>
+    void run_sets(const char* key_name, size_t n, _Report report) {
+        if constexpr (sizeof...(_Policies) == 0)
+            run_workloads<std::set<_Key, std::less<>, alloc<_Key>>>("std::set", key_name, n, report);
+        run_workloads<xstl::bs_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("bs_set", key_name, n, report);
+        run_workloads<xstl::avl_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("avl_set", key_name, n, report);
+        run_workloads<xstl::treap_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("treap_set", key_name, n, report);
+        run_workloads<xstl::splay_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("splay_set", key_name, n, report);
+        run_workloads<xstl::rb_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("rb_set", key_name, n, report);
+        run_workloads<xstl::scapegoat_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("scapegoat_set", key_name, n, report);
+        run_workloads<xstl::wb_set<_Key, std::less<>, alloc<_Key>, _Policies...>>("wb_set", key_name, n, report);
+    }
+
+    template <class _Key, class _Value, class... _Policies, class _Report>
+    void run_maps(const char* key_name, size_t n, _Report report) {
+        using _Alloc = map_alloc<_Key, _Value>;
+        if constexpr (sizeof...(_Policies) == 0)
+            run_workloads<std::map<_Key, _Value, std::less<>, _Alloc>>("std::map", key_name, n, report);
+        run_workloads<xstl::bs_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("bs_map", key_name, n, report);
+        run_workloads<xstl::avl_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("avl_map", key_name, n, report);
+        run_workloads<xstl::treap_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("treap_map", key_name, n, report);
+        run_workloads<xstl::splay_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("splay_map", key_name, n, report);
+        run_workloads<xstl::rb_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("rb_map", key_name, n, report);
+        run_workloads<xstl::scapegoat_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("scapegoat_map", key_name, n,
+                                                                                              report);
+        run_workloads<xstl::wb_map<_Key, _Value, std::less<>, _Alloc, _Policies...>>("wb_map", key_name, n, report);
+    }
+}  // namespace bench
+
+int main(int argc, char** argv) {
+    std::vector<size_t> _sizes;
+    for (int i = 1; i < argc; ++i)
+        _sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if (_sizes.empty())
+        _sizes = { 1 << 10, 1 << 14, 1 << 17 };
+
+    std::printf("%-14s %-8s %9s %-12s %14s %10s %10s %12s\n", "container", "key", "n", "workload", "ops/s", "p50(ns)",
+                "p99(ns)", "peak(B)");
+    for (size_t _n : _sizes) {
+        if (_n == 0)
+            continue;
+        bench::run_sets<std::int64_t>("int64", _n, bench::report_timing);
+        bench::run_maps<std::string, std::int64_t>("string", _n, bench::report_timing);
+    }
+
+    std::printf("\n%-14s %-8s %9s %-12s %8s\n", "container", "key", "n", "workload", "rot/op");
+    for (size_t _n : _sizes) {
+        if (_n == 0)
+            continue;
+        bench::run_sets<std::int64_t, xstl::TreeStats>("int64", _n, bench::report_rotations);
+        bench::run_maps<std::string, std::int64_t, xstl::TreeStats>("string", _n, bench::report_rotations);
+    }
+}
@@ -0,0 +1,584 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file bs_tree_check.cpp
+ *   @brief Checks guarantees of the trees of bs_tree.hpp which are easy to break and hard to see, against std::set and
+ *   std::multiset. It is a standalone C++20 program with its own main like bs_tree_bench.cpp, which has no build target in
+ *   this repository. Every failed expectation is printed to stderr with the tree it failed on, one line per check is
+ *   printed to stdout, and the program exits with EXIT_FAILURE if any check failed. Checks:
+ *      merge : a comparator throwing after N calls, for every N, in each of the three merge strategies, leaves every
+ *              element in exactly one of both trees, which stay ordered and usable
+ *      update : random update_key and in-place modifications followed by reposition keep the same elements as
+ *              std::set/std::multiset and never move an element to another node. A colliding key of a set is rejected
+ *              by update_key and extracted by reposition. A comparator throwing after N calls leaves the element in
+ *              its node and in the tree, unchanged by update_key and in order after reposition is called again
+ *      snapshot : load restores what save wrote, and a snapshot which is truncated or whose size is patched to 2^50
+ *              sets failbit and leaves the tree unchanged
+ *      concurrent : concurrent_map under random inserts, erases and finds from 4 threads holds exactly the elements
+ *              whose insertions outnumber their erasures, and ranges filled and thinned by one thread each while others
+ *              read end up as expected
+ *      persistent : snapshots of persistent_map keep the version they were taken from while the map and a tree made from
+ *              one of them are modified, and snapshots taken by 3 threads while a writer slides a window of keys always
+ *              see a whole version
+ *      sharded : sharded_set with a comparator reversed at runtime keeps the order of std::set, while keys inserted in
+ *              order, in reverse and from several threads keep moving shard boundaries by rebalancing
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#include "bs_tree.hpp"
+#include "concurrent_map.hpp"
+#include "persistent_map.hpp"
+#include "sharded_map.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace check {
+    inline size_t failures = 0;
+
+    void expect(bool cond, const char* tree, const char* what) {
+        if (!cond) {
+            ++failures;
+            std::fprintf(stderr, "%s: %s\n", tree, what);
+        }
+    }
+
+    template <class _Tree>
+    inline constexpr bool is_multi_v = std::is_same_v<decltype(std::declval<_Tree&>().insert(0)), typename _Tree::iterator>;
+
+    /**
+     *   @brief whether size() of tree agrees with its iteration, and its elements are in order, without duplicates unless
+     *   it is a multiset.
+     */
+    template <class _Tree>
+    bool ordered(const _Tree& tree) {
+        if (static_cast<size_t>(std::distance(tree.begin(), tree.end())) != tree.size()
+            || !std::is_sorted(tree.begin(), tree.end()))
+            return false;
+        return is_multi_v<_Tree> || std::adjacent_find(tree.begin(), tree.end()) == tree.end();
+    }
+
+    /**
+     *   @brief whether tree holds exactly the elements of ref, in the same order.
+     */
+    template <class _Tree, class _Ref>
+    bool same_elements(const _Tree& tree, const _Ref& ref) {
+        return ordered(tree) && tree.size() == ref.size() && std::equal(tree.begin(), tree.end(), ref.begin(), ref.end());
+    }
+
+    /**
+     *   @brief inserts, finds and erases a key greater than all others, and checks that tree is ordered afterwards.
+     */
+    template <class _Tree>
+    void expect_usable(_Tree& tree, const char* name) {
+        constexpr int _key  = 1 << 30;
+        const size_t  _size = tree.size();
+        tree.insert(_key);
+        expect(tree.find(_key) != tree.end(), name, "an inserted key is not found");
+        tree.erase(_key);
+        expect(tree.size() == _size && ordered(tree), name, "the tree is broken by an insertion and an erasure");
+    }
+
+    struct comparison_error {};
+
+    /**
+     *   @brief compares ints by operator< and throws once budget comparisons have been made. It is empty, so that merge
+     *   takes its fast paths as with std::less.
+     */
+    struct throwing_less {
+        inline static long long budget = -1;  // negative for never throwing
+        inline static size_t    calls  = 0;
+
+        bool operator()(int lhs, int rhs) const {
+            if (budget == 0)
+                throw comparison_error{};
+            if (budget > 0)
+                --budget;
+            ++calls;
+            return lhs < rhs;
+        }
+    };
+
+    /**
+     *   @brief merges a source of m keys into a tree of n keys, with a comparator which throws after N calls for N from 0 to
+     *   the number of comparisons of the whole merge. About half of the source collides with the tree.
+     */
+    template <class _Tree>
+    void check_merge(const char* name, size_t n, size_t m) {
+        std::mt19937                       _rng(static_cast<unsigned>(n * 31 + m));
+        std::uniform_int_distribution<int> _pick(0, static_cast<int>(n * 2));
+        std::vector<int>                   _src_keys(m);
+        for (int& _key : _src_keys)
+            _key = _pick(_rng);
+        auto _fill = [&](_Tree& dst, _Tree& src) {
+            throwing_less::budget = -1;
+            for (size_t i = 0; i < n; ++i)
+                dst.insert(static_cast<int>(i * 2));
+            for (int _key : _src_keys)
+                src.insert(_key);
+        };
+        // every merge, thrown or not, must keep these elements between both trees
+        auto _held = [](const _Tree& dst, const _Tree& src) {
+            std::multiset<int> _res(dst.begin(), dst.end());
+            _res.insert(src.begin(), src.end());
+            return _res;
+        };
+
+        std::multiset<int> _all;
+        size_t             _total = 0;
+        {
+            _Tree _dst, _src;
+            _fill(_dst, _src);
+            _all                 = _held(_dst, _src);
+            throwing_less::calls = 0;
+            _dst.merge(_src);
+            _total = throwing_less::calls;
+            expect(_held(_dst, _src) == _all && ordered(_dst) && ordered(_src), name, "merge loses or misorders elements");
+        }
+        for (size_t _budget = 0; _budget <= _total; _budget += (std::max)(_total / 97, size_t{ 1 })) {
+            _Tree _dst, _src;
+            _fill(_dst, _src);
+            throwing_less::budget = static_cast<long long>(_budget);
+            try {
+                _dst.merge(_src);
+            } catch (const comparison_error&) {
+            }
+            throwing_less::budget = -1;
+            expect(_held(_dst, _src) == _all, name, "a throwing merge loses or duplicates elements");
+            expect(ordered(_dst) && ordered(_src), name, "a throwing merge leaves a tree out of order");
+            expect_usable(_dst, name);
+            expect_usable(_src, name);
+        }
+    }
+
+    /**
+     *   @brief applies random update_key and reposition to elements of tree and to a std::set/std::multiset. New keys are
+     *   drawn from a range twice as large as the tree, so sets often collide.
+     */
+    template <class _Tree>
+    void check_update(const char* name) {
+        using _Ref = std::conditional_t<is_multi_v<_Tree>, std::multiset<int>, std::set<int>>;
+        std::mt19937                       _rng(5);
+        std::uniform_int_distribution<int> _key_of(0, 511);
+        _Tree                              _tree;
+        _Ref                               _ref;
+        for (int _step = 0; _step < 4000; ++_step) {
+            while (_tree.size() < 256) {
+                const int _key = _key_of(_rng);
+                _tree.insert(_key);
+                _ref.insert(_key);
+            }
+            const auto _pos = std::next(_tree.cbegin(), std::uniform_int_distribution<size_t>(0, _tree.size() - 1)(_rng));
+            const int  _old = *_pos, _new = _key_of(_rng);
+            const int* _addr     = std::addressof(*_pos);
+            const bool _collides = !is_multi_v<_Tree> && _new != _old && _ref.count(_new) != 0;
+            if (_step % 2 == 0) {
+                const auto [_res, _updated] = _tree.update_key(_pos, _new);
+                expect(_updated == !_collides && *_res == _new, name, "update_key returns a wrong result");
+                expect(_collides || std::addressof(*_res) == _addr, name, "update_key moves the element to another node");
+            }
+            else {
+                const_cast<int&>(*_pos) = _new;
+                auto _res               = _tree.reposition(_pos);
+                expect(_res.inserted == !_collides && *_res.position == _new, name, "reposition returns a wrong result");
+                if (_collides)
+                    expect(!_res.node.empty() && std::addressof(_res.node.value()) == _addr, name,
+                           "reposition does not hand the colliding element back");
+                else
+                    expect(_res.node.empty() && std::addressof(*_res.position) == _addr, name,
+                           "reposition moves the element to another node");
+            }
+            if (!_collides) {
+                _ref.erase(_ref.find(_old));
+                _ref.insert(_new);
+            }
+            else if (_step % 2 != 0)  // the element extracted by reposition
+                _ref.erase(_old);
+            expect(same_elements(_tree, _ref), name, "elements differ from std::set/std::multiset");
+        }
+        for (int _key : _ref)
+            expect(_tree.contains(_key), name, "an element is not found after updates");
+        expect_usable(_tree, name);
+    }
+
+    /**
+     *   @brief moves an element across the tree by update_key and by reposition, with a comparator which throws after N
+     *   calls for every N up to the number of comparisons taken.
+     */
+    template <class _Tree>
+    void check_update_throw(const char* name) {
+        using _Ref = std::conditional_t<is_multi_v<_Tree>, std::multiset<int>, std::set<int>>;
+        for (const bool _in_place : { false, true }) {
+            for (long long _budget = 0;; ++_budget) {
+                throwing_less::budget = -1;
+                _Tree _tree;
+                for (int i = 0; i < 64; ++i)
+                    _tree.insert(i * 2);
+                _Ref       _ref(_tree.begin(), _tree.end());
+                const auto _pos  = std::next(_tree.cbegin(), 5);
+                const int* _addr = std::addressof(*_pos);
+                bool       _thrown = false;
+                throwing_less::budget = _budget;
+                try {
+                    if (_in_place) {
+                        const_cast<int&>(*_pos) = 101;
+                        _tree.reposition(_pos);
+                    }
+                    else
+                        _tree.update_key(_pos, 101);
+                } catch (const comparison_error&) {
+                    _thrown = true;
+                }
+                throwing_less::budget = -1;
+                expect(std::any_of(_tree.begin(), _tree.end(), [&](const int& elem) { return std::addressof(elem) == _addr; }),
+                       name, "a throwing update loses the element");
+                if (_thrown && _in_place) {
+                    expect(_tree.size() == _ref.size(), name, "a throwing reposition changes the size");
+                    _tree.reposition(_pos);
+                }
+                if (!_thrown || _in_place) {
+                    _ref.erase(10);
+                    _ref.insert(101);
+                }
+                expect(same_elements(_tree, _ref), name, _thrown ? "a throwing update changes the tree" : "update fails");
+                expect_usable(_tree, name);
+                if (!_thrown)
+                    break;
+            }
+        }
+    }
+
+    /**
+     *   @brief saves a tree, then loads the snapshot, a truncated one and one whose size field claims 2^50 elements.
+     */
+    template <class _Tree>
+    void check_snapshot(const char* name) {
+        _Tree _tree;
+        for (int i = 0; i < 1000; ++i)
+            _tree.insert(i * 3 % 1001);
+        std::ostringstream _os;
+        _tree.save(_os);
+        const std::string _bytes = _os.str();
+
+        auto _load = [&](const std::string& bytes, const char* what) {
+            _Tree _target;  // a loaded tree replaces these elements, a rejected snapshot keeps them
+            _target.insert(7);
+            _target.insert(11);
+            std::istringstream _is(bytes);
+            _target.load(_is);
+            if (bytes == _bytes)
+                expect(!_is.fail() && same_elements(_target, _tree), name, what);
+            else
+                expect(_is.fail() && same_elements(_target, std::vector<int>{ 7, 11 }), name, what);
+        };
+        _load(_bytes, "load does not restore the saved elements");
+        _load(_bytes.substr(0, _bytes.size() - 1), "a truncated snapshot is loaded");
+        std::string         _patched = _bytes;
+        const std::uint64_t _size    = std::uint64_t{ 1 } << 50;
+        std::memcpy(_patched.data() + offsetof(xstl::_Tree_snapshot_header, _size), &_size, sizeof(_size));
+        _load(_patched, "a snapshot claiming 2^50 elements is loaded");
+    }
+
+    /**
+     *   @brief calls fn(t) on threads t of 0, 1, 2 and 3 and waits for them.
+     */
+    template <class _Fn>
+    void run_threads(_Fn fn) {
+        std::vector<std::thread> _threads;
+        for (int t = 0; t < 4; ++t)
+            _threads.emplace_back(fn, t);
+        for (std::thread& _thread : _threads)
+            _thread.join();
+    }
+
+    /**
+     *   @brief stresses a concurrent_map from 4 threads, whose elements always map key to 2 * key. Random operations on a
+     *   shared range of keys count the insertions and erasures which took place, so that the final size is known. Then
+     *   every thread fills its own range and erases its multiples of 3, while finding keys of other ranges.
+     */
+    void check_concurrent() {
+        constexpr const char*          _name = "concurrent_map";
+        constexpr int                  _keys = 2048;
+        xstl::concurrent_map<int, int> _map;
+        std::atomic<long long>         _net{ 0 };
+        std::atomic<bool>              _wrong{ false };
+        auto _expect_contents = [&](auto holds, size_t size, const char* what) {
+            std::vector<std::pair<int, int>> _elems;
+            for (const auto& _elem : _map)
+                _elems.emplace_back(_elem.first, _elem.second);
+            bool _right = _elems.size() == size && _map.size() == size;
+            for (size_t i = 0; i < _elems.size() && _right; ++i)
+                _right = (i == 0 || _elems[i - 1].first < _elems[i].first) && _elems[i].second == 2 * _elems[i].first
+                      && holds(_elems[i].first) && _map.contains(_elems[i].first);
+            expect(_right, _name, what);
+        };
+
+        run_threads([&](int t) {
+            std::mt19937                       _rng(static_cast<unsigned>(t));
+            std::uniform_int_distribution<int> _key_of(0, _keys - 1), _op(0, 2);
+            long long                          _local = 0;
+            for (int i = 0; i < 20000; ++i) {
+                const int _key = _key_of(_rng);
+                switch (_op(_rng)) {
+                case 0:
+                    _local += _map.insert({ _key, 2 * _key }).second;
+                    break;
+                case 1:
+                    _local -= static_cast<long long>(_map.erase(_key));
+                    break;
+                default:
+                    if (const auto _iter = _map.find(_key); _iter != _map.end() && _iter->second != 2 * _key)
+                        _wrong = true;
+                }
+            }
+            _net += _local;
+        });
+        expect(!_wrong, _name, "an element found by a thread has a wrong value");
+        _expect_contents([](int) { return true; }, static_cast<size_t>(_net.load()),
+                         "elements left by random operations differ from their count");
+
+        for (int _key = 0; _key < _keys; ++_key)
+            _map.erase(_key);
+        run_threads([&](int t) {
+            const int _first = _keys * t, _last = _keys * (t + 1);
+            for (int _key = _first; _key < _last; ++_key)
+                _map.insert({ _key, 2 * _key });
+            for (int _key = _first + (3 - _first % 3) % 3; _key < _last; _key += 3) {
+                _map.erase(_key);
+                const int _other = (_key + _keys) % (4 * _keys);
+                if (const auto _iter = _map.find(_other); _iter != _map.end() && _iter->second != 2 * _other)
+                    _wrong = true;
+            }
+        });
+        expect(!_wrong, _name, "an element found by a thread has a wrong value");
+        _expect_contents([](int key) { return key % 3 != 0; }, static_cast<size_t>(4 * _keys - (4 * _keys + 2) / 3),
+                         "elements left in ranges of threads differ from expected");
+    }
+
+    /**
+     *   @brief whether snapshot holds exactly the elements of ref, in the same order.
+     */
+    template <class _Snapshot>
+    bool same_version(const _Snapshot& snapshot, const std::map<int, int>& ref) {
+        if (snapshot.size() != ref.size() || !std::equal(snapshot.begin(), snapshot.end(), ref.begin(), ref.end()))
+            return false;
+        return std::all_of(ref.begin(), ref.end(), [&](const auto& elem) {
+            const auto _iter = snapshot.find(elem.first);
+            return _iter != snapshot.end() && _iter->second == elem.second;
+        });
+    }
+
+    /**
+     *   @brief takes a snapshot of a persistent_map after each of many random insertions, assignments and erasures, and
+     *   compares every snapshot with a std::map copied at the same time once all are taken. Then a writer inserts key i
+     *   and erases key i - 64 for growing i, while 3 threads check that each snapshot they take holds the keys of one
+     *   window, mapped to themselves, and stays the same while the writer goes on.
+     */
+    void check_persistent() {
+        using _Map     = xstl::persistent_map<int, int>;
+        using _Version = std::pair<_Map::snapshot_type, std::map<int, int>>;
+        constexpr const char*              _name = "persistent_map";
+        _Map                               _map;
+        std::map<int, int>                 _ref;
+        std::vector<_Version>              _versions;
+        std::mt19937                       _rng(7);
+        std::uniform_int_distribution<int> _key_of(0, 255), _op(0, 2);
+        for (int i = 0; i < 2000; ++i) {
+            const int _key = _key_of(_rng);
+            switch (_op(_rng)) {
+            case 0:
+                _map.insert({ _key, i });
+                _ref.insert({ _key, i });
+                break;
+            case 1:
+                _map.insert_or_assign(_key, i);
+                _ref.insert_or_assign(_key, i);
+                break;
+            default:
+                _map.erase(_key);
+                _ref.erase(_key);
+            }
+            if (i % 16 == 0)
+                _versions.emplace_back(_map.snapshot(), _ref);
+        }
+        const _Version&    _middle = _versions[_versions.size() / 2];
+        _Map               _restored(_middle.first);
+        std::map<int, int> _odd = _middle.second;
+        for (int _key = 0; _key < 256; _key += 2) {
+            _restored.erase(_key);
+            _odd.erase(_key);
+        }
+        expect(same_version(_restored.snapshot(), _odd), _name, "a tree made from a snapshot is modified wrongly");
+        _map.clear();
+        for (const auto& [_snapshot, _version] : _versions)
+            expect(same_version(_snapshot, _version), _name, "a snapshot differs from the version it was taken from");
+
+        std::atomic<bool> _done{ false }, _wrong{ false };
+        std::thread       _writer([&] {
+            for (int i = 0; i < 20000; ++i) {
+                _map.insert({ i, i });
+                if (i >= 64)
+                    _map.erase(i - 64);
+            }
+            _done = true;
+        });
+        run_threads([&](int t) {
+            if (t == 3)
+                return;
+            while (!_done) {
+                const _Map::snapshot_type _snapshot = _map.snapshot();
+                std::vector<int>          _keys;
+                for (const auto& _elem : _snapshot) {
+                    if (_elem.first != _elem.second || (!_keys.empty() && _elem.first != _keys.back() + 1))
+                        _wrong = true;
+                    _keys.push_back(_elem.first);
+                }
+                if (_keys.size() != _snapshot.size() || _keys.size() > 64
+                    || !std::equal(_snapshot.begin(), _snapshot.end(), _keys.begin(), _keys.end(),
+                                   [](const auto& elem, int key) { return elem.first == key; }))
+                    _wrong = true;
+            }
+        });
+        _writer.join();
+        expect(!_wrong, _name, "a snapshot taken during writes is not a whole version or changes");
+    }
+
+    /**
+     *   @brief compares ints by operator<, or by operator> if reversed. A tree which default-constructs its comparator
+     *   instead of copying it orders keys ascending.
+     */
+    struct reversible_less {
+        bool reversed = false;
+
+        bool operator()(int lhs, int rhs) const { return reversed ? rhs < lhs : lhs < rhs; }
+    };
+
+    /**
+     *   @brief fills a sharded set in the order of its comparator, in reverse, and from 4 threads at once, each time far
+     *   beyond rebalance_threshold per shard so that boundaries move, then erases every third key. Elements are compared
+     *   with a std::set after each step.
+     */
+    template <class _Set>
+    void check_sharded(const char* name, reversible_less cmpr) {
+        constexpr int                  _n = 4000;
+        _Set                           _set(4, cmpr);
+        std::set<int, reversible_less> _ref(cmpr);
+        auto _expect_same = [&](const char* what) {
+            std::vector<int> _elems;
+            _set.for_each([&](int key) { _elems.push_back(key); });
+            expect(_set.size() == _ref.size() && std::equal(_elems.begin(), _elems.end(), _ref.begin(), _ref.end()), name,
+                   what);
+            for (int _key : _ref) {
+                const auto _cursor = _set.find(_key);
+                expect(_cursor && *_cursor == _key && _set.contains(_key), name, "an element is not found");
+            }
+        };
+
+        for (int i = 0; i < _n; ++i) {
+            const int _key = cmpr.reversed ? _n - i : i;
+            _set.insert(_key);
+            _ref.insert(_key);
+        }
+        _expect_same("elements inserted in order differ from std::set");
+        for (int i = 0; i < _n; ++i) {
+            const int _key = cmpr.reversed ? _n + 1 + i : -1 - i;
+            _set.insert(_key);
+            _ref.insert(_key);
+        }
+        _expect_same("elements inserted in reverse differ from std::set");
+        run_threads([&](int t) {
+            for (int i = t; i < _n; i += 4)
+                _set.insert(2 * _n + i);
+        });
+        for (int i = 0; i < _n; ++i)
+            _ref.insert(2 * _n + i);
+        _expect_same("elements inserted by threads differ from std::set");
+        for (int _key = -_n; _key < 3 * _n; _key += 3) {
+            expect(_set.erase(_key) == _ref.erase(_key), name, "erase returns a wrong count");
+        }
+        _expect_same("elements left by erase differ from std::set");
+    }
+
+    /**
+     *   @brief calls check(std::type_identity<tree>{}, name) for the set and the multiset of every tree family.
+     */
+    template <class _Compare, class _Check>
+    void for_each_set(_Check check) {
+        using _Alloc = std::allocator<int>;
+        check(std::type_identity<xstl::bs_set<int, _Compare, _Alloc>>{}, "bs_set");
+        check(std::type_identity<xstl::avl_set<int, _Compare, _Alloc>>{}, "avl_set");
+        check(std::type_identity<xstl::treap_set<int, _Compare, _Alloc>>{}, "treap_set");
+        check(std::type_identity<xstl::splay_set<int, _Compare, _Alloc>>{}, "splay_set");
+        check(std::type_identity<xstl::rb_set<int, _Compare, _Alloc>>{}, "rb_set");
+        check(std::type_identity<xstl::scapegoat_set<int, _Compare, _Alloc>>{}, "scapegoat_set");
+        check(std::type_identity<xstl::wb_set<int, _Compare, _Alloc>>{}, "wb_set");
+        check(std::type_identity<xstl::bs_multiset<int, _Compare, _Alloc>>{}, "bs_multiset");
+        check(std::type_identity<xstl::avl_multiset<int, _Compare, _Alloc>>{}, "avl_multiset");
+        check(std::type_identity<xstl::treap_multiset<int, _Compare, _Alloc>>{}, "treap_multiset");
+        check(std::type_identity<xstl::splay_multiset<int, _Compare, _Alloc>>{}, "splay_multiset");
+        check(std::type_identity<xstl::rb_multiset<int, _Compare, _Alloc>>{}, "rb_multiset");
+        check(std::type_identity<xstl::scapegoat_multiset<int, _Compare, _Alloc>>{}, "scapegoat_multiset");
+        check(std::type_identity<xstl::wb_multiset<int, _Compare, _Alloc>>{}, "wb_multiset");
+    }
+
+    void report(const char* check, size_t failures_before) {
+        if (failures == failures_before)
+            std::printf("%-8s ok\n", check);
+        else
+            std::printf("%-8s FAILED %zu expectations\n", check, failures - failures_before);
+    }
+}  // namespace check
+
+int main() {
+    size_t _before = check::failures;
+    check::for_each_set<check::throwing_less>([](auto tag, const char* name) {
+        using _Tree = typename decltype(tag)::type;
+        check::check_merge<_Tree>(name, 512, 4);    // spliced node by node
+        check::check_merge<_Tree>(name, 512, 64);   // inserted in order from a finger
+        check::check_merge<_Tree>(name, 512, 400);  // merged into one sequence and rebuilt
+    });
+    check::report("merge", _before);
+
+    _before = check::failures;
+    check::for_each_set<std::less<>>([](auto tag, const char* name) { check::check_update<typename decltype(tag)::type>(name); });
+    check::for_each_set<check::throwing_less>(
+        [](auto tag, const char* name) { check::check_update_throw<typename decltype(tag)::type>(name); });
+    check::report("update", _before);
+
+    _before = check::failures;
+    check::for_each_set<std::less<>>(
+        [](auto tag, const char* name) { check::check_snapshot<typename decltype(tag)::type>(name); });
+    check::report("snapshot", _before);
+
+    _before = check::failures;
+    check::check_concurrent();
+    check::report("concurrent", _before);
+
+    _before = check::failures;
+    check::check_persistent();
+    check::report("persistent", _before);
+
+    _before = check::failures;
+    for (const bool _reversed : { false, true }) {
+        const check::reversible_less _cmpr{ _reversed };
+        check::check_sharded<xstl::sharded_set<int, check::reversible_less, std::allocator<int>>>("sharded_set", _cmpr);
+        check::check_sharded<xstl::sharded_set<int, check::reversible_less, std::allocator<int>, xstl::avl_set>>(
+            "sharded_set<avl_set>", _cmpr);
+    }
+    check::report("sharded", _before);
+
+    return check::failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,414 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file compressed_map.hpp
+ *   @brief The compressed library contains multisets/multimaps which store every distinct key once. A tree of bs_tree.hpp
+ *   maps each key to the number of its occurrences (multiset) or to the list of its mapped values (multimap), so a heavily
+ *   repeated key costs one node and one rebalance, and the height of tree only depends on the number of distinct keys.
+ *   They keep the semantics of multisets/multimaps, such as count, equal_range and iteration over duplicates.
+ *	1. compressed_multiset
+ *	2. compressed_multimap
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _COMPRESSED_MAP_HPP_
+#define _COMPRESSED_MAP_HPP_
+
+#include "bs_tree.hpp"
+#include <utility>
+#include <vector>
+
+namespace xstl {
+    /**
+     *	@class _Compressed_tree
+     *   @brief a multiset (_Mapped is void) or a multimap stored in a unique map of _Family from key to a bucket, which is
+     *	a count or a std::vector of mapped values in order of insertion. Elements of multimap are not stored as value_type,
+     *	so its iterators return a pair of references to key and mapped value instead of a reference to value_type.
+     *	Iterators are invalidated if their bucket changes, besides the cases of the underlying tree.
+     */
+    template <class _Key, class _Mapped, class _Compare, class _Alloc,
+              template <class, class, class, class, class...> class _Family>
+    class _Compressed_tree {
+        static constexpr bool _Is_map = !std::is_void_v<_Mapped>;
+
+    public:
+        using key_type        = _Key;
+        using mapped_type     = _Mapped;
+        using value_type      = std::conditional_t<_Is_map, std::pair<const _Key, _Mapped>, _Key>;
+        using key_compare     = _Compare;
+        using allocator_type  = _Alloc;
+        using size_type       = typename std::allocator_traits<_Alloc>::size_type;
+        using difference_type = typename std::allocator_traits<_Alloc>::difference_type;
+        using reference =
+            std::conditional_t<_Is_map, std::pair<const _Key&, std::add_lvalue_reference_t<_Mapped>>, const _Key&>;
+        using const_reference =
+            std::conditional_t<_Is_map, std::pair<const _Key&, std::add_lvalue_reference_t<const _Mapped>>, const _Key&>;
+
+    private:
+        template <class _Ty>
+        using _Rebind_alloc = typename std::allocator_traits<_Alloc>::template rebind_alloc<_Ty>;
+
+        using _Bucket     = std::conditional_t<_Is_map, std::vector<_Mapped, _Rebind_alloc<_Mapped>>, size_type>;
+        using _Tree       = _Family<_Key, _Bucket, _Compare, _Rebind_alloc<std::pair<const _Key, _Bucket>>>;
+        using _Tree_iter  = typename _Tree::iterator;
+        using _Tree_citer = typename _Tree::const_iterator;
+
+        static size_type _Bucket_size(const _Bucket& bucket) noexcept {
+            if constexpr (_Is_map)
+                return bucket.size();
+            else
+                return bucket;
+        }
+
+        /**
+         *	@brief holds the pair of references returned by operator-> of multimap iterators.
+         */
+        template <class _Ref>
+        struct _Arrow_proxy {
+            const _Ref* operator->() const noexcept { return std::addressof(_ref); }
+
+            _Ref _ref;
+        };
+
+        /**
+         *	@class _Compressed_iter
+         *   @brief bidirectional iterator, which points to the index-th element in the bucket of a node of tree.
+         */
+        template <bool _Const>
+        class _Compressed_iter {
+            friend class _Compressed_tree;
+            template <bool>
+            friend class _Compressed_iter;
+
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type        = typename _Compressed_tree::value_type;
+            using difference_type   = typename _Compressed_tree::difference_type;
+            using reference         = std::conditional_t<_Const, const_reference, typename _Compressed_tree::reference>;
+            using pointer           = std::conditional_t<_Is_map, _Arrow_proxy<reference>, const _Key*>;
+
+            _Compressed_iter() = default;
+
+            template <bool _Other_const, std::enable_if_t<_Const && !_Other_const, int> = 0>
+            _Compressed_iter(const _Compressed_iter<_Other_const>& other) noexcept : _node(other._node), _index(other._index) {}
+
+            XSTL_NODISCARD reference operator*() const noexcept {
+                if constexpr (_Is_map)
+                    return reference(_node->first, _node->second[_index]);
+                else
+                    return _node->first;
+            }
+            XSTL_NODISCARD pointer operator->() const noexcept {
+                if constexpr (_Is_map)
+                    return pointer{ **this };
+                else
+                    return std::addressof(_node->first);
+            }
+
+            _Compressed_iter& operator++() noexcept {
+                if (++_index == _Bucket_size(_node->second)) {
+                    ++_node;
+                    _index = 0;
+                }
+                return *this;
+            }
+            _Compressed_iter operator++(int) noexcept {
+                _Compressed_iter _tmp = *this;
+                ++*this;
+                return _tmp;
+            }
+
+            _Compressed_iter& operator--() noexcept {
+                if (_index == 0) {
+                    --_node;
+                    _index = _Bucket_size(_node->second) - 1;
+                }
+                else
+                    --_index;
+                return *this;
+            }
+            _Compressed_iter operator--(int) noexcept {
+                _Compressed_iter _tmp = *this;
+                --*this;
+                return _tmp;
+            }
+
+            XSTL_NODISCARD friend bool operator==(const _Compressed_iter& lhs, const _Compressed_iter& rhs) noexcept {
+                return lhs._node == rhs._node && lhs._index == rhs._index;
+            }
+            XSTL_NODISCARD friend bool operator!=(const _Compressed_iter& lhs, const _Compressed_iter& rhs) noexcept {
+                return !(lhs == rhs);
+            }
+
+        private:
+            _Compressed_iter(_Tree_iter node, size_type index) noexcept : _node(node), _index(index) {}
+
+            _Tree_iter _node{};
+            size_type  _index = 0;
+        };
+
+    public:
+        using iterator               = std::conditional_t<_Is_map, _Compressed_iter<false>, _Compressed_iter<true>>;
+        using const_iterator         = _Compressed_iter<true>;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        _Compressed_tree() = default;
+
+        explicit _Compressed_tree(const key_compare& cmpr) : _tree(cmpr) {}
+
+        _Compressed_tree(const key_compare& cmpr, const allocator_type& alloc)
+            : _tree(cmpr, _Rebind_alloc<std::pair<const _Key, _Bucket>>(alloc)) {}
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Compressed_tree(_Iter first, _Iter last) {
+            insert(first, last);
+        }
+
+        _Compressed_tree(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        _Compressed_tree(const _Compressed_tree&) = default;
+
+        _Compressed_tree(_Compressed_tree&& other) noexcept(std::is_nothrow_move_constructible_v<_Tree>)
+            : _tree(std::move(other._tree)), _size(std::exchange(other._size, 0)) {}
+
+        _Compressed_tree& operator=(const _Compressed_tree&) = default;
+
+        _Compressed_tree& operator=(_Compressed_tree&& other) noexcept(std::is_nothrow_move_assignable_v<_Tree>) {
+            _tree = std::move(other._tree);
+            _size = std::exchange(other._size, 0);
+            return *this;
+        }
+
+        XSTL_NODISCARD iterator       begin() noexcept { return iterator(_tree.begin(), 0); }
+        XSTL_NODISCARD const_iterator begin() const noexcept { return const_iterator(_Unconst(_tree.begin()), 0); }
+        XSTL_NODISCARD iterator       end() noexcept { return iterator(_tree.end(), 0); }
+        XSTL_NODISCARD const_iterator end() const noexcept { return const_iterator(_Unconst(_tree.end()), 0); }
+        XSTL_NODISCARD const_iterator cbegin() const noexcept { return begin(); }
+        XSTL_NODISCARD const_iterator cend() const noexcept { return end(); }
+
+        XSTL_NODISCARD reverse_iterator       rbegin() noexcept { return reverse_iterator(end()); }
+        XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+        XSTL_NODISCARD reverse_iterator       rend() noexcept { return reverse_iterator(begin()); }
+        XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+        XSTL_NODISCARD const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+        XSTL_NODISCARD const_reverse_iterator crend() const noexcept { return rend(); }
+
+        /**
+         *	@return the number of elements, counting every duplicate
+         */
+        XSTL_NODISCARD size_type size() const noexcept { return _size; }
+        XSTL_NODISCARD bool      empty() const noexcept { return _size == 0; }
+        XSTL_NODISCARD size_type max_size() const noexcept { return (std::numeric_limits<size_type>::max)(); }
+
+        /**
+         *	@return the number of distinct keys, namely the number of nodes of tree
+         */
+        XSTL_NODISCARD size_type unique_size() const noexcept { return _tree.size(); }
+
+        XSTL_NODISCARD size_type height() const noexcept { return _tree.height(); }
+
+        /**
+         *	@brief inserts value after all elements with equivalent key. A new key costs an insertion into tree, while a
+         *	duplicated key only costs a search.
+         *	@return an iterator to the inserted element
+         */
+        iterator insert(const value_type& value) {
+            if constexpr (_Is_map)
+                return _Add(value.first, value.second);
+            else
+                return _Add(value);
+        }
+        iterator insert(value_type&& value) {
+            if constexpr (_Is_map)
+                return _Add(value.first, std::move(value.second));
+            else
+                return _Add(std::move(value));
+        }
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert(_Iter first, _Iter last) {
+            for (; first != last; ++first)
+                insert(*first);
+        }
+
+        void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        template <class... _Args>
+        iterator emplace(_Args&&... args) {
+            return insert(value_type(std::forward<_Args>(args)...));
+        }
+
+        /**
+         *	@brief removes the element at position. The node of its key is erased with its last element.
+         *	@return iterator following the removed element
+         */
+        iterator erase(const_iterator position) {
+            const _Tree_iter _node   = position._node;
+            const size_type  _index  = position._index;
+            _Bucket&         _bucket = _node->second;
+            --_size;
+            if (_Bucket_size(_bucket) == 1)
+                return iterator(_tree.erase(_node), 0);
+            if constexpr (_Is_map)
+                _bucket.erase(_bucket.begin() + static_cast<difference_type>(_index));
+            else
+                --_bucket;
+            return _index == _Bucket_size(_bucket) ? iterator(std::next(_node), 0) : iterator(_node, _index);
+        }
+
+        /**
+         *	@brief removes the elements in [first, last). Each partly covered bucket loses its slice at once, and nodes of
+         *	the buckets covered entirely are erased as one range of the tree.
+         *	@return iterator following the last removed element
+         */
+        iterator erase(const_iterator first, const_iterator last) {
+            if (first._node == last._node) {
+                _Erase_slice(first._node->second, first._index, last._index);
+                return iterator(first._node, first._index);
+            }
+            _Tree_iter _node = first._node;
+            if (first._index != 0) {
+                _Erase_slice(_node->second, first._index, _Bucket_size(_node->second));
+                ++_node;
+            }
+            for (_Tree_iter _curr = _node; _curr != last._node; ++_curr)
+                _size -= _Bucket_size(_curr->second);
+            _tree.erase(_node, last._node);
+            if (last._index != 0)
+                _Erase_slice(last._node->second, 0, last._index);
+            return iterator(last._node, 0);
+        }
+
+        /**
+         *	@brief removes all elements with key by erasing a single node.
+         *	@return the number of elements removed
+         */
+        size_type erase(const key_type& key) {
+            const _Tree_iter _node = _tree.find(key);
+            if (_node == _tree.end())
+                return 0;
+            const size_type _count = _Bucket_size(_node->second);
+            _tree.erase(_node);
+            _size -= _count;
+            return _count;
+        }
+
+        void clear() noexcept {
+            _tree.clear();
+            _size = 0;
+        }
+
+        void swap(_Compressed_tree& other) noexcept(std::is_nothrow_swappable_v<_Tree>) {
+            using std::swap;
+            swap(_tree, other._tree);
+            swap(_size, other._size);
+        }
+
+        /**
+         *	@return the number of elements with key, which costs a single search.
+         */
+        XSTL_NODISCARD size_type count(const key_type& key) const {
+            const _Tree_citer _node = _tree.find(key);
+            return _node == _tree.end() ? 0 : _Bucket_size(_node->second);
+        }
+
+        XSTL_NODISCARD bool contains(const key_type& key) const { return _tree.contains(key); }
+
+        /**
+         *	@return an iterator to the first element with key, or end() if there is no such element.
+         */
+        XSTL_NODISCARD iterator       find(const key_type& key) { return iterator(_tree.find(key), 0); }
+        XSTL_NODISCARD const_iterator find(const key_type& key) const { return const_iterator(_Unconst(_tree.find(key)), 0); }
+
+        XSTL_NODISCARD iterator lower_bound(const key_type& key) { return iterator(_tree.lower_bound(key), 0); }
+        XSTL_NODISCARD const_iterator lower_bound(const key_type& key) const {
+            return const_iterator(_Unconst(_tree.lower_bound(key)), 0);
+        }
+
+        XSTL_NODISCARD iterator upper_bound(const key_type& key) { return iterator(_tree.upper_bound(key), 0); }
+        XSTL_NODISCARD const_iterator upper_bound(const key_type& key) const {
+            return const_iterator(_Unconst(_tree.upper_bound(key)), 0);
+        }
+
+        /**
+         *	@brief returns all elements with key, which are the bucket of a single node.
+         */
+        XSTL_NODISCARD std::pair<iterator, iterator> equal_range(const key_type& key) {
+            const _Tree_iter _node = _tree.find(key);
+            return { iterator(_node, 0), iterator(_node == _tree.end() ? _node : std::next(_node), 0) };
+        }
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const {
+            const auto [_first, _last] = _tree.equal_range(key);
+            return { const_iterator(_Unconst(_first), 0), const_iterator(_Unconst(_last), 0) };
+        }
+
+        XSTL_NODISCARD key_compare    key_comp() const { return _tree.key_comp(); }
+        XSTL_NODISCARD allocator_type get_allocator() const noexcept { return allocator_type(_tree.get_allocator()); }
+
+        XSTL_NODISCARD friend bool operator==(const _Compressed_tree& lhs, const _Compressed_tree& rhs) {
+            return lhs._size == rhs._size && lhs._tree == rhs._tree;
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Compressed_tree& lhs, const _Compressed_tree& rhs) {
+            return !(lhs == rhs);
+        }
+
+    private:
+        /**
+         *	@brief const iterators hold tree iterators, so results of the const lookups of tree are rebound to the same node.
+         *	Looking up through the const tree keeps a const lookup from splaying or moving the finger of tree.
+         */
+        static _Tree_iter _Unconst(const _Tree_citer& iter) noexcept { return _Tree_iter(iter.base(), iter._Get_cont()); }
+
+        /**
+         *	@brief removes elements [first, last) of bucket, which must not be all of them.
+         */
+        void _Erase_slice(_Bucket& bucket, size_type first, size_type last) {
+            if constexpr (_Is_map)
+                bucket.erase(bucket.begin() + static_cast<difference_type>(first),
+                             bucket.begin() + static_cast<difference_type>(last));
+            else
+                bucket -= last - first;
+            _size -= last - first;
+        }
+
+        template <class _Kty, class... _Value>
+        iterator _Add(_Kty&& key, _Value&&... mapped_value) {
+            const auto [_node, _inserted] = _tree.try_emplace(std::forward<_Kty>(key));
+            _Bucket& _bucket              = _node->second;
+            if constexpr (_Is_map) {
+                try {
+                    _bucket.emplace_back(std::forward<_Value>(mapped_value)...);
+                } catch (...) {
+                    if (_inserted)
+                        _tree.erase(_node);
+                    throw;
+                }
+            }
+            else
+                ++_bucket;
+            ++_size;
+            return iterator(_node, _Bucket_size(_bucket) - 1);
+        }
+
+        _Tree     _tree;
+        size_type _size = 0;
+    };
+
+    template <class _Key, class _Mapped, class _Compare, class _Alloc,
+              template <class, class, class, class, class...> class _Family>
+    void swap(_Compressed_tree<_Key, _Mapped, _Compare, _Alloc, _Family>& lhs,
+              _Compressed_tree<_Key, _Mapped, _Compare, _Alloc, _Family>& rhs) noexcept(noexcept(lhs.swap(rhs))) {
+        lhs.swap(rhs);
+    }
+
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp),
+              template <class, class, class, class, class...> class _Family = rb_map>
+    using compressed_multiset = _Compressed_tree<_Tp, void, _Compare, _Alloc, _Family>;
+#define MAP_VALUE_TYPE std::pair<const _Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),
+              template <class, class, class, class, class...> class _Family = rb_map>
+    using compressed_multimap = _Compressed_tree<_Key, _Value, _Compare, _Alloc, _Family>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _COMPRESSED_MAP_HPP_
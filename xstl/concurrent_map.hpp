@@ -0,0 +1,709 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file concurrent_map.hpp
+ *   @brief The concurrent library contains ordered maps/sets which can be read and modified by any number of threads without
+ *   locking. They are lock-free skip lists (Fraser's algorithm), whose removed nodes are reclaimed by epoch-based
+ *   reclamation, so readers never touch freed memory.
+ *	1. concurrent_set
+ *	2. concurrent_map
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _CONCURRENT_MAP_HPP_
+#define _CONCURRENT_MAP_HPP_
+
+#include "bs_tree.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace xstl {
+    /**
+     *	@class _Epoch_domain
+     *   @brief epoch-based reclamation. A thread announces the global epoch while it is reading shared nodes (it is
+     *	pinned), and a node which is unlinked in epoch e is freed once the global epoch reaches e + 2, because every thread
+     *	which could still see it must have been unpinned by then. Each thread keeps a record in a lock-free list. When a
+     *	thread exits, its records are handed back, to be claimed by the next thread which needs one, so the list is bounded
+     *	by the number of threads alive at once. A record is freed by the last of its domain and its owning thread to let it
+     *	go. A destroyed domain frees the retired lists of its records at once, and a thread lets go of the records of
+     *	destroyed domains whenever it takes a new record, so it keeps no more records than there are live domains it uses.
+     */
+    class _Epoch_domain {
+    public:
+        struct _Record {
+            std::atomic<std::uint64_t>                   _state{ 0 };  // (epoch << 1) | pinned
+            std::atomic<std::thread::id>                 _owner;       // a default id if no thread owns it
+            std::atomic<int>                             _refs{ 2 };   // the domain and the owning thread, if any
+            _Epoch_domain*                               _domain;
+            size_t                                       _nesting = 0;
+            std::vector<std::pair<std::uint64_t, void*>> _retired;
+            _Record*                                     _next        = nullptr;
+            _Record*                                     _thread_next = nullptr;  // the next record owned by the same thread
+
+            void release() noexcept {
+                if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete this;
+            }
+        };
+
+        /**
+         *	@class guard
+         *   @brief keeps the calling thread pinned while it is alive. Guards may nest and be copied, but never leave the
+         *	thread which created them.
+         */
+        class guard {
+        public:
+            guard() noexcept = default;
+            explicit guard(_Epoch_domain& domain) : _rec(domain._Local_record()) { _Epoch_domain::_Pin(_rec); }
+            guard(const guard& other) noexcept : _rec(other._rec) {
+                if (_rec)
+                    _Epoch_domain::_Pin(_rec);
+            }
+            guard(guard&& other) noexcept : _rec(std::exchange(other._rec, nullptr)) {}
+            guard& operator=(guard other) noexcept {
+                std::swap(_rec, other._rec);
+                return *this;
+            }
+            ~guard() {
+                if (_rec && --_rec->_nesting == 0)
+                    _rec->_state.store(0, std::memory_order_release);
+            }
+
+            _Record* record() const noexcept { return _rec; }
+
+        private:
+            _Record* _rec = nullptr;
+        };
+
+        static constexpr size_t retire_threshold = 64;
+
+        _Epoch_domain() noexcept : _id(_Next_id().fetch_add(1, std::memory_order_relaxed) + 1) {}
+        _Epoch_domain(const _Epoch_domain&)            = delete;
+        _Epoch_domain& operator=(const _Epoch_domain&) = delete;
+
+        ~_Epoch_domain() {
+            for (_Record* _rec = _records.load(std::memory_order_acquire); _rec;) {
+                decltype(_rec->_retired)().swap(_rec->_retired);  // the owning thread may keep the record for a while
+                std::exchange(_rec, _rec->_next)->release();
+            }
+        }
+
+        /**
+         *	@brief makes room for one more retired node of the pinned thread. An operation which may retire a node calls it
+         *	before it modifies anything, so that retire cannot fail after the node has been unlinked.
+         */
+        void reserve_retire(const guard& pin) {
+            auto& _retired = pin.record()->_retired;
+            if (_retired.size() == _retired.capacity())
+                _retired.reserve((std::max)(retire_threshold, _retired.size() * 2));
+        }
+
+        /**
+         *	@brief hands over a node which has been unlinked by the pinned thread. free is called with nodes which are no
+         *	longer visible to any thread, possibly including node itself. Room for node must have been made by
+         *	reserve_retire under the same pin.
+         */
+        template <class _Fn>
+        void retire(const guard& pin, void* node, _Fn&& free) noexcept {
+            _Record* const _rec = pin.record();
+            XSTL_EXPECT(_rec->_retired.size() < _rec->_retired.capacity(), "retire without reserve_retire");
+            _rec->_retired.emplace_back(_epoch.load(std::memory_order_seq_cst), node);
+            if (_rec->_retired.size() % retire_threshold == 0)
+                _Collect(_rec, _Try_advance(), free);
+        }
+
+        /**
+         *	@brief frees every retired node. It must not be called concurrently with any other operation.
+         */
+        template <class _Fn>
+        void drain(_Fn&& free) {
+            for (_Record* _rec = _records.load(std::memory_order_acquire); _rec; _rec = _rec->_next) {
+                for (auto& _retired : _rec->_retired)
+                    free(_retired.second);
+                _rec->_retired.clear();
+            }
+        }
+
+    private:
+        static std::atomic<std::uint64_t>& _Next_id() noexcept {
+            static std::atomic<std::uint64_t> _ids{ 0 };
+            return _ids;
+        }
+
+        static void _Pin(_Record* rec) noexcept {
+            if (rec->_nesting++ == 0) {
+                // a sequentially consistent store orders the announcement before every following load of links
+                rec->_state.store(rec->_domain->_epoch.load(std::memory_order_seq_cst) << 1 | 1, std::memory_order_seq_cst);
+            }
+        }
+
+        /**
+         *	@brief finds the record of calling thread, claims one handed back by an exited thread, or adds a new one. The
+         *	last used record is cached per thread, so a thread working on one container only scans the record list once.
+         */
+        _Record* _Local_record() {
+            struct _Cache {
+                std::uint64_t _id  = 0;
+                _Record*      _rec = nullptr;
+            };
+            struct _Owned {  // records owned by this thread, which are handed back when it exits
+                _Record* _head = nullptr;
+
+                /**
+                 *	@brief lets go of records whose domain has been destroyed, which are only referred to by this thread.
+                 */
+                void release_orphans() noexcept {
+                    for (_Record** _link = &_head; *_link;) {
+                        _Record* const _rec = *_link;
+                        if (_rec->_refs.load(std::memory_order_acquire) == 1) {
+                            *_link = _rec->_thread_next;
+                            _rec->release();
+                        }
+                        else
+                            _link = &_rec->_thread_next;
+                    }
+                }
+
+                ~_Owned() {
+                    while (_head) {
+                        _Record* const _rec = std::exchange(_head, _head->_thread_next);
+                        _rec->_owner.store(std::thread::id(), std::memory_order_release);
+                        _rec->release();
+                    }
+                }
+            };
+            static thread_local _Cache _cache;
+            static thread_local _Owned _owned;
+            if XSTL_LIKELY (_cache._id == _id)
+                return _cache._rec;
+            const std::thread::id _self = std::this_thread::get_id();
+            _Record*              _rec  = _records.load(std::memory_order_acquire);
+            while (_rec && _rec->_owner.load(std::memory_order_relaxed) != _self)
+                _rec = _rec->_next;
+            if (!_rec) {
+                for (_rec = _records.load(std::memory_order_acquire); _rec; _rec = _rec->_next) {
+                    std::thread::id _none;
+                    if (_rec->_owner.load(std::memory_order_relaxed) == _none
+                        && _rec->_owner.compare_exchange_strong(_none, _self, std::memory_order_acquire,
+                                                                std::memory_order_relaxed)) {
+                        _rec->_refs.fetch_add(1, std::memory_order_relaxed);
+                        break;
+                    }
+                }
+                if (!_rec) {
+                    _rec          = new _Record;
+                    _rec->_domain = this;
+                    _rec->_owner.store(_self, std::memory_order_relaxed);
+                    _rec->_next = _records.load(std::memory_order_relaxed);
+                    while (!_records.compare_exchange_weak(_rec->_next, _rec, std::memory_order_release,
+                                                           std::memory_order_relaxed))
+                        ;
+                }
+                _owned.release_orphans();
+                _rec->_thread_next = _owned._head;
+                _owned._head       = _rec;
+            }
+            _cache = { _id, _rec };
+            return _rec;
+        }
+
+        /**
+         *	@brief advances the global epoch if every pinned thread has announced the current one.
+         *	@return the global epoch after trying
+         */
+        std::uint64_t _Try_advance() noexcept {
+            std::uint64_t _curr = _epoch.load(std::memory_order_seq_cst);
+            for (_Record* _rec = _records.load(std::memory_order_acquire); _rec; _rec = _rec->_next) {
+                const std::uint64_t _state = _rec->_state.load(std::memory_order_seq_cst);
+                if ((_state & 1) && (_state >> 1) != _curr)
+                    return _curr;
+            }
+            return _epoch.compare_exchange_strong(_curr, _curr + 1, std::memory_order_seq_cst) ? _curr + 1 : _curr;
+        }
+
+        template <class _Fn>
+        static void _Collect(_Record* rec, std::uint64_t epoch, _Fn& free) {
+            auto _last = rec->_retired.begin();
+            for (auto _iter = _last; _iter != rec->_retired.end(); ++_iter) {
+                if (_iter->first + 2 <= epoch)
+                    free(_iter->second);
+                else
+                    *_last++ = *_iter;
+            }
+            rec->_retired.erase(_last, rec->_retired.end());
+        }
+
+        const std::uint64_t        _id;
+        std::atomic<std::uint64_t> _epoch{ 0 };
+        std::atomic<_Record*>      _records{ nullptr };
+    };
+
+    /**
+     *	@class _Skip_node
+     *   @brief node of skip list. The tower of _height links is allocated right after the node. The lowest bit of a link
+     *	marks that its owner has been removed from that level. _owners counts the inserting and the erasing threads which
+     *	still need the node, the last of them retires it.
+     */
+    template <class _Tp>
+    struct alignas(std::atomic<std::uintptr_t>) _Skip_node {
+        using _Node    = _Skip_node<_Tp>;
+        using _Nodeptr = _Node*;
+        using _Link    = std::atomic<std::uintptr_t>;
+
+        _Tp              _value;
+        std::atomic<int> _owners;
+        int              _height;
+
+        /**
+         *	@return the number of _Node units occupied by a node with height links
+         */
+        static constexpr size_t units(int height) noexcept {
+            return 1 + (height * sizeof(_Link) + sizeof(_Node) - 1) / sizeof(_Node);
+        }
+
+        template <class _Alnode>
+        static _Nodeptr create_node(_Alnode& alloc, int height) {
+            _Nodeptr _node = alloc.allocate(units(height));
+            construct_in_place(_node->_owners, 2);
+            _node->_height = height;
+            for (int i = 0; i < height; ++i)
+                construct_in_place(_node->next(i), std::uintptr_t{ 0 });
+            return _node;
+        }
+
+        template <class _Alnode>
+        static void free_node(_Alnode& alloc, _Nodeptr node) noexcept {
+            alloc.deallocate(node, units(node->_height));
+        }
+
+        _Link& next(int level) noexcept { return reinterpret_cast<_Link*>(this + 1)[level]; }
+
+        static _Nodeptr      ptr(std::uintptr_t link) noexcept { return reinterpret_cast<_Nodeptr>(link & ~std::uintptr_t{ 1 }); }
+        static bool          marked(std::uintptr_t link) noexcept { return link & 1; }
+        static std::uintptr_t link(_Nodeptr node) noexcept { return reinterpret_cast<std::uintptr_t>(node); }
+
+        bool removed() noexcept { return marked(next(0).load(std::memory_order_acquire)); }
+    };
+
+    /**
+     *	@class _Skip_citer
+     *   @brief forward iterator of concurrent skip list. It keeps its thread pinned, so the element it points to stays
+     *	readable even if it is erased meanwhile. Iteration is weakly consistent: it reflects every element that exists for
+     *	the whole traversal, and may or may not reflect concurrent modifications. An iterator must be used and destroyed by
+     *	the thread which obtained it, and should not be held for long, since it delays the reclamation of every node.
+     */
+    template <class _Node, class _Tp>
+    class _Skip_citer {
+        using _Nodeptr = _Node*;
+
+        template <class, class>
+        friend class _Skip_list;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = _Tp;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const _Tp*;
+        using reference         = const _Tp&;
+
+        _Skip_citer() noexcept = default;
+
+        XSTL_NODISCARD reference operator*() const noexcept {
+            XSTL_EXPECT(_node, "cannot dereference end concurrent iterator");
+            return _node->_value;
+        }
+        XSTL_NODISCARD pointer operator->() const noexcept { return std::addressof(**this); }
+
+        _Skip_citer& operator++() noexcept {
+            XSTL_EXPECT(_node, "cannot increment end concurrent iterator");
+            _node = _Skip_live(_Node::ptr(_node->next(0).load(std::memory_order_acquire)));
+            if (!_node)
+                _pin = _Epoch_domain::guard();
+            return *this;
+        }
+        _Skip_citer operator++(int) noexcept {
+            _Skip_citer _tmp = *this;
+            ++*this;
+            return _tmp;
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Skip_citer& lhs, const _Skip_citer& rhs) noexcept {
+            return lhs._node == rhs._node;
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Skip_citer& lhs, const _Skip_citer& rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+    private:
+        _Skip_citer(_Epoch_domain::guard&& pin, _Nodeptr node) noexcept
+            : _pin(node ? std::move(pin) : _Epoch_domain::guard()), _node(node) {}
+
+        static _Nodeptr _Skip_live(_Nodeptr node) noexcept {
+            while (node && node->removed())
+                node = _Node::ptr(node->next(0).load(std::memory_order_acquire));
+            return node;
+        }
+
+        _Epoch_domain::guard _pin;
+        _Nodeptr             _node = nullptr;
+    };
+
+    /**
+     *	@class _Skip_list
+     *   @brief a lock-free ordered set/map. find, lower_bound, upper_bound, contains, emplace, insert and erase can be
+     *	called concurrently by any number of threads, while clear() and destructor must be called exclusively.
+     *	size() is exact only when there are no concurrent modifications. Elements are immutable once inserted, and the
+     *	allocator must be thread safe.
+     */
+    template <class _Cate, class _Alloc>
+    class _Skip_list {
+    public:
+        using key_type        = typename _Cate::key_type;
+        using value_type      = typename _Cate::value_type;
+        using key_compare     = typename _Cate::key_compare;
+        using value_compare   = typename _Cate::value_compare;
+        using allocator_type  = _Alloc;
+        using size_type       = typename std::allocator_traits<_Alloc>::size_type;
+        using difference_type = typename std::allocator_traits<_Alloc>::difference_type;
+        using reference       = const value_type&;
+        using const_reference = const value_type&;
+
+    private:
+        using _Node          = _Skip_node<value_type>;
+        using _Nodeptr       = _Node*;
+        using _Alnode_type   = typename std::allocator_traits<_Alloc>::template rebind_alloc<_Node>;
+        using _Alnode_traits = std::allocator_traits<_Alnode_type>;
+        using _Guard         = _Epoch_domain::guard;
+
+        static_assert(std::is_same_v<typename _Alloc::value_type, value_type>,
+                      MISMATCH_ALLOCATOR_MESSAGE("concurrent_map/set", "value_type"));
+
+    public:
+        using const_iterator = _Skip_citer<_Node, value_type>;
+        using iterator       = const_iterator;
+
+        static constexpr int max_height = 32;
+
+        /**
+         *	@brief constructs an empty concurrent skip list.
+         *	@param cmpr : comparison function object to use for all comparisons of keys
+         *   @param alloc : allocator to use for all memory allocations of this skip list
+         */
+        _Skip_list() : _tpl(std::ignore, std::ignore, nullptr) { _Init_head(); }
+
+        explicit _Skip_list(const key_compare& cmpr) : _tpl(cmpr, std::ignore, nullptr) { _Init_head(); }
+
+        _Skip_list(const key_compare& cmpr, const allocator_type& alloc) : _tpl(cmpr, alloc, nullptr) { _Init_head(); }
+
+        template <class _Iter>
+        _Skip_list(_Iter first, _Iter last, const key_compare& cmpr = key_compare(),
+                   const allocator_type& alloc = allocator_type())
+            : _Skip_list(cmpr, alloc) {
+            insert(first, last);
+        }
+
+        _Skip_list(std::initializer_list<value_type> ilist, const key_compare& cmpr = key_compare(),
+                   const allocator_type& alloc = allocator_type())
+            : _Skip_list(ilist.begin(), ilist.end(), cmpr, alloc) {}
+
+        /**
+         *	@brief copies the elements visible by a traversal of other, which may be modified concurrently.
+         */
+        _Skip_list(const _Skip_list& other)
+            : _Skip_list(other._Get_cmpr(), _Alnode_traits::select_on_container_copy_construction(other._Getal())) {
+            insert(other.begin(), other.end());
+        }
+
+        _Skip_list& operator=(const _Skip_list&) = delete;
+
+        ~_Skip_list() {
+            clear();
+            _Node::free_node(_Getal(), _Get_head());
+        }
+
+        XSTL_NODISCARD const_iterator begin() const {
+            _Guard _pin(_domain);
+            return const_iterator(std::move(_pin), const_iterator::_Skip_live(_First()));
+        }
+        XSTL_NODISCARD const_iterator end() const noexcept { return const_iterator(); }
+        XSTL_NODISCARD const_iterator cbegin() const { return begin(); }
+        XSTL_NODISCARD const_iterator cend() const noexcept { return end(); }
+
+        XSTL_NODISCARD size_type size() const noexcept { return _size.load(std::memory_order_relaxed); }
+        XSTL_NODISCARD bool      empty() const { return begin() == end(); }
+        XSTL_NODISCARD size_type max_size() const noexcept {
+            return std::min<size_type>((std::numeric_limits<difference_type>::max)(), _Alnode_traits::max_size(_Getal()));
+        }
+
+        /**
+         *	@return an iterator pointing to the first element that is not less than key
+         */
+        XSTL_NODISCARD const_iterator lower_bound(const key_type& key) const {
+            _Guard _pin(_domain);
+            return const_iterator(std::move(_pin), const_iterator::_Skip_live(_Bound<false>(key)));
+        }
+
+        /**
+         *	@return an iterator pointing to the first element that is greater than key
+         */
+        XSTL_NODISCARD const_iterator upper_bound(const key_type& key) const {
+            _Guard _pin(_domain);
+            return const_iterator(std::move(_pin), const_iterator::_Skip_live(_Bound<true>(key)));
+        }
+
+        XSTL_NODISCARD const_iterator find(const key_type& key) const {
+            _Guard         _pin(_domain);
+            const _Nodeptr _node = const_iterator::_Skip_live(_Bound<false>(key));
+            return const_iterator(std::move(_pin), _node && !_Get_cmpr()(key, _Cate::kfn(_node->_value)) ? _node : nullptr);
+        }
+
+        XSTL_NODISCARD bool contains(const key_type& key) const {
+            _Guard         _pin(_domain);
+            const _Nodeptr _node = const_iterator::_Skip_live(_Bound<false>(key));
+            return _node && !_Get_cmpr()(key, _Cate::kfn(_node->_value));
+        }
+
+        XSTL_NODISCARD size_type count(const key_type& key) const { return contains(key); }
+
+        /**
+         *	@brief inserts a new element constructed from args if there is no element with the same key.
+         *	@return a pair of an iterator to the element with the key, and a bool which is true if insertion took place
+         */
+        template <class... _Args>
+        std::pair<iterator, bool> emplace(_Args&&... args) {
+            _Guard _pin(_domain);
+            _domain.reserve_retire(_pin);
+            const _Nodeptr _node = _Node::create_node(_Getal(), _Random_height());
+            try {
+                _Alnode_traits::construct(_Getal(), std::addressof(_node->_value), std::forward<_Args>(args)...);
+            } catch (...) {
+                _Node::free_node(_Getal(), _node);
+                throw;
+            }
+            const _Nodeptr _pos = _Insert(_node);
+            if (_pos != _node) {  // the node has never been published
+                _Alnode_traits::destroy(_Getal(), std::addressof(_node->_value));
+                _Node::free_node(_Getal(), _node);
+                return { iterator(std::move(_pin), _pos), false };
+            }
+            _Link_upper(_pin, _node);
+            return { iterator(std::move(_pin), _node), true };
+        }
+
+        std::pair<iterator, bool> insert(const value_type& value) { return emplace(value); }
+        std::pair<iterator, bool> insert(value_type&& value) { return emplace(std::move(value)); }
+
+        template <class _Iter>
+        void insert(_Iter first, _Iter last) {
+            for (; first != last; ++first)
+                emplace(*first);
+        }
+
+        void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        /**
+         *	@brief removes the element with key. If several threads erase the same element, only one of them succeeds.
+         *	@return the number of elements removed
+         */
+        size_type erase(const key_type& key) {
+            _Guard _pin(_domain);
+            _domain.reserve_retire(_pin);
+            _Nodeptr _preds[max_height], _succs[max_height];
+            if (!_Find(key, _preds, _succs))
+                return 0;
+            const _Nodeptr _node = _succs[0];
+            for (int _level = _node->_height - 1; _level > 0; --_level) {  // marks upper levels from top to bottom
+                std::uintptr_t _link = _node->next(_level).load(std::memory_order_acquire);
+                while (!_Node::marked(_link)
+                       && !_node->next(_level).compare_exchange_weak(_link, _link | 1, std::memory_order_acq_rel))
+                    ;
+            }
+            std::uintptr_t _link = _node->next(0).load(std::memory_order_acquire);
+            do {  // the thread marking level 0 removes the element
+                if (_Node::marked(_link))
+                    return 0;
+            } while (!_node->next(0).compare_exchange_weak(_link, _link | 1, std::memory_order_acq_rel));
+            _size.fetch_sub(1, std::memory_order_relaxed);
+            _Find(key, _preds, _succs);  // unlinks the node from every level
+            _Release(_pin, _node);
+            return 1;
+        }
+
+        /**
+         *	@brief destroys all elements. It must not be called concurrently with any other operation.
+         */
+        void clear() noexcept {
+            for (_Nodeptr _node = _First(); _node;) {
+                const _Nodeptr _next = _Node::ptr(_node->next(0).load(std::memory_order_relaxed));
+                _Free(_node);
+                _node = _next;
+            }
+            _domain.drain([this](void* ptr) { _Free(static_cast<_Nodeptr>(ptr)); });
+            for (int i = 0; i < max_height; ++i)
+                _Get_head()->next(i).store(0, std::memory_order_relaxed);
+            _size.store(0, std::memory_order_relaxed);
+        }
+
+        XSTL_NODISCARD key_compare    key_comp() const { return _Get_cmpr(); }
+        XSTL_NODISCARD allocator_type get_allocator() const noexcept { return static_cast<allocator_type>(_Getal()); }
+
+    private:
+        void _Init_head() { _Get_head() = _Node::create_node(_Getal(), max_height); }
+
+        /**
+         *	@brief draws a height from geometric distribution with p = 1/2.
+         */
+        static int _Random_height() noexcept {
+            thread_local std::uint64_t _seed =
+                (reinterpret_cast<std::uintptr_t>(&_seed) ^ std::hash<std::thread::id>()(std::this_thread::get_id()))
+                    * 0x9E3779B97F4A7C15ull
+                | 1;
+            _seed ^= _seed << 13;
+            _seed ^= _seed >> 7;
+            _seed ^= _seed << 17;
+            int _height = 1;
+            for (std::uint64_t _bits = _seed; (_bits & 1) && _height < max_height; _bits >>= 1)
+                ++_height;
+            return _height;
+        }
+
+        _Nodeptr _First() const noexcept { return _Node::ptr(_Get_head()->next(0).load(std::memory_order_acquire)); }
+
+        /**
+         *	@brief searches without helping writers. Removed nodes may be returned and are skipped by caller.
+         *	@return the first node whose key is not less than (_Upper = false) or greater than (_Upper = true) key
+         */
+        template <bool _Upper>
+        _Nodeptr _Bound(const key_type& key) const {
+            _Nodeptr _pred = _Get_head(), _curr = nullptr;
+            for (int _level = _level_hint.load(std::memory_order_relaxed) - 1; _level >= 0; --_level) {
+                for (_curr = _Node::ptr(_pred->next(_level).load(std::memory_order_acquire)); _curr;
+                     _curr = _Node::ptr(_curr->next(_level).load(std::memory_order_acquire))) {
+                    if (_Upper ? _Get_cmpr()(key, _Cate::kfn(_curr->_value)) : !_Get_cmpr()(_Cate::kfn(_curr->_value), key))
+                        break;
+                    _pred = _curr;
+                }
+            }
+            return _curr;
+        }
+
+        /**
+         *	@brief finds the predecessors and successors of key at every level, and unlinks the removed nodes on the way.
+         *	@return true if succs[0] is an element with key
+         */
+        bool _Find(const key_type& key, _Nodeptr* preds, _Nodeptr* succs) {
+            const int _top = _level_hint.load(std::memory_order_acquire);
+            for (int _level = _top; _level < max_height; ++_level)
+                preds[_level] = _Get_head(), succs[_level] = nullptr;
+        retry:
+            _Nodeptr _pred = _Get_head();
+            for (int _level = _top - 1; _level >= 0; --_level) {
+                _Nodeptr _curr = _Node::ptr(_pred->next(_level).load(std::memory_order_acquire));
+                while (_curr) {
+                    std::uintptr_t _succ = _curr->next(_level).load(std::memory_order_acquire);
+                    if (_Node::marked(_succ)) {  // _curr has been removed from this level
+                        std::uintptr_t _expected = _Node::link(_curr);
+                        if (!_pred->next(_level).compare_exchange_strong(_expected, _succ & ~std::uintptr_t{ 1 },
+                                                                         std::memory_order_acq_rel))
+                            goto retry;
+                        _curr = _Node::ptr(_succ);
+                    } else if (_Get_cmpr()(_Cate::kfn(_curr->_value), key)) {
+                        _pred = _curr;
+                        _curr = _Node::ptr(_succ);
+                    } else
+                        break;
+                }
+                preds[_level] = _pred;
+                succs[_level] = _curr;
+            }
+            return succs[0] && !_Get_cmpr()(key, _Cate::kfn(succs[0]->_value));
+        }
+
+        /**
+         *	@brief links node into level 0, which publishes it.
+         *	@return node if it has been inserted, otherwise the existing element with the same key
+         */
+        _Nodeptr _Insert(_Nodeptr node) {
+            for (int _top = _level_hint.load(std::memory_order_relaxed); _top < node->_height
+                 && !_level_hint.compare_exchange_weak(_top, node->_height, std::memory_order_acq_rel);)
+                ;
+            const key_type& _key = _Cate::kfn(node->_value);
+            _Nodeptr        _preds[max_height], _succs[max_height];
+            while (true) {
+                if (_Find(_key, _preds, _succs))
+                    return _succs[0];
+                for (int i = 0; i < node->_height; ++i)
+                    node->next(i).store(_Node::link(_succs[i]), std::memory_order_relaxed);
+                std::uintptr_t _expected = _Node::link(_succs[0]);
+                if (_preds[0]->next(0).compare_exchange_strong(_expected, _Node::link(node), std::memory_order_acq_rel)) {
+                    _size.fetch_add(1, std::memory_order_relaxed);
+                    return node;
+                }
+            }
+        }
+
+        /**
+         *	@brief links a published node into its upper levels. It gives up once the node is removed, and makes sure that a
+         *	removed node is unlinked before dropping the inserting owner.
+         */
+        void _Link_upper(const _Guard& pin, _Nodeptr node) {
+            const key_type& _key = _Cate::kfn(node->_value);
+            _Nodeptr        _preds[max_height], _succs[max_height];
+            bool            _linked = _Find(_key, _preds, _succs) && _succs[0] == node;
+            for (int _level = 1; _level < node->_height; ++_level) {
+                while (true) {
+                    if (!_linked)  // node has been removed and unlinked from level 0
+                        goto done;
+                    const std::uintptr_t _succ = _Node::link(_succs[_level]);
+                    std::uintptr_t       _link = node->next(_level).load(std::memory_order_acquire);
+                    if (_Node::marked(_link)
+                        || _link != _succ && !node->next(_level).compare_exchange_strong(_link, _succ, std::memory_order_acq_rel))
+                        goto done;  // marked by an eraser
+                    std::uintptr_t _expected = _succ;
+                    if (_preds[_level]->next(_level).compare_exchange_strong(_expected, _Node::link(node),
+                                                                             std::memory_order_acq_rel))
+                        break;
+                    _linked = _Find(_key, _preds, _succs) && _succs[0] == node;
+                }
+            }
+        done:
+            if (node->removed())
+                _Find(_key, _preds, _succs);
+            _Release(pin, node);
+        }
+
+        /**
+         *	@brief drops an owner of a node. The last owner retires it.
+         */
+        void _Release(const _Guard& pin, _Nodeptr node) noexcept {
+            if (node->_owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                _domain.retire(pin, node, [this](void* ptr) { _Free(static_cast<_Nodeptr>(ptr)); });
+        }
+
+        void _Free(_Nodeptr node) noexcept {
+            _Alnode_traits::destroy(_Getal(), std::addressof(node->_value));
+            _Node::free_node(_Getal(), node);
+        }
+
+        inline key_compare&        _Get_cmpr() noexcept { return std::get<0>(_tpl); }
+        inline const key_compare&  _Get_cmpr() const noexcept { return std::get<0>(_tpl); }
+        inline _Alnode_type&       _Getal() noexcept { return std::get<1>(_tpl); }
+        inline const _Alnode_type& _Getal() const noexcept { return std::get<1>(_tpl); }
+        inline _Nodeptr&           _Get_head() noexcept { return std::get<2>(_tpl); }
+        inline _Nodeptr            _Get_head() const noexcept { return std::get<2>(_tpl); }
+
+        compressed_tuple<key_compare, _Alnode_type, _Nodeptr> _tpl;
+        std::atomic<size_type>                                _size{ 0 };
+        std::atomic<int>                                      _level_hint{ 1 };
+        mutable _Epoch_domain                                 _domain;
+    };
+
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp)>
+    using concurrent_set = _Skip_list<_Set_traits<_Tp, _Compare>, _Alloc>;
+#define MAP_VALUE_TYPE std::pair<const _Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE)>
+    using concurrent_map = _Skip_list<_Map_traits<_Key, _Value, _Compare>, _Alloc>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _CONCURRENT_MAP_HPP_
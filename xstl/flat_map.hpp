@@ -0,0 +1,527 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file flat_map.hpp
+ *   @brief The flat library contains maps/sets which keep their elements sorted in a contiguous sequence container.
+ *   They share the interface of maps/sets in bs_tree.hpp, so a container type can be swapped by one typedef. Lookups are
+ *   branchless binary searches over contiguous memory, which beat node trees for read-mostly tables of a few thousand
+ *   elements, while a single insertion or erasure moves O(n) elements.
+ *	1. flat_set
+ *	2. flat_multiset
+ *	3. flat_map
+ *	4. flat_multimap
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _FLAT_MAP_HPP_
+#define _FLAT_MAP_HPP_
+
+#include "bs_tree.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace xstl {
+    namespace {
+        /**
+         *	@brief traits of flat maps. Different from _Map_traits, key of value_type is not const, since elements are moved
+         *	when the sequence is shifted or merged. Keys must not be modified through iterators.
+         */
+        template <class _Key, class _Value, class _Compare>
+        struct _Flat_map_traits {
+            using key_type    = _Key;
+            using mapped_type = _Value;
+            using value_type  = std::pair<_Key, _Value>;
+            using key_compare = _Compare;
+            struct value_compare {
+                XSTL_NODISCARD bool operator()(const value_type& lhs, const value_type& rhs) const {
+                    return _cmpr(lhs.first, rhs.first);
+                }
+
+                key_compare _cmpr;
+            };
+
+            static const _Key& kfn(const value_type& value) { return value.first; }
+        };
+    }  // namespace
+
+    /**
+     *	@class _Flat_tree
+     *   @brief a set/map stored in a sorted sequence container, which must provide random access iterators, insert and
+     *	erase, e.g. std::vector. Any insertion or erasure invalidates iterators as the underlying container does.
+     */
+    template <class _Cate, bool _Mfl, class _Container>
+    class _Flat_tree {
+    public:
+        using key_type               = typename _Cate::key_type;
+        using value_type             = typename _Cate::value_type;
+        using key_compare            = typename _Cate::key_compare;
+        using value_compare          = typename _Cate::value_compare;
+        using container_type         = _Container;
+        using allocator_type         = typename _Container::allocator_type;
+        using size_type              = typename _Container::size_type;
+        using difference_type        = typename _Container::difference_type;
+        using reference              = value_type&;
+        using const_reference        = const value_type&;
+        using const_iterator         = typename _Container::const_iterator;
+        using iterator               = std::conditional_t<std::is_same_v<key_type, value_type>, const_iterator,
+                                                          typename _Container::iterator>;
+        using reverse_iterator       = std::reverse_iterator<iterator>;
+        using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+        static_assert(std::is_same_v<typename _Container::value_type, value_type>,
+                      MISMATCH_ALLOCATOR_MESSAGE("flat_map/set", "value_type"));
+
+    private:
+        static constexpr bool _Multi = _Mfl;
+
+        using _Insert_result = std::conditional_t<_Multi, iterator, std::pair<iterator, bool>>;
+
+    public:
+        /**
+         *	@brief constructs an empty flat tree.
+         *	@param cmpr : comparison function object to use for all comparisons of keys
+         *   @param alloc : allocator to use for all memory allocations of the underlying container
+         */
+        _Flat_tree() : _tpl(std::ignore, std::ignore) {}
+
+        explicit _Flat_tree(const key_compare& cmpr) : _tpl(cmpr, std::ignore) {}
+
+        explicit _Flat_tree(const allocator_type& alloc) : _tpl(std::ignore, alloc) {}
+
+        _Flat_tree(const key_compare& cmpr, const allocator_type& alloc) : _tpl(cmpr, alloc) {}
+
+        /**
+         *	@brief constructs a flat tree with the contents of the range [first, last). It sorts the range once, which is
+         *	O(n log n) rather than n insertions of O(n).
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Flat_tree(_Iter first, _Iter last) : _tpl(std::ignore, std::ignore) {
+            insert(first, last);
+        }
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Flat_tree(_Iter first, _Iter last, const key_compare& cmpr, const allocator_type& alloc = allocator_type())
+            : _tpl(cmpr, alloc) {
+            insert(first, last);
+        }
+
+        _Flat_tree(std::initializer_list<value_type> ilist) : _Flat_tree(ilist.begin(), ilist.end()) {}
+
+        _Flat_tree(std::initializer_list<value_type> ilist, const key_compare& cmpr,
+                   const allocator_type& alloc = allocator_type())
+            : _Flat_tree(ilist.begin(), ilist.end(), cmpr, alloc) {}
+
+        _Flat_tree& operator=(std::initializer_list<value_type> ilist) {
+            clear();
+            insert(ilist.begin(), ilist.end());
+            return *this;
+        }
+
+        XSTL_NODISCARD iterator               begin() noexcept { return _Get_cont().begin(); }
+        XSTL_NODISCARD const_iterator         begin() const noexcept { return _Get_cont().begin(); }
+        XSTL_NODISCARD iterator               end() noexcept { return _Get_cont().end(); }
+        XSTL_NODISCARD const_iterator         end() const noexcept { return _Get_cont().end(); }
+        XSTL_NODISCARD reverse_iterator       rbegin() noexcept { return reverse_iterator(end()); }
+        XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+        XSTL_NODISCARD reverse_iterator       rend() noexcept { return reverse_iterator(begin()); }
+        XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+        XSTL_NODISCARD const_iterator         cbegin() const noexcept { return begin(); }
+        XSTL_NODISCARD const_iterator         cend() const noexcept { return end(); }
+        XSTL_NODISCARD const_reverse_iterator crbegin() const noexcept { return rbegin(); }
+        XSTL_NODISCARD const_reverse_iterator crend() const noexcept { return rend(); }
+
+        XSTL_NODISCARD size_type size() const noexcept { return _Get_cont().size(); }
+        XSTL_NODISCARD bool      empty() const noexcept { return _Get_cont().empty(); }
+        XSTL_NODISCARD size_type max_size() const noexcept { return _Get_cont().max_size(); }
+        XSTL_NODISCARD size_type capacity() const noexcept { return _Get_cont().capacity(); }
+
+        void reserve(size_type count) { _Get_cont().reserve(count); }
+        void shrink_to_fit() { _Get_cont().shrink_to_fit(); }
+        void clear() noexcept { _Get_cont().clear(); }
+
+        /**
+         *	@brief inserts value. Unique trees do nothing if there is an element with equivalent key, multi trees insert
+         *	value after all elements with equivalent key.
+         *	@return an iterator to the inserted element for multi trees, or a pair consisting of an iterator to the inserted
+         *	element (or to the element that prevented the insertion) and a bool denoting whether the insertion took place
+         */
+        _Insert_result insert(const value_type& value) { return _Insert(value); }
+        _Insert_result insert(value_type&& value) { return _Insert(std::move(value)); }
+
+        /**
+         *	@brief inserts value as close as possible to the position just prior to hint. The search is skipped if value
+         *	belongs to hint, so inserting sorted elements at end() costs no comparison besides the check.
+         */
+        iterator insert(const_iterator hint, const value_type& value) { return _Insert_hint(hint, value); }
+        iterator insert(const_iterator hint, value_type&& value) { return _Insert_hint(hint, std::move(value)); }
+
+        /**
+         *	@brief inserts elements of range [first, last). The range is appended, sorted, then merged with the old elements,
+         *	which costs O(n + k log k) instead of k insertions of O(n). Among elements with equivalent key, the old ones and
+         *	then the earlier ones of the range are kept by unique trees, or ordered first by multi trees.
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert(_Iter first, _Iter last) {
+            const size_type _old_size = size();
+            _Get_cont().insert(_Get_cont().end(), first, last);
+            std::stable_sort(_Get_cont().begin() + _old_size, _Get_cont().end(), value_comp());
+            _Merge_tail(_old_size);
+        }
+
+        void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        /**
+         *	@brief inserts elements of range [first, last), which must be sorted by key. It merges the range in O(n + k).
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert_sorted(_Iter first, _Iter last) {
+            const size_type _old_size = size();
+            _Get_cont().insert(_Get_cont().end(), first, last);
+            XSTL_EXPECT(std::is_sorted(_Get_cont().begin() + _old_size, _Get_cont().end(), value_comp()),
+                        "flat_map/set insert_sorted requires a sorted range");
+            _Merge_tail(_old_size);
+        }
+
+        /**
+         *	@brief constructs an element in place, then inserts it as insert.
+         */
+        template <class... _Args>
+        _Insert_result emplace(_Args&&... args) {
+            return _Insert(value_type(std::forward<_Args>(args)...));
+        }
+
+        template <class... _Args>
+        iterator emplace_hint(const_iterator hint, _Args&&... args) {
+            return _Insert_hint(hint, value_type(std::forward<_Args>(args)...));
+        }
+
+        /**
+         *	@brief if a key equivalent to key already exists, does nothing. Otherwise, inserts an element constructed by
+         *	key and mapped_value in place.
+         *	@return a pair consisting of an iterator to the element with key and a bool denoting whether the insertion
+         *	took place
+         */
+        template <class... _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        std::pair<iterator, bool> try_emplace(const key_type& key, _Mapped&&... mapped_value) {
+            return _Try_emplace(key, std::forward<_Mapped>(mapped_value)...);
+        }
+        template <class... _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        std::pair<iterator, bool> try_emplace(key_type&& key, _Mapped&&... mapped_value) {
+            return _Try_emplace(std::move(key), std::forward<_Mapped>(mapped_value)...);
+        }
+
+        /**
+         *	@brief same as try_emplace without hint. A hint could only save the binary search, while an insertion moves
+         *	O(n) elements anyway.
+         */
+        template <class... _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        iterator try_emplace(const_iterator, const key_type& key, _Mapped&&... mapped_value) {
+            return _Try_emplace(key, std::forward<_Mapped>(mapped_value)...).first;
+        }
+        template <class... _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        iterator try_emplace(const_iterator, key_type&& key, _Mapped&&... mapped_value) {
+            return _Try_emplace(std::move(key), std::forward<_Mapped>(mapped_value)...).first;
+        }
+
+        /**
+         *	@brief if a key equivalent to key already exists, assigns mapped_value to its mapped value. Otherwise, inserts
+         *	value_type(key, mapped_value).
+         *	@return a pair consisting of an iterator to the element with key and a bool denoting whether the insertion
+         *	took place
+         */
+        template <class _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        std::pair<iterator, bool> insert_or_assign(const key_type& key, _Mapped&& mapped_value) {
+            return _Insert_or_assign(key, std::forward<_Mapped>(mapped_value));
+        }
+        template <class _Mapped, XSTL_REQUIRES_(!_Mfl && !std::is_same_v<key_type, value_type>)>
+        std::pair<iterator, bool> insert_or_assign(key_type&& key, _Mapped&& mapped_value) {
+            return _Insert_or_assign(std::move(key), std::forward<_Mapped>(mapped_value));
+        }
+
+        /**
+         *	@brief returns a reference to the mapped value of the element with key equivalent to key.
+         */
+        XSTL_REQUIRES(!_Mfl && !std::is_same_v<key_type, value_type>)
+        XSTL_NODISCARD auto& at(const key_type& key) {
+            const const_iterator _where = find(key);
+            if (_where == end())
+                throw std::out_of_range("invalid flat_map<K, T> key");
+            return _Unconst(_where)->second;
+        }
+
+        XSTL_REQUIRES(!_Mfl && !std::is_same_v<key_type, value_type>)
+        XSTL_NODISCARD const auto& at(const key_type& key) const {
+            const const_iterator _where = find(key);
+            if (_where == end())
+                throw std::out_of_range("invalid flat_map<K, T> key");
+            return _where->second;
+        }
+
+        XSTL_REQUIRES(!_Mfl && !std::is_same_v<key_type, value_type>)
+        auto& operator[](const key_type& key) { return _Try_emplace(key).first->second; }
+
+        XSTL_REQUIRES(!_Mfl && !std::is_same_v<key_type, value_type>)
+        auto& operator[](key_type&& key) { return _Try_emplace(std::move(key)).first->second; }
+
+        /**
+         *	@brief removes the element at where.
+         *	@return iterator following the removed element
+         */
+        iterator erase(const_iterator where) { return _Get_cont().erase(where); }
+
+        iterator erase(const_iterator first, const_iterator last) { return _Get_cont().erase(first, last); }
+
+        /**
+         *	@brief removes all elements with key equivalent to key.
+         *	@return the number of elements removed
+         */
+        size_type erase(const key_type& key) {
+            const auto [_first, _last] = equal_range(key);
+            const size_type _count     = static_cast<size_type>(_last - _first);
+            _Get_cont().erase(_first, _last);
+            return _count;
+        }
+
+        void swap(_Flat_tree& other) noexcept(std::is_nothrow_swappable_v<_Container>
+                                              && std::is_nothrow_swappable_v<key_compare>) {
+            using std::swap;
+            swap(_tpl, other._tpl);
+        }
+
+        /**
+         *   @brief return an iterator pointing to the first element that is not less than key.
+         */
+        XSTL_NODISCARD iterator       lower_bound(const key_type& key) { return _Unconst(_Lower_bound(key)); }
+        XSTL_NODISCARD const_iterator lower_bound(const key_type& key) const { return _Lower_bound(key); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD iterator lower_bound(const _Key& key) {
+            return _Unconst(_Lower_bound(key));
+        }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator lower_bound(const _Key& key) const {
+            return _Lower_bound(key);
+        }
+
+        /**
+         *   @brief return an iterator pointing to the first element that is greater than key.
+         */
+        XSTL_NODISCARD iterator       upper_bound(const key_type& key) { return _Unconst(_Upper_bound(key)); }
+        XSTL_NODISCARD const_iterator upper_bound(const key_type& key) const { return _Upper_bound(key); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD iterator upper_bound(const _Key& key) {
+            return _Unconst(_Upper_bound(key));
+        }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator upper_bound(const _Key& key) const {
+            return _Upper_bound(key);
+        }
+
+        /**
+         *   @brief returns a range containing all elements with the given key.
+         */
+        XSTL_NODISCARD std::pair<iterator, iterator> equal_range(const key_type& key) { return _Unconst(_Equal_range(key)); }
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const {
+            return _Equal_range(key);
+        }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD std::pair<iterator, iterator> equal_range(const _Key& key) {
+            return _Unconst(_Equal_range(key));
+        }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const _Key& key) const {
+            return _Equal_range(key);
+        }
+
+        /**
+         *   @brief finds an element with key equivalent to key.
+         *	@return iterator to the first such element, or end() if no such element is found.
+         */
+        XSTL_NODISCARD iterator       find(const key_type& key) { return _Unconst(_Find(key)); }
+        XSTL_NODISCARD const_iterator find(const key_type& key) const { return _Find(key); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD iterator find(const _Key& key) {
+            return _Unconst(_Find(key));
+        }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD const_iterator find(const _Key& key) const {
+            return _Find(key);
+        }
+
+        XSTL_NODISCARD size_type count(const key_type& key) const { return _Count(key); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD size_type count(const _Key& key) const {
+            return _Count(key);
+        }
+
+        XSTL_NODISCARD bool contains(const key_type& key) const { return _Find(key) != end(); }
+        template <class _Key, class _Cmpr = key_compare, class = typename _Cmpr::is_transparent>
+        XSTL_NODISCARD bool contains(const _Key& key) const {
+            return _Find(key) != end();
+        }
+
+        XSTL_NODISCARD key_compare    key_comp() const { return _Get_cmpr(); }
+        XSTL_NODISCARD value_compare  value_comp() const { return value_compare{ _Get_cmpr() }; }
+        XSTL_NODISCARD allocator_type get_allocator() const noexcept { return _Get_cont().get_allocator(); }
+
+        XSTL_NODISCARD friend bool operator==(const _Flat_tree& lhs, const _Flat_tree& rhs) {
+            return lhs._Get_cont() == rhs._Get_cont();
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Flat_tree& lhs, const _Flat_tree& rhs) { return !(lhs == rhs); }
+
+    private:
+        iterator _Unconst(const_iterator where) noexcept {
+            return _Get_cont().begin() + (where - _Get_cont().cbegin());
+        }
+
+        std::pair<iterator, iterator> _Unconst(std::pair<const_iterator, const_iterator> range) noexcept {
+            return { _Unconst(range.first), _Unconst(range.second) };
+        }
+
+        /**
+         *	@brief branchless binary search. Each step halves the range by a conditional move instead of a branch, so its
+         *	cost does not depend on how predictable the comparisons are.
+         *	@return the first element whose key satisfies !pred(key), where pred must partition the sequence
+         */
+        template <class _Pred>
+        const_iterator _Partition_point(_Pred pred) const {
+            const_iterator _base = _Get_cont().cbegin();
+            size_type      _len  = _Get_cont().size();
+            if (_len == 0)
+                return _base;
+            while (_len > 1) {
+                const size_type _half = _len / 2;
+                _base += pred(_Cate::kfn(_base[_half])) ? _half : 0;
+                _len -= _half;
+            }
+            return _base + pred(_Cate::kfn(*_base));
+        }
+
+        template <class _Key>
+        const_iterator _Lower_bound(const _Key& key) const {
+            return _Partition_point([&](const auto& curr) { return _Get_cmpr()(curr, key); });
+        }
+
+        template <class _Key>
+        const_iterator _Upper_bound(const _Key& key) const {
+            return _Partition_point([&](const auto& curr) { return !_Get_cmpr()(key, curr); });
+        }
+
+        template <class _Key>
+        std::pair<const_iterator, const_iterator> _Equal_range(const _Key& key) const {
+            const const_iterator _first = _Lower_bound(key);
+            if constexpr (_Multi)
+                return { _first, _Upper_bound(key) };
+            else
+                return { _first, _first == end() || _Get_cmpr()(key, _Cate::kfn(*_first)) ? _first : _first + 1 };
+        }
+
+        template <class _Key>
+        const_iterator _Find(const _Key& key) const {
+            const const_iterator _where = _Lower_bound(key);
+            return _where == end() || _Get_cmpr()(key, _Cate::kfn(*_where)) ? end() : _where;
+        }
+
+        template <class _Key>
+        size_type _Count(const _Key& key) const {
+            const auto _range = _Equal_range(key);
+            return static_cast<size_type>(_range.second - _range.first);
+        }
+
+        template <class _Value>
+        _Insert_result _Insert(_Value&& value) {
+            const key_type& _key = _Cate::kfn(value);
+            if constexpr (_Multi)
+                return _Get_cont().insert(_Upper_bound(_key), std::forward<_Value>(value));
+            else {
+                const const_iterator _where = _Lower_bound(_key);
+                if (_where != end() && !_Get_cmpr()(_key, _Cate::kfn(*_where)))
+                    return { _Unconst(_where), false };
+                return { _Get_cont().insert(_where, std::forward<_Value>(value)), true };
+            }
+        }
+
+        template <class _Value>
+        iterator _Insert_hint(const_iterator hint, _Value&& value) {
+            const key_type& _key = _Cate::kfn(value);
+            bool            _fits;
+            if constexpr (_Multi)  // prev.key <= key <= hint.key
+                _fits = (hint == begin() || !_Get_cmpr()(_key, _Cate::kfn(*(hint - 1))))
+                     && (hint == end() || !_Get_cmpr()(_Cate::kfn(*hint), _key));
+            else  // prev.key < key < hint.key
+                _fits = (hint == begin() || _Get_cmpr()(_Cate::kfn(*(hint - 1)), _key))
+                     && (hint == end() || _Get_cmpr()(_key, _Cate::kfn(*hint)));
+            if (_fits)
+                return _Get_cont().insert(hint, std::forward<_Value>(value));
+            if constexpr (_Multi)
+                return _Insert(std::forward<_Value>(value));
+            else
+                return _Insert(std::forward<_Value>(value)).first;
+        }
+
+        template <class _Key, class... _Mapped>
+        std::pair<iterator, bool> _Try_emplace(_Key&& key, _Mapped&&... mapped_value) {
+            const const_iterator _where = _Lower_bound(key);
+            if (_where != end() && !_Get_cmpr()(key, _Cate::kfn(*_where)))
+                return { _Unconst(_where), false };
+            return { _Get_cont().emplace(_where, std::piecewise_construct, std::forward_as_tuple(std::forward<_Key>(key)),
+                                         std::forward_as_tuple(std::forward<_Mapped>(mapped_value)...)),
+                     true };
+        }
+
+        template <class _Key, class _Mapped>
+        std::pair<iterator, bool> _Insert_or_assign(_Key&& key, _Mapped&& mapped_value) {
+            const const_iterator _where = _Lower_bound(key);
+            if (_where != end() && !_Get_cmpr()(key, _Cate::kfn(*_where))) {
+                const iterator _iter = _Unconst(_where);
+                _iter->second        = std::forward<_Mapped>(mapped_value);
+                return { _iter, false };
+            }
+            return { _Get_cont().emplace(_where, std::forward<_Key>(key), std::forward<_Mapped>(mapped_value)), true };
+        }
+
+        /**
+         *	@brief merges the sorted tail [old_size, size()) into the sorted head, then drops duplicated keys from unique
+         *	trees. The merge is skipped if the tail already follows the head.
+         */
+        void _Merge_tail(size_type old_size) {
+            _Container&    _cont  = _Get_cont();
+            const auto     _mid   = _cont.begin() + old_size;
+            value_compare  _vcmpr = value_comp();
+            if (_mid != _cont.begin() && _mid != _cont.end() && _vcmpr(*_mid, *(_mid - 1)))
+                std::inplace_merge(_cont.begin(), _mid, _cont.end(), _vcmpr);
+            if constexpr (!_Multi)
+                _cont.erase(std::unique(_cont.begin(), _cont.end(),
+                                        [&](const value_type& lhs, const value_type& rhs) { return !_vcmpr(lhs, rhs); }),
+                            _cont.end());
+        }
+
+        inline key_compare&       _Get_cmpr() noexcept { return std::get<0>(_tpl); }
+        inline const key_compare& _Get_cmpr() const noexcept { return std::get<0>(_tpl); }
+        inline _Container&        _Get_cont() noexcept { return std::get<1>(_tpl); }
+        inline const _Container&  _Get_cont() const noexcept { return std::get<1>(_tpl); }
+
+        compressed_tuple<key_compare, _Container> _tpl;
+    };
+
+    template <class _Cate, bool _Mfl, class _Container>
+    void swap(_Flat_tree<_Cate, _Mfl, _Container>& lhs, _Flat_tree<_Cate, _Mfl, _Container>& rhs) noexcept(
+        noexcept(lhs.swap(rhs))) {
+        lhs.swap(rhs);
+    }
+
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp),
+              class _Container = std::vector<_Tp, _Alloc>>
+    using flat_set = _Flat_tree<_Set_traits<_Tp, _Compare>, false, _Container>;
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp),
+              class _Container = std::vector<_Tp, _Alloc>>
+    using flat_multiset = _Flat_tree<_Set_traits<_Tp, _Compare>, true, _Container>;
+#define MAP_VALUE_TYPE std::pair<_Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),
+              class _Container = std::vector<MAP_VALUE_TYPE, _Alloc>>
+    using flat_map = _Flat_tree<_Flat_map_traits<_Key, _Value, _Compare>, false, _Container>;
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),
+              class _Container = std::vector<MAP_VALUE_TYPE, _Alloc>>
+    using flat_multimap = _Flat_tree<_Flat_map_traits<_Key, _Value, _Compare>, true, _Container>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _FLAT_MAP_HPP_
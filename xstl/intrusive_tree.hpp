@@ -0,0 +1,342 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file intrusive_tree.hpp
+ *   @brief The intrusive library contains ordered sets which link objects owned by users instead of copies of them. An
+ *   object embeds a tree_hook, which holds the links and balance data of a tree node, so insertion allocates nothing and
+ *   a lookup reaches the object without a pointer hop. All trees of bs_tree.hpp are supported by the same balancing code.
+ *	1. [bs|avl|treap|splay|rb|scapegoat|wb]_intrusive_set
+ *	2. [bs|avl|treap|splay|rb|scapegoat|wb]_intrusive_multiset
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _INTRUSIVE_TREE_HPP_
+#define _INTRUSIVE_TREE_HPP_
+
+#include "bs_tree.hpp"
+
+namespace xstl {
+    /**
+     *	@class tree_hook
+     *   @brief the links of an object in an intrusive tree. _Tp must derive from it publicly, and an object can be linked
+     *	into one tree by each of its hooks, which are told apart by _Tag. Copying an object does not copy its links, and
+     *	an object must be unlinked before it is destroyed.
+     */
+    template <class _Tp, class _Tag = void>
+    struct tree_hook : _Tree_node_ops<tree_hook<_Tp, _Tag>> {
+        using _Node    = tree_hook<_Tp, _Tag>;
+        using _Nodeptr = _Node*;
+
+        tree_hook() noexcept = default;
+        tree_hook(const tree_hook&) noexcept {}
+        tree_hook& operator=(const tree_hook&) noexcept { return *this; }
+
+        /**
+         *	@return true if the object is linked into a tree by this hook
+         */
+        XSTL_NODISCARD bool is_linked() const noexcept { return _parent != nullptr; }
+
+        inline static _Tp& value_of(_Nodeptr node) noexcept { return static_cast<_Tp&>(*node); }
+
+        inline static void assign_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr,
+                                       bool is_nil) {
+            node->_left   = left;
+            node->_right  = right;
+            node->_parent = parent;
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        inline static void init_node(_Nodeptr node, _Nodeptr left, _Nodeptr right, _Nodeptr parent, const int attr, bool is_nil) {
+            construct_in_place(node->_left, left);
+            construct_in_place(node->_right, right);
+            construct_in_place(node->_parent, parent);
+            node->_prop   = attr;
+            node->_is_nil = is_nil;
+        }
+
+        /**
+         *   @brief called when the tree erases the object or is cleared. The object is owned by user, so it is only
+         *   marked unlinked.
+         */
+        template <class _Alnode>
+        inline static void destroy_node(_Alnode&, _Nodeptr node) noexcept {
+            assign_node(node, nullptr, nullptr, nullptr, RED, false);
+        }
+
+        template <class _Alnode>
+        inline static void destroy_nodes(_Alnode& alloc, const _Nodeptr* nodes, size_t count) noexcept {
+            for (size_t _i = 0; _i != count; ++_i)
+                destroy_node(alloc, nodes[_i]);
+        }
+
+        int _prop = RED;  // an unlinked hook is a fresh node, see extract_node
+
+        bool     _is_nil = false;
+        _Nodeptr _left{ nullptr };
+        _Nodeptr _right{ nullptr };
+        _Nodeptr _parent{ nullptr };
+    };
+
+    namespace {
+        template <class _Tag>
+        struct _Intrusive_node_policy : _Tree_node_policy {
+            template <class _Tp>
+            using node = tree_hook<_Tp, _Tag>;
+        };
+
+        /**
+         *	@brief the category of intrusive trees, whose keys are taken from elements by _KeyOfValue.
+         */
+        template <class _Tp, class _KeyOfValue, class _Compare>
+        struct _Intrusive_traits {
+            static_assert(std::is_reference_v<std::invoke_result_t<_KeyOfValue, const _Tp&>>,
+                          "key of value must return a reference to the key held by element");
+
+            using key_type    = std::remove_cvref_t<std::invoke_result_t<_KeyOfValue, const _Tp&>>;
+            using value_type  = _Tp;
+            using key_compare = _Compare;
+            struct value_compare {
+                XSTL_NODISCARD bool operator()(const value_type& lhs, const value_type& rhs) const {
+                    return _cmpr(kfn(lhs), kfn(rhs));
+                }
+
+                key_compare _cmpr;
+            };
+
+            template <class _Derived>
+            struct node_handle_base {};
+
+            template <class... _Args>
+            struct in_place_key_extract {
+                static constexpr bool extractable = false;
+            };
+
+            static const key_type& kfn(const _Tp& value) { return _KeyOfValue{}(value); }
+        };
+    }  // namespace
+
+    /**
+     *	@class _Intrusive_tree
+     *   @brief an ordered set of objects linked by their hooks. Only the header of tree is allocated. Erasing or clearing
+     *	unlinks objects without destroying them, and destroying the tree unlinks all of them. Keys of linked objects must
+     *	not be modified, since they decide the positions of objects.
+     */
+    template <class _Traits>
+    class _Intrusive_tree {
+        using _Tree    = _Bs_tree<_Traits>;
+        using _Node    = typename _Traits::_Node;
+        using _Nodeptr = typename _Traits::_Nodeptr;
+
+        static constexpr bool _Multi = _Traits::_Multi;
+
+    public:
+        using key_type               = typename _Tree::key_type;
+        using value_type             = typename _Tree::value_type;
+        using key_compare            = typename _Tree::key_compare;
+        using value_compare          = typename _Tree::value_compare;
+        using size_type              = typename _Tree::size_type;
+        using difference_type        = typename _Tree::difference_type;
+        using reference              = value_type&;
+        using const_reference        = const value_type&;
+        using pointer                = value_type*;
+        using const_pointer          = const value_type*;
+        using iterator               = typename _Tree::iterator;
+        using const_iterator         = typename _Tree::const_iterator;
+        using reverse_iterator       = typename _Tree::reverse_iterator;
+        using const_reverse_iterator = typename _Tree::const_reverse_iterator;
+
+        _Intrusive_tree() = default;
+
+        explicit _Intrusive_tree(const key_compare& cmpr) : _tree(cmpr) {}
+
+        /**
+         *	@brief constructs the tree linking objects referred by [first, last).
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Intrusive_tree(_Iter first, _Iter last, const key_compare& cmpr = key_compare()) : _tree(cmpr) {
+            insert(first, last);
+        }
+
+        _Intrusive_tree(const _Intrusive_tree&)            = delete;
+        _Intrusive_tree& operator=(const _Intrusive_tree&) = delete;
+
+        _Intrusive_tree(_Intrusive_tree&& other) : _tree(std::move(other._tree)) {}  // allocates a header for other
+
+        _Intrusive_tree& operator=(_Intrusive_tree&& rhs) noexcept {
+            if (this != std::addressof(rhs)) {
+                clear();
+                swap(rhs);
+            }
+            return *this;
+        }
+
+        XSTL_NODISCARD iterator               begin() noexcept { return _tree.begin(); }
+        XSTL_NODISCARD const_iterator         begin() const noexcept { return _tree.begin(); }
+        XSTL_NODISCARD const_iterator         cbegin() const noexcept { return _tree.cbegin(); }
+        XSTL_NODISCARD iterator               end() noexcept { return _tree.end(); }
+        XSTL_NODISCARD const_iterator         end() const noexcept { return _tree.end(); }
+        XSTL_NODISCARD const_iterator         cend() const noexcept { return _tree.cend(); }
+        XSTL_NODISCARD reverse_iterator       rbegin() noexcept { return _tree.rbegin(); }
+        XSTL_NODISCARD const_reverse_iterator rbegin() const noexcept { return _tree.rbegin(); }
+        XSTL_NODISCARD reverse_iterator       rend() noexcept { return _tree.rend(); }
+        XSTL_NODISCARD const_reverse_iterator rend() const noexcept { return _tree.rend(); }
+
+        XSTL_NODISCARD size_type size() const noexcept { return _tree.size(); }
+        XSTL_NODISCARD bool      empty() const noexcept { return _tree.empty(); }
+
+        XSTL_NODISCARD key_compare   key_comp() const { return _tree.key_comp(); }
+        XSTL_NODISCARD value_compare value_comp() const { return value_compare{ _tree.key_comp() }; }
+
+        /**
+         *	@brief links value into the tree. value must not be linked by the same hook.
+         *	@return an iterator to value, or to the element with the same key if insertion failed, and whether insertion
+         *	took place for sets, or an iterator to value for multisets
+         */
+        auto insert(reference value) {
+            const _Nodeptr  _node = _Hook(value);
+            const key_type& _key  = _Traits::kfn(value);
+            XSTL_EXPECT(!_node->is_linked(), "element has been linked by this hook");
+            if constexpr (_Multi)
+                return _Make_iter(_Tree_accessor::insert_at(&_tree, _Tree_accessor::find_upper_bound(&_tree, _key)._pack, _node));
+            else {
+                const auto _res = _Tree_accessor::find_lower_bound(&_tree, _key);
+                if (!_res._curr->is_nil() && !key_comp()(_key, _Traits::kfn(_Node::value_of(_res._curr))))
+                    return std::pair<iterator, bool>{ _Make_iter(_res._curr), false };
+                return std::pair<iterator, bool>{ _Make_iter(_Tree_accessor::insert_at(&_tree, _res._pack, _node)), true };
+            }
+        }
+
+        /**
+         *	@brief links value into the tree as close as possible to the position just prior to hint.
+         *	@return an iterator to value, or to the element with the same key if insertion failed
+         */
+        iterator insert(const_iterator hint, reference value) {
+            const _Nodeptr _node = _Hook(value);
+            XSTL_EXPECT(!_node->is_linked(), "element has been linked by this hook");
+            const auto _res = _Tree_accessor::find_hint(&_tree, hint.base(), _Traits::kfn(value));
+            if (!_res._insertable)
+                return _Make_iter(_res._pack._parent);
+            return _Make_iter(_Tree_accessor::insert_at(&_tree, _res._pack, _node));
+        }
+
+        /**
+         *	@brief links objects referred by [first, last).
+         */
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert(_Iter first, _Iter last) {
+            for (; first != last; ++first)
+                insert(end(), *first);
+        }
+
+        /**
+         *	@brief unlinks the element at position.
+         *	@return iterator following the unlinked element
+         */
+        iterator erase(const_iterator position) noexcept { return _tree.erase(position); }
+        iterator erase(const_iterator first, const_iterator last) noexcept { return _tree.erase(first, last); }
+
+        /**
+         *	@brief unlinks all elements with key.
+         *	@return the number of elements unlinked
+         */
+        size_type erase(const key_type& key) { return _tree.erase(key); }
+
+        /**
+         *	@brief unlinks all elements.
+         */
+        void clear() noexcept { _tree.clear(); }
+
+        void swap(_Intrusive_tree& other) noexcept { _tree.swap(other._tree); }
+
+        /**
+         *	@return an iterator to value, which must be linked into this tree
+         */
+        XSTL_NODISCARD iterator iterator_to(reference value) noexcept {
+            XSTL_EXPECT(_Hook(value)->is_linked(), "element is not linked by this hook");
+            return _Make_iter(_Hook(value));
+        }
+        XSTL_NODISCARD const_iterator iterator_to(const_reference value) const noexcept {
+            return const_cast<_Intrusive_tree*>(this)->iterator_to(const_cast<reference>(value));
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator find(const _Key& key) {
+            return _tree.find(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator find(const _Key& key) const {
+            return _tree.find(key);
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD size_type count(const _Key& key) const {
+            return _tree.count(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD bool contains(const _Key& key) const {
+            return _tree.contains(key);
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator lower_bound(const _Key& key) {
+            return _tree.lower_bound(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator lower_bound(const _Key& key) const {
+            return _tree.lower_bound(key);
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD iterator upper_bound(const _Key& key) {
+            return _tree.upper_bound(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD const_iterator upper_bound(const _Key& key) const {
+            return _tree.upper_bound(key);
+        }
+
+        template <class _Key>
+        XSTL_NODISCARD std::pair<iterator, iterator> equal_range(const _Key& key) {
+            return _tree.equal_range(key);
+        }
+        template <class _Key>
+        XSTL_NODISCARD std::pair<const_iterator, const_iterator> equal_range(const _Key& key) const {
+            return _tree.equal_range(key);
+        }
+
+    private:
+        static _Nodeptr _Hook(reference value) noexcept { return static_cast<_Nodeptr>(std::addressof(value)); }
+
+        iterator _Make_iter(_Nodeptr node) noexcept { return _Tree_accessor::make_iter(&_tree, node); }
+
+        _Tree _tree;
+    };
+
+    template <class _Traits>
+    void swap(_Intrusive_tree<_Traits>& lhs, _Intrusive_tree<_Traits>& rhs) noexcept {
+        lhs.swap(rhs);
+    }
+
+#define DEFINE_INTRUSIVE_CONTAINER(NAME)                                                                                    \
+    template <class _Tp, class _KeyOfValue = std::identity, class _Compare = std::less<>, class _Tag = void,                \
+              class... _Policies>                                                                                           \
+    using NAME##_intrusive_set = _Intrusive_tree<NAME##_traits<_Intrusive_traits<_Tp, _KeyOfValue, _Compare>,               \
+                                                               DEFAULT_ALLOC(_Tp), false, _Intrusive_node_policy<_Tag>,     \
+                                                               _Policies...>>;                                              \
+    template <class _Tp, class _KeyOfValue = std::identity, class _Compare = std::less<>, class _Tag = void,                \
+              class... _Policies>                                                                                           \
+    using NAME##_intrusive_multiset = _Intrusive_tree<NAME##_traits<_Intrusive_traits<_Tp, _KeyOfValue, _Compare>,          \
+                                                                    DEFAULT_ALLOC(_Tp), true, _Intrusive_node_policy<_Tag>, \
+                                                                    _Policies...>>;
+
+    DEFINE_INTRUSIVE_CONTAINER(bs);
+    DEFINE_INTRUSIVE_CONTAINER(avl);
+    DEFINE_INTRUSIVE_CONTAINER(treap);
+    DEFINE_INTRUSIVE_CONTAINER(splay);
+    DEFINE_INTRUSIVE_CONTAINER(rb);
+    DEFINE_INTRUSIVE_CONTAINER(scapegoat);
+    DEFINE_INTRUSIVE_CONTAINER(wb);
+#undef DEFINE_INTRUSIVE_CONTAINER
+}  // namespace xstl
+
+#endif  // _INTRUSIVE_TREE_HPP_
@@ -0,0 +1,562 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file persistent_map.hpp
+ *   @brief The persistent library contains maps/sets whose versions can be captured in O(1) by snapshot().
+ *   Nodes are immutable once published and shared between versions by reference counting, so a writer updates the tree by
+ *   copying the O(log n) nodes on the search path (path copying). Readers hold snapshots and never lock, while a single
+ *   writer keeps updating the container.
+ *	1. persistent_set
+ *	2. persistent_map
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _PERSISTENT_MAP_HPP_
+#define _PERSISTENT_MAP_HPP_
+
+#include "bs_tree.hpp"
+#include <atomic>
+
+namespace xstl {
+    /**
+     *	@class _Persistent_node
+     *   @brief node of persistent tree. It has no parent pointer, since a node may be shared by several parents of
+     *	different versions. _height is the height of AVL tree rooted at this node.
+     */
+    template <class _Tp>
+    struct _Persistent_node {
+        using _Node    = _Persistent_node<_Tp>;
+        using _Nodeptr = _Node*;
+
+        std::atomic<size_t> _refs;
+        _Nodeptr            _left;
+        _Nodeptr            _right;
+        int                 _height;
+        _Tp                 _value;
+
+        /**
+         *	@brief creates a node which takes over the references of left and right.
+         */
+        template <class _Alnode, class... _Args>
+        static _Nodeptr create_node(_Alnode& alloc, _Nodeptr left, _Nodeptr right, _Args&&... args) {
+            _Nodeptr _node = alloc.allocate(1);
+            try {
+                std::allocator_traits<_Alnode>::construct(alloc, std::addressof(_node->_value), std::forward<_Args>(args)...);
+            } catch (...) {
+                alloc.deallocate(_node, 1);
+                throw;
+            }
+            construct_in_place(_node->_refs, size_t{ 1 });
+            construct_in_place(_node->_left, left);
+            construct_in_place(_node->_right, right);
+            _node->_height = (std::max)(height(left), height(right)) + 1;
+            return _node;
+        }
+
+        static int height(_Nodeptr node) noexcept { return node ? node->_height : 0; }
+
+        static void update_height(_Nodeptr node) noexcept {
+            node->_height = (std::max)(height(node->_left), height(node->_right)) + 1;
+        }
+
+        static _Nodeptr retain(_Nodeptr node) noexcept {
+            if (node)
+                node->_refs.fetch_add(1, std::memory_order_relaxed);
+            return node;
+        }
+
+        /**
+         *	@brief drops a reference of node. The last reference destroys node and releases its children, which recurses at
+         *	most the height of tree.
+         */
+        template <class _Alnode>
+        static void release(_Alnode& alloc, _Nodeptr node) noexcept {
+            if (node && node->_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                release(alloc, node->_left);
+                release(alloc, node->_right);
+                destroy_in_place(node->_refs);
+                std::allocator_traits<_Alnode>::destroy(alloc, std::addressof(node->_value));
+                alloc.deallocate(node, 1);
+            }
+        }
+
+        /**
+         *	@return true if node is referenced only by the version which is being built, so it can be modified in place.
+         */
+        static bool unique(_Nodeptr node) noexcept { return node->_refs.load(std::memory_order_acquire) == 1; }
+    };
+
+    /**
+     *	@class _Persistent_citer
+     *   @brief forward iterator of persistent tree. Nodes have no parent pointer, so it keeps the path from root in a fixed
+     *	stack. An AVL tree with 2^64 nodes is lower than 93, which bounds the stack.
+     */
+    template <class _Node, class _Tp>
+    class _Persistent_citer {
+        using _Nodeptr = _Node*;
+
+        template <class, class>
+        friend class _Persistent_tree;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = _Tp;
+        using difference_type   = ptrdiff_t;
+        using pointer           = const _Tp*;
+        using reference         = const _Tp&;
+
+        static constexpr size_t max_height = 96;
+
+        _Persistent_citer() noexcept = default;
+
+        XSTL_NODISCARD reference operator*() const noexcept {
+            XSTL_EXPECT(_top != 0, "cannot dereference end persistent iterator");
+            return _stack[_top - 1]->_value;
+        }
+        XSTL_NODISCARD pointer operator->() const noexcept { return std::addressof(**this); }
+
+        _Persistent_citer& operator++() noexcept {
+            XSTL_EXPECT(_top != 0, "cannot increment end persistent iterator");
+            _Push_leftmost(_stack[--_top]->_right);
+            return *this;
+        }
+        _Persistent_citer operator++(int) noexcept {
+            _Persistent_citer _tmp = *this;
+            ++*this;
+            return _tmp;
+        }
+
+        XSTL_NODISCARD friend bool operator==(const _Persistent_citer& lhs, const _Persistent_citer& rhs) noexcept {
+            return lhs._Current() == rhs._Current();
+        }
+        XSTL_NODISCARD friend bool operator!=(const _Persistent_citer& lhs, const _Persistent_citer& rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+    private:
+        _Nodeptr _Current() const noexcept { return _top == 0 ? nullptr : _stack[_top - 1]; }
+
+        void _Push(_Nodeptr node) noexcept {
+            XSTL_EXPECT(_top < max_height, "persistent tree is too high");
+            _stack[_top++] = node;
+        }
+
+        void _Push_leftmost(_Nodeptr node) noexcept {
+            for (; node; node = node->_left)
+                _Push(node);
+        }
+
+        _Nodeptr _stack[max_height];
+        size_t   _top = 0;
+    };
+
+    /**
+     *	@class _Persistent_tree
+     *   @brief a set/map which is updated by a single writer and read by any number of threads through snapshots.
+     *	Methods of _Persistent_tree are NOT thread safe except snapshot(), which may be called concurrently with one writer.
+     *	Snapshots are independent values and can be used by any thread without locking. Nodes may be freed by the thread
+     *	releasing the last snapshot, so the allocator must be thread safe.
+     */
+    template <class _Cate, class _Alloc>
+    class _Persistent_tree {
+    public:
+        using key_type        = typename _Cate::key_type;
+        using value_type      = typename _Cate::value_type;
+        using key_compare     = typename _Cate::key_compare;
+        using value_compare   = typename _Cate::value_compare;
+        using allocator_type  = _Alloc;
+        using size_type       = typename std::allocator_traits<_Alloc>::size_type;
+        using difference_type = typename std::allocator_traits<_Alloc>::difference_type;
+        using reference       = const value_type&;
+        using const_reference = const value_type&;
+
+    private:
+        using _Node          = _Persistent_node<value_type>;
+        using _Nodeptr       = _Node*;
+        using _Alnode_type   = typename std::allocator_traits<_Alloc>::template rebind_alloc<_Node>;
+        using _Alnode_traits = std::allocator_traits<_Alnode_type>;
+
+        static_assert(std::is_same_v<typename _Alloc::value_type, value_type>,
+                      MISMATCH_ALLOCATOR_MESSAGE("persistent_map/set", "value_type"));
+
+    public:
+        using const_iterator = _Persistent_citer<_Node, value_type>;
+        using iterator       = const_iterator;
+
+        /**
+         *	@class snapshot_type
+         *   @brief an immutable version of tree. Copying a snapshot is O(1).
+         */
+        class snapshot_type {
+            friend class _Persistent_tree;
+
+        public:
+            snapshot_type() = default;
+
+            snapshot_type(const snapshot_type& other) : _tpl(other._tpl), _size(other._size) { _Node::retain(_Get_root()); }
+
+            snapshot_type(snapshot_type&& other) noexcept : _tpl(std::move(other._tpl)), _size(std::exchange(other._size, 0)) {
+                other._Get_root() = nullptr;
+            }
+
+            snapshot_type& operator=(snapshot_type other) noexcept {
+                swap(other);
+                return *this;
+            }
+
+            ~snapshot_type() { _Node::release(_Getal(), _Get_root()); }
+
+            void swap(snapshot_type& other) noexcept {
+                using std::swap;
+                swap(_tpl, other._tpl);
+                swap(_size, other._size);
+            }
+
+            XSTL_NODISCARD size_type size() const noexcept { return _size; }
+            XSTL_NODISCARD bool      empty() const noexcept { return _size == 0; }
+
+            XSTL_NODISCARD const_iterator begin() const noexcept {
+                const_iterator _iter;
+                _iter._Push_leftmost(_Get_root());
+                return _iter;
+            }
+            XSTL_NODISCARD const_iterator end() const noexcept { return const_iterator(); }
+            XSTL_NODISCARD const_iterator cbegin() const noexcept { return begin(); }
+            XSTL_NODISCARD const_iterator cend() const noexcept { return end(); }
+
+            /**
+             *	@return an iterator pointing to the first element that is not less than key
+             */
+            XSTL_NODISCARD const_iterator lower_bound(const key_type& key) const {
+                const_iterator _iter;
+                for (_Nodeptr _curr = _Get_root(); _curr;) {
+                    if (_Get_cmpr()(_Cate::kfn(_curr->_value), key))  // curr.key < key, this node is never visited again
+                        _curr = _curr->_right;
+                    else {
+                        _iter._Push(_curr);
+                        _curr = _curr->_left;
+                    }
+                }
+                return _iter;
+            }
+
+            XSTL_NODISCARD const_iterator find(const key_type& key) const {
+                const_iterator _iter = lower_bound(key);
+                return _iter == end() || _Get_cmpr()(key, _Cate::kfn(*_iter)) ? end() : _iter;
+            }
+
+            XSTL_NODISCARD bool contains(const key_type& key) const { return _Find(_Get_root(), _Get_cmpr(), key) != nullptr; }
+
+            XSTL_NODISCARD size_type count(const key_type& key) const { return contains(key); }
+
+            /**
+             *	@return the mapped value of the element with key, which must be present
+             */
+            XSTL_REQUIRES(!std::is_same_v<key_type, value_type>)
+            XSTL_NODISCARD const auto& at(const key_type& key) const {
+                const _Nodeptr _node = _Find(_Get_root(), _Get_cmpr(), key);
+                if (!_node)
+                    throw std::out_of_range("invalid persistent_map<K, T> key");
+                return _node->_value.second;
+            }
+
+            XSTL_NODISCARD key_compare key_comp() const { return _Get_cmpr(); }
+
+        private:
+            snapshot_type(const key_compare& cmpr, const _Alnode_type& alloc, _Nodeptr root, size_type size) noexcept
+                : _tpl(cmpr, alloc, root), _size(size) {}
+
+            inline const key_compare& _Get_cmpr() const noexcept { return std::get<0>(_tpl); }
+            inline _Alnode_type&      _Getal() noexcept { return std::get<1>(_tpl); }
+            inline _Nodeptr&          _Get_root() noexcept { return std::get<2>(_tpl); }
+            inline _Nodeptr           _Get_root() const noexcept { return std::get<2>(_tpl); }
+
+            compressed_tuple<key_compare, _Alnode_type, _Nodeptr> _tpl{ std::ignore, std::ignore, nullptr };
+            size_type                                             _size = 0;
+        };
+
+        /**
+         *	@brief constructs an empty persistent tree.
+         *	@param cmpr : comparison function object to use for all comparisons of keys
+         *   @param alloc : allocator to use for all memory allocations of this tree
+         */
+        _Persistent_tree() : _tpl(std::ignore, std::ignore, nullptr) {}
+
+        explicit _Persistent_tree(const key_compare& cmpr) : _tpl(cmpr, std::ignore, nullptr) {}
+
+        _Persistent_tree(const key_compare& cmpr, const allocator_type& alloc) : _tpl(cmpr, alloc, nullptr) {}
+
+        /**
+         *	@brief constructs a persistent tree which shares all nodes with other, so it costs O(1).
+         */
+        _Persistent_tree(const _Persistent_tree& other) : _tpl(other._tpl), _size(other._size) { _Node::retain(_Get_root()); }
+
+        _Persistent_tree(_Persistent_tree&& other) noexcept : _tpl(std::move(other._tpl)), _size(std::exchange(other._size, 0)) {
+            other._Get_root() = nullptr;
+        }
+
+        /**
+         *	@brief constructs a persistent tree which starts from the version of snapshot.
+         */
+        explicit _Persistent_tree(const snapshot_type& snapshot)
+            : _tpl(snapshot._Get_cmpr(), std::get<1>(snapshot._tpl), _Node::retain(snapshot._Get_root())),
+              _size(snapshot._size) {}
+
+        _Persistent_tree& operator=(const _Persistent_tree& rhs) {
+            if XSTL_LIKELY (this != std::addressof(rhs)) {
+                XSTL_EXPECT(_Getal() == rhs._Getal(), "persistent trees can only share nodes with equal allocators");
+                _Get_cmpr() = rhs._Get_cmpr();
+                _Publish(_Node::retain(rhs._Get_root()), rhs._size);
+            }
+            return *this;
+        }
+
+        ~_Persistent_tree() { _Node::release(_Getal(), _Get_root()); }
+
+        /**
+         *	@brief captures current version in O(1). It is safe to call snapshot() concurrently with one writer.
+         */
+        XSTL_NODISCARD snapshot_type snapshot() const {
+            _Lock_guard _guard(_lock);
+            return snapshot_type(_Get_cmpr(), _Getal(), _Node::retain(_Get_root()), _size);
+        }
+
+        XSTL_NODISCARD size_type size() const noexcept { return _size; }
+        XSTL_NODISCARD bool      empty() const noexcept { return _size == 0; }
+        XSTL_NODISCARD size_type max_size() const noexcept {
+            return std::min<size_type>((std::numeric_limits<difference_type>::max)(), _Alnode_traits::max_size(_Getal()));
+        }
+
+        XSTL_NODISCARD bool contains(const key_type& key) const { return _Find(_Get_root(), _Get_cmpr(), key) != nullptr; }
+
+        /**
+         *	@brief inserts value if there is no element with the same key. It copies O(log n) nodes.
+         *	@return true if insertion took place
+         */
+        bool insert(const value_type& value) { return _Insert(value, false); }
+
+        template <class... _Args>
+        bool emplace(_Args&&... args) {
+            return _Insert(value_type(std::forward<_Args>(args)...), false);
+        }
+
+        /**
+         *	@brief inserts a new element, or replaces the mapped value if key exists.
+         *	@return true if insertion took place, false if the assignment took place
+         */
+        template <class _Mapped, XSTL_REQUIRES_(!std::is_same_v<key_type, value_type>)>
+        bool insert_or_assign(const key_type& key, _Mapped&& mapped) {
+            return _Insert(value_type(key, std::forward<_Mapped>(mapped)), true);
+        }
+
+        /**
+         *	@brief removes the element with key. It copies O(log n) nodes.
+         *	@return the number of elements removed
+         */
+        size_type erase(const key_type& key) {
+            if (!_Find(_Get_root(), _Get_cmpr(), key))
+                return 0;
+            _Publish(_Erase(_Get_root(), key), _size - 1);
+            return 1;
+        }
+
+        void clear() noexcept { _Publish(nullptr, 0); }
+
+        void swap(_Persistent_tree& other) {
+            _Lock_guard _guard(_lock), _other_guard(other._lock);
+            using std::swap;
+            swap(_tpl, other._tpl);
+            swap(_size, other._size);
+        }
+
+        XSTL_NODISCARD key_compare    key_comp() const { return _Get_cmpr(); }
+        XSTL_NODISCARD allocator_type get_allocator() const noexcept { return static_cast<allocator_type>(_Getal()); }
+
+    private:
+        /**
+         *	@brief a spin lock which only guards the copy of root pointer and its reference count.
+         */
+        struct _Lock_guard {
+            explicit _Lock_guard(std::atomic_flag& lock) noexcept : _lock(lock) {
+                while (_lock.test_and_set(std::memory_order_acquire))
+                    ;
+            }
+            ~_Lock_guard() { _lock.clear(std::memory_order_release); }
+
+            std::atomic_flag& _lock;
+        };
+
+        static _Nodeptr _Find(_Nodeptr node, const key_compare& cmpr, const key_type& key) {
+            while (node) {
+                if (cmpr(key, _Cate::kfn(node->_value)))
+                    node = node->_left;
+                else if (cmpr(_Cate::kfn(node->_value), key))
+                    node = node->_right;
+                else
+                    return node;
+            }
+            return nullptr;
+        }
+
+        /**
+         *	@brief replaces current version by root, then releases the old version outside of the lock.
+         */
+        void _Publish(_Nodeptr root, size_type size) noexcept {
+            _Nodeptr _old;
+            {
+                _Lock_guard _guard(_lock);
+                _old  = std::exchange(_Get_root(), root);
+                _size = size;
+            }
+            _Node::release(_Getal(), _old);
+        }
+
+        bool _Insert(const value_type& value, bool assign) {
+            const bool _exists = _Find(_Get_root(), _Get_cmpr(), _Cate::kfn(value)) != nullptr;
+            if (_exists && !assign)
+                return false;
+            if (!_exists && _size == max_size())
+                throw std::length_error("persistent_map/set too long");
+            _Publish(_Insert_at(_Get_root(), value), _size + !_exists);
+            return !_exists;
+        }
+
+        /**
+         *	@brief builds a new version of the subtree rooted at node, where value is inserted or assigned.
+         *	@return an owned reference of new subtree
+         */
+        _Nodeptr _Insert_at(_Nodeptr node, const value_type& value) {
+            if (!node)
+                return _Node::create_node(_Getal(), nullptr, nullptr, value);
+            const auto& _key = _Cate::kfn(value);
+            if (_Get_cmpr()(_key, _Cate::kfn(node->_value))) {
+                const _Nodeptr _left = _Insert_at(node->_left, value);
+                return _Balance(_Copy_node(node, _left, _Node::retain(node->_right)));
+            }
+            if (_Get_cmpr()(_Cate::kfn(node->_value), _key)) {
+                const _Nodeptr _right = _Insert_at(node->_right, value);
+                return _Balance(_Copy_node(node, _Node::retain(node->_left), _right));
+            }
+            return _Node::create_node(_Getal(), _Node::retain(node->_left), _Node::retain(node->_right), value);
+        }
+
+        /**
+         *	@brief builds a new version of the subtree rooted at node, where key is removed. key must be present.
+         */
+        _Nodeptr _Erase(_Nodeptr node, const key_type& key) {
+            if (_Get_cmpr()(key, _Cate::kfn(node->_value))) {
+                const _Nodeptr _left = _Erase(node->_left, key);
+                return _Balance(_Copy_node(node, _left, _Node::retain(node->_right)));
+            }
+            if (_Get_cmpr()(_Cate::kfn(node->_value), key)) {
+                const _Nodeptr _right = _Erase(node->_right, key);
+                return _Balance(_Copy_node(node, _Node::retain(node->_left), _right));
+            }
+            if (!node->_left)
+                return _Node::retain(node->_right);
+            if (!node->_right)
+                return _Node::retain(node->_left);
+            _Nodeptr _suc = node->_right;
+            while (_suc->_left)
+                _suc = _suc->_left;
+            const _Nodeptr _right = _Erase_min(node->_right);
+            return _Balance(_Copy_node(_suc, _Node::retain(node->_left), _right));
+        }
+
+        _Nodeptr _Erase_min(_Nodeptr node) {
+            if (!node->_left)
+                return _Node::retain(node->_right);
+            const _Nodeptr _left = _Erase_min(node->_left);
+            return _Balance(_Copy_node(node, _left, _Node::retain(node->_right)));
+        }
+
+        /**
+         *	@brief copies the value of node into a new node, which takes over the references of left and right. They are
+         *	released if the copy throws.
+         */
+        _Nodeptr _Copy_node(_Nodeptr node, _Nodeptr left, _Nodeptr right) {
+            try {
+                return _Node::create_node(_Getal(), left, right, node->_value);
+            } catch (...) {
+                _Node::release(_Getal(), left);
+                _Node::release(_Getal(), right);
+                throw;
+            }
+        }
+
+        /**
+         *	@brief makes node modifiable. A shared node is copied and the reference to it is dropped.
+         */
+        _Nodeptr _Unshare(_Nodeptr node) {
+            if (_Node::unique(node))
+                return node;
+            const _Nodeptr _copy = _Copy_node(node, _Node::retain(node->_left), _Node::retain(node->_right));
+            _Node::release(_Getal(), node);
+            return _copy;
+        }
+
+        _Nodeptr _Rotate_left(_Nodeptr node) {
+            const _Nodeptr _pivot = node->_right = _Unshare(node->_right);
+            node->_right          = _pivot->_left;
+            _pivot->_left         = node;
+            _Node::update_height(node);
+            _Node::update_height(_pivot);
+            return _pivot;
+        }
+
+        _Nodeptr _Rotate_right(_Nodeptr node) {
+            const _Nodeptr _pivot = node->_left = _Unshare(node->_left);
+            node->_left           = _pivot->_right;
+            _pivot->_right        = node;
+            _Node::update_height(node);
+            _Node::update_height(_pivot);
+            return _pivot;
+        }
+
+        /**
+         *	@brief restores AVL property of a node which has been newly built by this version.
+         */
+        _Nodeptr _Balance(_Nodeptr node) {
+            try {  // node is a valid subtree whenever a copy throws, so it can be released as a whole
+                const int _diff = _Node::height(node->_left) - _Node::height(node->_right);
+                if (_diff > 1) {
+                    if (_Node::height(node->_left->_left) < _Node::height(node->_left->_right)) {
+                        node->_left = _Unshare(node->_left);
+                        node->_left = _Rotate_left(node->_left);
+                    }
+                    return _Rotate_right(node);
+                }
+                if (_diff < -1) {
+                    if (_Node::height(node->_right->_right) < _Node::height(node->_right->_left)) {
+                        node->_right = _Unshare(node->_right);
+                        node->_right = _Rotate_right(node->_right);
+                    }
+                    return _Rotate_left(node);
+                }
+                return node;
+            } catch (...) {
+                _Node::release(_Getal(), node);
+                throw;
+            }
+        }
+
+        inline key_compare&        _Get_cmpr() noexcept { return std::get<0>(_tpl); }
+        inline const key_compare&  _Get_cmpr() const noexcept { return std::get<0>(_tpl); }
+        inline _Alnode_type&       _Getal() noexcept { return std::get<1>(_tpl); }
+        inline const _Alnode_type& _Getal() const noexcept { return std::get<1>(_tpl); }
+        inline _Nodeptr&           _Get_root() noexcept { return std::get<2>(_tpl); }
+        inline _Nodeptr            _Get_root() const noexcept { return std::get<2>(_tpl); }
+
+        compressed_tuple<key_compare, _Alnode_type, _Nodeptr> _tpl;
+        size_type                                             _size = 0;
+        mutable std::atomic_flag                              _lock = ATOMIC_FLAG_INIT;
+    };
+
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp)>
+    using persistent_set = _Persistent_tree<_Set_traits<_Tp, _Compare>, _Alloc>;
+#define MAP_VALUE_TYPE std::pair<const _Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE)>
+    using persistent_map = _Persistent_tree<_Map_traits<_Key, _Value, _Compare>, _Alloc>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _PERSISTENT_MAP_HPP_
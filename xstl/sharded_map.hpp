@@ -0,0 +1,481 @@
+/*
+ *   Copyright (c) 2022 Kamichanw. All rights reserved.
+ *   @file sharded_map.hpp
+ *   @brief The sharded library contains ordered sets/maps for many writers. The key space is partitioned into ranges, each
+ *   range is a tree of bs_tree.hpp guarded by its own mutex, so threads writing different ranges never wait for each
+ *   other. Boundaries of ranges move as shards grow, and the table of boundaries is reclaimed by epoch-based reclamation,
+ *   so routing a key to its shard takes no lock.
+ *	1. sharded_set
+ *	2. sharded_map
+ *   @author Kami-chan e-mail: 865710157@qq.com
+ */
+#pragma once
+#ifndef _SHARDED_MAP_HPP_
+#define _SHARDED_MAP_HPP_
+
+#include "concurrent_map.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace xstl {
+    /**
+     *	@class _Sharded_tree
+     *   @brief an ordered set/map of unique keys made of shards, each of which is a _Tree holding the keys between two
+     *	boundaries. Every member function can be called concurrently by any number of threads, except for destructor.
+     *	Elements are accessed under the lock of their shard, by visit(), for_each() or cursors. A cursor holds the lock of
+     *	the shard it points into, so the thread holding it must not modify the same map.
+     *	When a shard grows to more than twice the size of its smaller neighbour plus rebalance_threshold, half of the
+     *	difference is moved to that neighbour by relinking nodes, and shards which have never been used are taken on the way.
+     *	size() is exact only when there are no concurrent modifications.
+     */
+    template <class _Tree>
+    class _Sharded_tree {
+    public:
+        using key_type        = typename _Tree::key_type;
+        using value_type      = typename _Tree::value_type;
+        using key_compare     = typename _Tree::key_compare;
+        using allocator_type  = typename _Tree::allocator_type;
+        using size_type       = typename _Tree::size_type;
+        using difference_type = typename _Tree::difference_type;
+        using reference       = typename _Tree::reference;
+        using const_reference = typename _Tree::const_reference;
+
+    private:
+        static constexpr bool _Is_map = !std::is_same_v<key_type, value_type>;
+
+        static_assert(std::is_same_v<decltype(std::declval<_Tree&>().insert(std::declval<const value_type&>())),
+                                     std::pair<typename _Tree::iterator, bool>>,
+                      "sharded_map/set only supports trees of unique keys");
+
+        using _Guard   = _Epoch_domain::guard;
+        using _Nodeptr = decltype(_Tree_accessor::root(std::declval<_Tree*>()));
+
+        /**
+         *	@brief boundaries of shards. The first _active shards are in use, shard i holds keys in [_bounds[i - 1],
+         *	_bounds[i]), and the rest are empty. A layout is never modified after published.
+         */
+        struct _Layout {
+            size_type             _active = 1;
+            std::vector<key_type> _bounds;
+        };
+
+        struct alignas(64) _Shard {  // keeps mutexes of shards on different cache lines
+            std::mutex             _mtx;
+            _Tree                  _tree;
+            std::atomic<size_type> _count{ 0 };  // size of _tree, which can be read without _mtx
+        };
+
+        /**
+         *	@class _Cursor
+         *   @brief points to an element and holds the lock of its shard. Incrementing a cursor over the end of a shard
+         *	releases the lock and seeks the next element from the shard owning it, so elements moved by rebalancing are
+         *	neither skipped nor visited twice. An empty cursor is past the end.
+         */
+        template <bool _Const>
+        class _Cursor {
+            friend class _Sharded_tree;
+
+            using _Owner     = std::conditional_t<_Const, const _Sharded_tree, _Sharded_tree>;
+            using _Tree_iter = std::conditional_t<_Const, typename _Tree::const_iterator, typename _Tree::iterator>;
+
+        public:
+            using reference = typename std::iterator_traits<_Tree_iter>::reference;
+            using pointer   = std::add_pointer_t<reference>;
+
+            _Cursor() = default;
+
+            XSTL_NODISCARD explicit operator bool() const noexcept { return _lock.owns_lock(); }
+
+            XSTL_NODISCARD reference operator*() const noexcept { return *_iter; }
+            XSTL_NODISCARD pointer   operator->() const noexcept { return std::addressof(*_iter); }
+
+            _Cursor& operator++() {
+                XSTL_EXPECT(_lock.owns_lock(), "cannot increment past-the-end cursor");
+                if (const _Tree_iter _next = std::next(_iter); _next != _Tree_end()) {
+                    _iter = _next;
+                    return *this;
+                }
+                const key_type _last = _Key_of(*_iter);
+                _lock.unlock();
+                return *this = _owner->template _Seek<_Cursor>(&_last, [&](auto& tree) { return tree.upper_bound(_last); });
+            }
+
+        private:
+            _Cursor(_Owner* owner, _Shard* shard, std::unique_lock<std::mutex>&& lock, _Tree_iter iter) noexcept
+                : _owner(owner), _shard(shard), _lock(std::move(lock)), _iter(iter) {}
+
+            _Tree_iter _Tree_end() const noexcept { return _Cursor_tree<_Cursor>(*_shard).end(); }
+
+            _Owner*                      _owner = nullptr;
+            _Shard*                      _shard = nullptr;
+            std::unique_lock<std::mutex> _lock;
+            _Tree_iter                   _iter{};
+        };
+
+    public:
+        using cursor       = _Cursor<false>;
+        using const_cursor = _Cursor<true>;
+
+        static constexpr size_type rebalance_threshold = 256;
+
+        /**
+         *	@brief constructs an empty sharded tree.
+         *	@param shards : the maximum number of shards, the number of hardware threads by default
+         *	@param cmpr : comparison function object to use for all comparisons of keys
+         */
+        explicit _Sharded_tree(size_type shards = default_shard_count(), const key_compare& cmpr = key_compare())
+            : _cmpr(cmpr), _shard_count((std::max)(shards, size_type{ 1 })),
+              _shards(_Make_shards(_shard_count, cmpr)), _current(new _Layout) {}
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        _Sharded_tree(_Iter first, _Iter last, size_type shards = default_shard_count(), const key_compare& cmpr = key_compare())
+            : _Sharded_tree(shards, cmpr) {
+            insert(first, last);
+        }
+
+        _Sharded_tree(const _Sharded_tree&)            = delete;
+        _Sharded_tree& operator=(const _Sharded_tree&) = delete;
+
+        ~_Sharded_tree() {
+            _domain.drain(_Free_layout);
+            delete _current.load(std::memory_order_relaxed);
+        }
+
+        XSTL_NODISCARD static size_type default_shard_count() noexcept {
+            return (std::max)(static_cast<size_type>(std::thread::hardware_concurrency()), size_type{ 1 });
+        }
+
+        XSTL_NODISCARD size_type shard_count() const noexcept { return _shard_count; }
+
+        XSTL_NODISCARD size_type size() const noexcept {
+            size_type _size = 0;
+            for (size_type _i = 0; _i < _shard_count; ++_i)
+                _size += _shards[_i]._count.load(std::memory_order_relaxed);
+            return _size;
+        }
+        XSTL_NODISCARD bool      empty() const noexcept { return size() == 0; }
+        XSTL_NODISCARD size_type max_size() const noexcept { return (std::numeric_limits<size_type>::max)(); }
+
+        /**
+         *	@brief inserts a new element constructed from args if there is no element with the same key.
+         *	@return true if insertion took place
+         */
+        template <class... _Args>
+        bool emplace(_Args&&... args) {
+            return insert(value_type(std::forward<_Args>(args)...));
+        }
+
+        bool insert(const value_type& value) {
+            return _Modify(_Key_of(value), [&](_Tree& tree) { return tree.insert(value).second; });
+        }
+        bool insert(value_type&& value) {
+            return _Modify(_Key_of(value), [&](_Tree& tree) { return tree.insert(std::move(value)).second; });
+        }
+
+        template <class _Iter, XSTL_REQUIRES_(is_input_iterator_v<_Iter>)>
+        void insert(_Iter first, _Iter last) {
+            for (; first != last; ++first)
+                insert(*first);
+        }
+
+        void insert(std::initializer_list<value_type> ilist) { insert(ilist.begin(), ilist.end()); }
+
+        /**
+         *	@brief inserts an element with key and mapped value constructed from mapped_value if there is no element with
+         *	key, in which case mapped_value is not moved from.
+         *	@return true if insertion took place
+         */
+        template <class... _Mapped, bool _Map = _Is_map, XSTL_REQUIRES_(_Map)>
+        bool try_emplace(const key_type& key, _Mapped&&... mapped_value) {
+            return _Modify(key, [&](_Tree& tree) {
+                return tree.try_emplace(key, std::forward<_Mapped>(mapped_value)...).second;
+            });
+        }
+
+        /**
+         *	@brief removes the element with key.
+         *	@return the number of elements removed
+         */
+        size_type erase(const key_type& key) {
+            return _Locked(key, [&](_Shard& shard, size_type, const _Layout&) {
+                const size_type _count = shard._tree.erase(key);
+                shard._count.store(shard._tree.size(), std::memory_order_relaxed);
+                return _count;
+            });
+        }
+
+        /**
+         *	@brief removes all elements. Boundaries of shards are kept.
+         */
+        void clear() {
+            for (size_type _i = 0; _i < _shard_count; ++_i) {
+                std::lock_guard _lock(_shards[_i]._mtx);
+                _shards[_i]._tree.clear();
+                _shards[_i]._count.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        XSTL_NODISCARD bool contains(const key_type& key) const {
+            return _Locked(key, [&](_Shard& shard, size_type, const _Layout&) { return shard._tree.contains(key); });
+        }
+
+        XSTL_NODISCARD size_type count(const key_type& key) const { return contains(key); }
+
+        /**
+         *	@brief calls fn with the element with key under the lock of its shard. fn may modify the mapped value.
+         *	@return whether the element is found
+         */
+        template <class _Fn>
+        bool visit(const key_type& key, _Fn&& fn) {
+            return _Locked(key, [&](_Shard& shard, size_type, const _Layout&) { return _Visit(shard._tree, key, fn); });
+        }
+        template <class _Fn>
+        bool visit(const key_type& key, _Fn&& fn) const {
+            return _Locked(key, [&](_Shard& shard, size_type, const _Layout&) {
+                return _Visit(static_cast<const _Tree&>(shard._tree), key, fn);
+            });
+        }
+
+        /**
+         *	@brief calls fn with every element in order. Each shard is locked while its elements are visited.
+         */
+        template <class _Fn>
+        void for_each(_Fn fn) {
+            for (cursor _cursor = first(); _cursor; ++_cursor)
+                fn(*_cursor);
+        }
+        template <class _Fn>
+        void for_each(_Fn fn) const {
+            for (const_cursor _cursor = first(); _cursor; ++_cursor)
+                fn(*_cursor);
+        }
+
+        /**
+         *	@return a cursor to the least element, or an empty cursor if there is no element
+         */
+        XSTL_NODISCARD cursor first() {
+            return _Seek<cursor>(static_cast<const key_type*>(nullptr), [](_Tree& tree) { return tree.begin(); });
+        }
+        XSTL_NODISCARD const_cursor first() const {
+            return _Seek<const_cursor>(static_cast<const key_type*>(nullptr), [](const _Tree& tree) { return tree.begin(); });
+        }
+
+        XSTL_NODISCARD cursor find(const key_type& key) {
+            return _Seek<cursor>(&key, [&](_Tree& tree) { return tree.lower_bound(key); }, true);
+        }
+        XSTL_NODISCARD const_cursor find(const key_type& key) const {
+            return _Seek<const_cursor>(&key, [&](const _Tree& tree) { return tree.lower_bound(key); }, true);
+        }
+
+        XSTL_NODISCARD cursor lower_bound(const key_type& key) {
+            return _Seek<cursor>(&key, [&](_Tree& tree) { return tree.lower_bound(key); });
+        }
+        XSTL_NODISCARD const_cursor lower_bound(const key_type& key) const {
+            return _Seek<const_cursor>(&key, [&](const _Tree& tree) { return tree.lower_bound(key); });
+        }
+
+        XSTL_NODISCARD cursor upper_bound(const key_type& key) {
+            return _Seek<cursor>(&key, [&](_Tree& tree) { return tree.upper_bound(key); });
+        }
+        XSTL_NODISCARD const_cursor upper_bound(const key_type& key) const {
+            return _Seek<const_cursor>(&key, [&](const _Tree& tree) { return tree.upper_bound(key); });
+        }
+
+        XSTL_NODISCARD key_compare key_comp() const { return _cmpr; }
+
+    private:
+        static const key_type& _Key_of(const value_type& value) noexcept {
+            if constexpr (_Is_map)
+                return value.first;
+            else
+                return value;
+        }
+
+        static void _Free_layout(void* layout) noexcept { delete static_cast<_Layout*>(layout); }
+
+        static std::unique_ptr<_Shard[]> _Make_shards(size_type count, const key_compare& cmpr) {
+            std::unique_ptr<_Shard[]> _shards(new _Shard[count]);
+            for (size_type _i = 0; _i < count; ++_i)
+                _shards[_i]._tree = _Tree(cmpr);  // shards cannot be moved, so each tree is assigned its comparator
+            return _shards;
+        }
+
+        template <class _Tree_ref, class _Fn>
+        static bool _Visit(_Tree_ref& tree, const key_type& key, _Fn& fn) {
+            const auto _iter = tree.find(key);
+            if (_iter == tree.end())
+                return false;
+            fn(*_iter);
+            return true;
+        }
+
+        size_type _Route(const _Layout& layout, const key_type& key) const {
+            return static_cast<size_type>(std::upper_bound(layout._bounds.begin(), layout._bounds.end(), key, _cmpr)
+                                          - layout._bounds.begin());
+        }
+
+        /**
+         *	@brief calls fn(shard, index, layout) with the lock of the shard owning key. Boundaries of a shard only move
+         *	while its lock is held, so the layout loaded after locking tells whether the shard still owns key.
+         */
+        template <class _Fn>
+        decltype(auto) _Locked(const key_type& key, _Fn&& fn) const {
+            _Guard         _pin(_domain);
+            const _Layout* _layout = _current.load(std::memory_order_acquire);
+            for (;;) {
+                const size_type             _index = _Route(*_layout, key);
+                _Shard&                     _shard = _shards[_index];
+                std::lock_guard<std::mutex> _lock(_shard._mtx);
+                const _Layout* const        _curr = _current.load(std::memory_order_acquire);
+                if (_curr == _layout || _Route(*_curr, key) == _index)
+                    return fn(_shard, _index, *_curr);
+                _layout = _curr;
+            }
+        }
+
+        template <class _Fn>
+        bool _Modify(const key_type& key, _Fn&& fn) {
+            bool       _heavy = false;
+            size_type  _index = 0;
+            const bool _done  = _Locked(key, [&](_Shard& shard, size_type index, const _Layout& layout) {
+                const bool _res = fn(shard._tree);
+                shard._count.store(shard._tree.size(), std::memory_order_relaxed);
+                _heavy = _Heavy(index, layout);
+                _index = index;
+                return _res;
+            });
+            if (_heavy)
+                _Rebalance(_index);
+            return _done;
+        }
+
+        /**
+         *	@brief finds the first element from the shard owning key (or the first shard if key is null) onwards, for which
+         *	search returns an iterator other than end of tree. The search restarts if boundaries change meanwhile.
+         *	@param exact : whether the element found must be equivalent to key
+         */
+        template <class _Cursor_type, class _Search>
+        _Cursor_type _Seek(const key_type* key, _Search search, bool exact = false) const {
+            _Guard _pin(_domain);
+            for (;;) {
+                const _Layout* const _layout = _current.load(std::memory_order_acquire);
+                for (size_type _index = key ? _Route(*_layout, *key) : 0; _index < _layout->_active; ++_index) {
+                    _Shard&                      _shard = _shards[_index];
+                    std::unique_lock<std::mutex> _lock(_shard._mtx);
+                    if (_layout != _current.load(std::memory_order_acquire))
+                        break;
+                    auto&      _tree = _Cursor_tree<_Cursor_type>(_shard);
+                    const auto _iter = search(_tree);
+                    if (_iter == _tree.end())
+                        continue;
+                    if (exact && _cmpr(*key, _Key_of(*_iter)))
+                        return _Cursor_type();
+                    using _Owner = typename _Cursor_type::_Owner;
+                    return _Cursor_type(const_cast<_Owner*>(this), std::addressof(_shard), std::move(_lock), _iter);
+                }
+                if (_layout == _current.load(std::memory_order_acquire))
+                    return _Cursor_type();
+            }
+        }
+
+        template <class _Cursor_type>
+        static auto& _Cursor_tree(_Shard& shard) noexcept {
+            if constexpr (std::is_same_v<_Cursor_type, const_cursor>)
+                return static_cast<const _Tree&>(shard._tree);
+            else
+                return shard._tree;
+        }
+
+        /**
+         *	@return whether shard at index is more than twice as large as its smaller neighbour, and rebalance_threshold
+         */
+        bool _Heavy(size_type index, const _Layout& layout) const noexcept {
+            const size_type _count = _shards[index]._count.load(std::memory_order_relaxed);
+            if (_count <= rebalance_threshold)
+                return false;
+            const size_type _lightest =
+                (std::min)(_Neighbour_count(index, index - 1, layout), _Neighbour_count(index, index + 1, layout));
+            return _lightest != _No_neighbour && _count > 2 * _lightest + rebalance_threshold;
+        }
+
+        static constexpr size_type _No_neighbour = (std::numeric_limits<size_type>::max)();
+
+        size_type _Neighbour_count(size_type index, size_type neighbour, const _Layout& layout) const noexcept {
+            if (neighbour >= _shard_count || (neighbour > index && index + 1 != layout._active && neighbour >= layout._active))
+                return _No_neighbour;
+            return neighbour < layout._active ? _shards[neighbour]._count.load(std::memory_order_relaxed) : 0;
+        }
+
+        /**
+         *	@brief moves elements from the shard at index to its smaller neighbour, then publishes new boundaries. Only one
+         *	thread rebalances at a time, others skip since the shard will be checked again by the next insertion.
+         *	Nodes of both shards are collected in order and both trees are rebuilt from them in O(n) without comparing
+         *	keys, and everything which can throw happens before, so an exception leaves both shards and the boundaries
+         *	unchanged.
+         */
+        void _Rebalance(size_type index) {
+            std::unique_lock<std::mutex> _guard(_rebalance_mtx, std::try_to_lock);
+            if (!_guard.owns_lock())
+                return;
+            _Guard _pin(_domain);
+            _domain.reserve_retire(_pin);
+            const _Layout* const _layout = _current.load(std::memory_order_acquire);  // only changed by rebalancing
+            if (!_Heavy(index, *_layout))
+                return;
+            const size_type _target = _Neighbour_count(index, index - 1, *_layout) <= _Neighbour_count(index, index + 1, *_layout)
+                                        ? index - 1
+                                        : index + 1;
+            std::scoped_lock _lock(_shards[(std::min)(index, _target)]._mtx, _shards[(std::max)(index, _target)]._mtx);
+            _Tree&          _from   = _shards[index]._tree;
+            _Tree&          _to     = _shards[_target]._tree;
+            const size_type _moving = _from.size() > _to.size() ? (_from.size() - _to.size()) / 2 : 0;
+            if (_moving == 0)
+                return;
+            auto _next = std::make_unique<_Layout>(*_layout);
+            if (_target > index) {
+                const auto _first = std::prev(_from.end(), static_cast<difference_type>(_moving));
+                if (_target == _next->_active) {
+                    _next->_bounds.push_back(_Key_of(*_first));
+                    ++_next->_active;
+                }
+                else
+                    _next->_bounds[index] = _Key_of(*_first);
+            }
+            else
+                _next->_bounds[_target] = _Key_of(*std::next(_from.begin(), static_cast<difference_type>(_moving)));
+            _Tree&                _low  = _target < index ? _to : _from;
+            _Tree&                _high = _target < index ? _from : _to;
+            const size_type       _split = _target < index ? _to.size() + _moving : _from.size() - _moving;
+            std::vector<_Nodeptr> _nodes;
+            _nodes.reserve(_low.size() + _high.size());
+            for (_Tree* const _tree : { &_low, &_high })
+                for (auto _iter = _tree->begin(); _iter != _tree->end(); ++_iter)
+                    _nodes.push_back(_iter.base());
+            _Tree_accessor::rebuild(std::addressof(_low), _nodes.data(), _split);
+            _Tree_accessor::rebuild(std::addressof(_high), _nodes.data() + _split, _nodes.size() - _split);
+            _shards[index]._count.store(_from.size(), std::memory_order_relaxed);
+            _shards[_target]._count.store(_to.size(), std::memory_order_relaxed);
+            _current.store(_next.release(), std::memory_order_release);
+            _domain.retire(_pin, const_cast<_Layout*>(_layout), _Free_layout);
+        }
+
+        key_compare               _cmpr;
+        const size_type           _shard_count;
+        std::unique_ptr<_Shard[]> _shards;
+        std::atomic<_Layout*>     _current;
+        std::mutex                _rebalance_mtx;
+        mutable _Epoch_domain     _domain;
+    };
+
+    template <class _Tp, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(_Tp),
+              template <class, class, class, class...> class _Family = rb_set>
+    using sharded_set = _Sharded_tree<_Family<_Tp, _Compare, _Alloc>>;
+#define MAP_VALUE_TYPE std::pair<const _Key, _Value>
+    template <class _Key, class _Value, class _Compare = std::less<>, class _Alloc = DEFAULT_ALLOC(MAP_VALUE_TYPE),
+              template <class, class, class, class, class...> class _Family = rb_map>
+    using sharded_map = _Sharded_tree<_Family<_Key, _Value, _Compare, _Alloc>>;
+#undef MAP_VALUE_TYPE
+}  // namespace xstl
+
+#endif  // _SHARDED_MAP_HPP_
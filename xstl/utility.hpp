@@ -129,7 +129,7 @@ namespace xstl {
         };
         template <class _This, class... _Rest>
         struct _Check_rest<_This, _Rest...> {
-            static constexpr bool value = _This::value && _Check_rest<_Rest...>;
+            static constexpr bool value = !_This::value && _Check_rest<_Rest...>::value;
         };
         template <class _Last>
         struct _Check_rest<_Last> {
@@ -29,6 +29,15 @@
 #define UNREACHABLE() __assume(false)
 #endif
 
+#if defined __GNUC__  // GCC, Clang, ICC
+#define XSTL_PREFETCH(ADDR) __builtin_prefetch(ADDR)
+#elif defined _MSC_VER && (defined _M_IX86 || defined _M_X64)  // MSVC
+#include <xmmintrin.h>
+#define XSTL_PREFETCH(ADDR) _mm_prefetch(reinterpret_cast<const char*>(ADDR), _MM_HINT_T0)
+#else
+#define XSTL_PREFETCH(ADDR) static_cast<void>(ADDR)
+#endif
+
 #define MISMATCH_ALLOCATOR_MESSAGE(CONTAINER, VALUE_TYPE)               \
     CONTAINER " requires that Allocator's value_type match " VALUE_TYPE \
               " (See N4659 26.2.1 [container.requirements.general]/16 allocator_type)"